@@ -1,17 +1,71 @@
 #include "first_app.h"
+#include "headless_app.h"
+#include "transform_benchmark.h"
 
 // Standard libraries
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
+#ifdef _WIN32
 #include <windows.h> // TESTING DEBUG
+#endif
 
-int main() {
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+	// Windows subsystem build has no console of its own, elsewhere stdout already goes to the terminal
 	AllocConsole();
 	FILE* stream;
 	freopen_s(&stream, "CONIN$", "r", stdin);
 	freopen_s(&stream, "CONOUT$", "w", stdout);
 	freopen_s(&stream, "CONOUT$", "w", stderr);
+#endif
+
+	// --headless [frames] [png|raw|ffmpeg] [output] renders offscreen without a window (no surface/swapchain needed),
+	// with an encoder every frame gets written out (output is the file prefix, or the video for ffmpeg)
+	if (argc > 1 && strcmp(argv[1], "--headless") == 0) {
+		uint32_t frameCount = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 10)) : 1000;
+		try {
+			std::optional<vkm::VkmFrameCapture::Settings> capture;
+			if (argc > 3) {
+				capture.emplace();
+				capture->encoder = vkm::VkmFrameCapture::encoderFromName(argv[3]);
+				capture->output = argc > 4 ? argv[4] : (capture->encoder == vkm::VkmFrameCapture::Encoder::FfmpegPipe ? "capture.mp4" : "capture");
+				capture->waitWhenFull = true; // Batch output wants every frame
+			}
+			vkm::HeadlessApp app{};
+			app.run(frameCount, capture);
+		}
+		catch (const std::exception &e) {
+			std::cerr << e.what() << '\n';
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// --bench-instancing [objects] [frames] compares the push constant and instanced draw paths, also headless
+	if (argc > 1 && strcmp(argv[1], "--bench-instancing") == 0) {
+		uint32_t objectCount = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 10)) : 10000;
+		uint32_t frameCount = argc > 3 ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 10)) : 500;
+		try {
+			vkm::HeadlessApp app{};
+			app.benchmarkDrawPaths(objectCount, frameCount);
+		}
+		catch (const std::exception &e) {
+			std::cerr << e.what() << '\n';
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// --bench-transforms [objects] [iterations] times the transform kernels, CPU only
+	if (argc > 1 && strcmp(argv[1], "--bench-transforms") == 0) {
+		uint32_t objectCount = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 10)) : 100000;
+		uint32_t iterations = argc > 3 ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 10)) : 200;
+		vkm::runTransformBenchmark(objectCount, iterations);
+		return EXIT_SUCCESS;
+	}
 
 	vkm::FirstApp app{};
 
@@ -1,3 +1,6 @@
 X:\Vulkan\VulkanSDK\Bin\glslc.exe shaders\simple_shader.vert -o shaders\simple_shader.vert.spv
 X:\Vulkan\VulkanSDK\Bin\glslc.exe shaders\simple_shader.frag -o shaders\simple_shader.frag.spv
+X:\Vulkan\VulkanSDK\Bin\glslc.exe shaders\simple_instanced.vert -o shaders\simple_instanced.vert.spv
+X:\Vulkan\VulkanSDK\Bin\glslc.exe shaders\simple_instanced.frag -o shaders\simple_instanced.frag.spv
+X:\Vulkan\VulkanSDK\Bin\glslc.exe shaders\cull.comp -o shaders\cull.comp.spv
 pause
\ No newline at end of file
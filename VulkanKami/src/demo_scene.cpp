@@ -0,0 +1,83 @@
+#include "demo_scene.h"
+#include "vkm_components.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// Standard Libraries
+#include <cassert>
+#include <cmath>
+
+namespace vkm {
+
+	std::vector<VkmModelHandle> createDemoScene(VkmDevice& device, VkmModelRegistry& models, VkmWorld& world) {
+		std::vector<VkmModel::Vertex> vertices{
+			{ {0.0f, -0.5f}, {1.0f, 0.0f, 0.0f} },
+			{ {0.5f, 0.5f},  {0.0f, 1.0f, 0.0f} },
+		{ {-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f} }};
+		VkmModelHandle vkmModel = models.create("triangle", vertices);
+
+		std::vector<glm::vec3> colors{
+			{1.f, .7f, .73f},
+			{1.f, .87f, .73f},
+			{1.f, 1.f, .73f},
+			{.73f, 1.f, .8f},
+			{.73, .88f, 1.f}
+		};
+		for (auto& color : colors) {
+			color = glm::pow(color, glm::vec3{ 2.2f });
+		}
+		for (int i = 0; i < 40; i++) {
+			Transform2dComponent transform{};
+			transform.scale = glm::vec2(.5f) + i * 0.025f;
+			transform.rotation = i * glm::pi<float>() * .025f;
+			// Same spin the render loop used to apply to the i-th object
+			world.createEntity(
+				transform,
+				ModelComponent{ vkmModel },
+				ColorComponent{ colors[i % colors.size()] },
+				SpinComponent{ 0.00005f * (i + 1) });
+		}
+
+		// Every model created above goes to the GPU in one staging submission
+		device.flushUploads();
+		return { vkmModel };
+	}
+
+	std::vector<VkmModelHandle> createSpriteGrid(
+		VkmDevice& device, VkmModelRegistry& models, VkmWorld& world, uint32_t count, uint32_t modelCount) {
+		assert(modelCount > 0 && "Sprite grid needs at least one model");
+		std::vector<VkmModelHandle> spriteModels;
+		for (uint32_t m = 0; m < modelCount; m++) {
+			// Slightly different shapes so the models really are different
+			float tip = -0.5f + 0.2f * m / modelCount;
+			std::vector<VkmModel::Vertex> vertices{
+				{ {0.0f, tip}, {1.0f, 1.0f, 1.0f} },
+				{ {0.5f, 0.5f}, {1.0f, 1.0f, 1.0f} },
+				{ {-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f} }};
+			spriteModels.push_back(models.create(vertices));
+		}
+
+		const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(count))));
+		const float cellSize = 2.f / side;
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t x = i % side;
+			uint32_t y = i / side;
+			Transform2dComponent transform{};
+			transform.translation = { -1.f + (x + .5f) * cellSize, -1.f + (y + .5f) * cellSize };
+			transform.scale = glm::vec2(cellSize * .8f);
+			transform.rotation = i * 0.1f;
+			world.createEntity(
+				transform,
+				ModelComponent{ spriteModels[i % modelCount] },
+				ColorComponent{ { static_cast<float>(x) / side, static_cast<float>(y) / side, .5f } },
+				SpinComponent{ 0.00005f * (i + 1) });
+		}
+
+		device.flushUploads();
+		return spriteModels;
+	}
+
+} // Namespace vkm
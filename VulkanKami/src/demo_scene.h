@@ -0,0 +1,23 @@
+#pragma once
+
+#include "vkm_device.h"
+#include "vkm_ecs.h"
+#include "vkm_model_registry.h"
+
+// Standard Library
+#include <cstdint>
+#include <vector>
+
+namespace vkm {
+
+	// Adds the triangle spiral both the windowed and the headless app render to world.
+	// Uploads are flushed before returning. Both return the models they hold a reference to, release them
+	// once the entities are gone (or leave them to the registry's destructor)
+	std::vector<VkmModelHandle> createDemoScene(VkmDevice& device, VkmModelRegistry& models, VkmWorld& world);
+
+	// count small triangles on a grid covering the screen, spread over modelCount shared models.
+	// Lots of objects and few models, what the draw path benchmark wants
+	std::vector<VkmModelHandle> createSpriteGrid(
+		VkmDevice& device, VkmModelRegistry& models, VkmWorld& world, uint32_t count, uint32_t modelCount = 4);
+
+} // Namespace vkm
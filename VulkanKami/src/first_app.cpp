@@ -1,6 +1,8 @@
 #include "first_app.h"
 
 #include "simple_render_system.h"
+#include "demo_scene.h"
+#include "vkm_cpu_profiler.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -10,58 +12,202 @@
 // Standard Libraries
 #include <stdexcept>
 #include <array>
+#include <iostream>
+#include <utility>
 
 namespace vkm {
 
 	FirstApp::FirstApp() {
+		VkmCpuProfiler::get().setThreadName("main");
 		loadGameObjects();
+		std::cout << "Device memory: " << vkmDevice.getAllocatorStats() << std::endl;
+		std::cout << "Swap chain pass: " << (vkmRenderer.usesDynamicRendering() ? "dynamic rendering" : "render pass") << std::endl;
+		std::cout << "Swap chain " << vkmRenderer.getDepthMemoryReport({ 3840, 2160 }) << std::endl;
 	}
 
 	FirstApp::~FirstApp() {}
 
 	void FirstApp::run() {
-		SimpleRenderSystem simpleRenderSystem{ vkmDevice, vkmRenderer.getSwapChainRenderPass() };
+		SimpleRenderSystem simpleRenderSystem{ vkmDevice, modelRegistry, vkmRenderer.getRenderTarget(), pipelineCompiler };
 
+		auto millisecondsSinceStart = [this]() {
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		};
+		bool firstFrame = true;
+		bool pipelinesReady = false;
+		auto currentTime = std::chrono::steady_clock::now();
+		bool traceKeyWasDown = false;
+		uint32_t traceCount = 0;
+		// 1/2/3 switch between low latency, throughput and power save, no restart needed
+		const std::array<std::pair<int, VkmLatencyMode>, 3> latencyKeys{ {
+			{ GLFW_KEY_1, VkmLatencyMode::LowLatency },
+			{ GLFW_KEY_2, VkmLatencyMode::Throughput },
+			{ GLFW_KEY_3, VkmLatencyMode::PowerSave } } };
+		std::array<bool, 3> latencyKeyWasDown{};
+		// P toggles recording the scene into secondary command buffers on the thread pool
+		bool parallelKeyWasDown = false;
+		bool parallelRecording = false;
+
+		// F11 starts/stops writing every frame out as capture_<n>_000000.png, frames get dropped if the encoder falls behind
+		bool captureKeyWasDown = false;
+		uint32_t captureCount = 0;
+		std::unique_ptr<VkmFrameCapture> frameCapture;
+
+		// With dynamic rendering the frame goes through the render graph, the main pass is its only pass for now
+		FrameInfo* graphFrame = nullptr; // The frame being recorded while the graph executes
+		VkmRenderer::SwapChainTargets swapChainTargets{};
+		if (vkmRenderer.usesDynamicRendering()) {
+			swapChainTargets = vkmRenderer.importSwapChain(renderGraph);
+			renderGraph.addPass("main pass",
+				[&](VkmRenderGraph::PassBuilder& pass) {
+					pass.writeColor(swapChainTargets.color, VkClearColorValue{ { 0.01f, 0.01f, 0.01f, 1.0f } }); // Background color
+					pass.writeDepth(swapChainTargets.depth, VkClearDepthStencilValue{ 1.0f, 0 });
+					pass.allowSecondaries();
+				},
+				[&](const VkmRenderGraph::PassContext& context) {
+					graphFrame->secondaryRecorder = context.secondaryRecorder;
+					simpleRenderSystem.renderGameObjects(*graphFrame);
+				});
+		}
 
 		while (!vkmWindow.shouldClose()) {
-			glfwPollEvents();
-			
+			VKM_PROFILE_SCOPE("frame");
+			{
+				VKM_PROFILE_SCOPE("glfwPollEvents");
+				// Nothing gets rendered while minimized, sleep until something happens instead of spinning.
+				// The timeout keeps the rest of the loop (pipeline builds finishing etc) ticking
+				if (vkmWindow.isMinimized()) {
+					glfwWaitEventsTimeout(0.1);
+				} else {
+					glfwPollEvents();
+				}
+			}
+
+			// F12 dumps the last few seconds of CPU markers for chrome://tracing or ui.perfetto.dev
+			bool traceKeyDown = glfwGetKey(vkmWindow.getGLFWwindow(), GLFW_KEY_F12) == GLFW_PRESS;
+			if (traceKeyDown && !traceKeyWasDown) {
+				std::string tracePath = "cpu_trace_" + std::to_string(traceCount++) + ".json";
+				if (VkmCpuProfiler::get().writeChromeTrace(tracePath)) {
+					std::cout << "CPU trace written to " << tracePath << std::endl;
+				} else {
+					std::cerr << "Failed to write CPU trace " << tracePath << std::endl;
+				}
+			}
+			traceKeyWasDown = traceKeyDown;
+
+			for (size_t i = 0; i < latencyKeys.size(); i++) {
+				bool keyDown = glfwGetKey(vkmWindow.getGLFWwindow(), latencyKeys[i].first) == GLFW_PRESS;
+				if (keyDown && !latencyKeyWasDown[i] && vkmRenderer.getLatencyMode() != latencyKeys[i].second) {
+					printLatencyReport(); // The stats start over with the new mode
+					vkmRenderer.setLatencyMode(latencyKeys[i].second);
+					std::cout << "Latency mode: " << VkmPresentPolicy::modeName(latencyKeys[i].second) << std::endl;
+				}
+				latencyKeyWasDown[i] = keyDown;
+			}
+
+			bool parallelKeyDown = glfwGetKey(vkmWindow.getGLFWwindow(), GLFW_KEY_P) == GLFW_PRESS;
+			if (parallelKeyDown && !parallelKeyWasDown) {
+				parallelRecording = !parallelRecording;
+				vkmRenderer.setParallelRecording(parallelRecording ? &threadPool : nullptr);
+				std::cout << "Recording: " << (parallelRecording ? "parallel secondary command buffers" : "inline") << std::endl;
+			}
+			parallelKeyWasDown = parallelKeyDown;
+
+			bool captureKeyDown = glfwGetKey(vkmWindow.getGLFWwindow(), GLFW_KEY_F11) == GLFW_PRESS;
+			if (captureKeyDown && !captureKeyWasDown) {
+				if (frameCapture) {
+					frameCapture->flush();
+					std::cout << "Capture stopped: " << frameCapture->getStats() << std::endl;
+					frameCapture.reset();
+				} else if (!vkmRenderer.canCapture()) {
+					std::cerr << "Capture: the surface doesn't allow copying out of swap chain images" << std::endl;
+				} else {
+					VkmFrameCapture::Settings settings{};
+					settings.output = "capture_" + std::to_string(captureCount++);
+					frameCapture = std::make_unique<VkmFrameCapture>(vkmDevice, settings);
+					std::cout << "Capture started: " << settings.output << "_*.png" << std::endl;
+				}
+			}
+			captureKeyWasDown = captureKeyDown;
+
+			auto newTime = std::chrono::steady_clock::now();
+			float frameTime = std::chrono::duration<float>(newTime - currentTime).count();
+			currentTime = newTime;
+
 			if (auto commandBuffer = vkmRenderer.beginFrame()) {
-				vkmRenderer.beginSwapChainRenderPass(commandBuffer);
-				simpleRenderSystem.renderGameObjects(commandBuffer, gameObjects);
-				vkmRenderer.endSwapChainRenderPass(commandBuffer);
+				FrameInfo frameInfo{
+					vkmRenderer.getFrameIndex(),
+					frameTime,
+					commandBuffer,
+					&vkmRenderer.getGpuProfiler() };
+
+				spinSystem.update(world, threadPool);
+				simpleRenderSystem.prepareFrame(frameInfo, world);
+				if (vkmRenderer.usesDynamicRendering()) {
+					graphFrame = &frameInfo;
+					vkmRenderer.executeGraph(commandBuffer, renderGraph, swapChainTargets);
+					graphFrame = nullptr;
+				} else {
+					vkmRenderer.beginSwapChainRenderPass(commandBuffer);
+					frameInfo.secondaryRecorder = vkmRenderer.getSecondaryRecorder();
+					simpleRenderSystem.renderGameObjects(frameInfo);
+					vkmRenderer.endSwapChainRenderPass(commandBuffer);
+				}
+				if (frameCapture) {
+					frameCapture->recordCopy(commandBuffer, vkmRenderer.getCurrentImage(),
+						vkmRenderer.getSwapChainImageFormat(), vkmRenderer.getSwapChainExtent(), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+				}
 				vkmRenderer.endFrame();
+				if (frameCapture) {
+					frameCapture->poll();
+				}
+
+				if (firstFrame) {
+					firstFrame = false;
+					if (vkmRenderer.usesDynamicRendering()) {
+						std::cout << renderGraph;
+					}
+					std::cout << "Startup: first frame submitted after " << millisecondsSinceStart() << " ms" << std::endl;
+				}
+			}
+
+			if (!pipelinesReady && pipelineCompiler.pendingCount() == 0 && simpleRenderSystem.isPipelineReady()) {
+				pipelinesReady = true;
+				auto pipelineStats = vkmDevice.getPipelineCacheStats();
+				std::cout << "Startup: all pipelines ready after " << millisecondsSinceStart() << " ms ("
+					<< pipelineStats.pipelineCount << " created, " << pipelineStats.totalCreateMs << " ms total, max "
+					<< pipelineStats.maxCreateMs << " ms, " << (pipelineStats.warm ? "warm" : "cold") << " cache)" << std::endl;
 			}
 		}
 		
 		vkDeviceWaitIdle(vkmDevice.device());
-	}
+		printLatencyReport();
+		if (frameCapture) {
+			frameCapture->flush();
+			std::cout << "Capture stopped: " << frameCapture->getStats() << std::endl;
+		}
 
-	void FirstApp::loadGameObjects() {
-		std::vector<VkmModel::Vertex> vertices{
-			{ {0.0f, -0.5f}, {1.0f, 0.0f, 0.0f} },
-			{ {0.5f, 0.5f},  {0.0f, 1.0f, 0.0f} },
-		{ {-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f} }};
-		auto vkmModel = std::make_shared<VkmModel>(vkmDevice, vertices);
-
-		std::vector<glm::vec3> colors{
-			{1.f, .7f, .73f},
-			{1.f, .87f, .73f},
-			{1.f, 1.f, .73f},
-			{.73f, 1.f, .8f},
-			{.73, .88f, 1.f}
-		};
-		for (auto& color : colors) {
-			color = glm::pow(color, glm::vec3{ 2.2f });
+		const VkmRenderer::ResizeStats& resizeStats = vkmRenderer.getResizeStats();
+		if (resizeStats.count > 0) {
+			std::cout << "Resize: " << resizeStats.count << " swap chain recreations, last " << resizeStats.lastMs
+				<< " ms until the next frame (" << resizeStats.lastRecreateMs << " ms recreating), max "
+				<< resizeStats.maxMs << " ms" << std::endl;
 		}
-		for (int i = 0; i < 40; i++) {
-			auto triangle = VkmGameObject::createGameObject();
-			triangle.model = vkmModel;
-			triangle.transform2d.scale = glm::vec2(.5f) + i * 0.025f;
-			triangle.transform2d.rotation = i * glm::pi<float>() * .025f;
-			triangle.color = colors[i % colors.size()];
-			gameObjects.push_back(std::move(triangle));
+	}
+
+	void FirstApp::printLatencyReport() {
+		VkmLatencyTracker::Stats stats = vkmRenderer.getLatencyStats();
+		if (stats.frameCount == 0) {
+			return;
 		}
+		std::cout << "Latency (" << VkmPresentPolicy::modeName(vkmRenderer.getLatencyMode()) << ", "
+			<< VkmSwapChain::presentModeName(vkmRenderer.getPresentMode()) << ", "
+			<< vkmRenderer.getFramesInFlight() << " in flight): input to GPU done over " << stats.frameCount
+			<< " frames, avg " << stats.averageMs << " ms, p99 " << stats.p99Ms << " ms, max " << stats.maxMs << " ms" << std::endl;
+	}
+
+	void FirstApp::loadGameObjects() {
+		createDemoScene(vkmDevice, modelRegistry, world); // Lives as long as the app
 	}
 
 } // Namespace vkm
\ No newline at end of file
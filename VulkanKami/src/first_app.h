@@ -2,11 +2,17 @@
 
 #include "vkm_window.h"
 #include "vkm_device.h"
-#include "vkm_game_object.h"
+#include "vkm_ecs.h"
+#include "vkm_frame_capture.h"
+#include "vkm_model_registry.h"
 #include "vkm_renderer.h"
+#include "vkm_thread_pool.h"
+#include "vkm_pipeline_compiler.h"
+#include "spin_system.h"
 // #include "vkm_model.h"
 
 // Standard Library
+#include <chrono>
 #include <memory>
 #include <vector>
 
@@ -26,13 +32,20 @@ namespace vkm {
 
 	private:
 		void loadGameObjects();
+		void printLatencyReport();
 
 		// ORDER HERE MATTERS
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now(); // Startup is measured from here
 		VkmWindow vkmWindow{WIDTH, HEIGHT, "VulkanKami"};
 		VkmDevice vkmDevice{ vkmWindow };
 		VkmRenderer vkmRenderer{ vkmWindow, vkmDevice };
+		VkmRenderGraph renderGraph{ vkmDevice, { WIDTH, HEIGHT }, 1 }; // Extent and frame slots follow the renderer
+		VkmThreadPool threadPool{};
+		VkmPipelineCompiler pipelineCompiler{ vkmDevice, threadPool };
 
-		std::vector<VkmGameObject> gameObjects;
+		VkmModelRegistry modelRegistry{ vkmDevice };
+		VkmWorld world{};
+		SpinSystem spinSystem{};
 
 	};
 } // Namespace vkm
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "headless_app.h"
+
+#include "simple_render_system.h"
+#include "demo_scene.h"
+#include "vkm_cpu_profiler.h"
+
+// Standard Libraries
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+namespace vkm {
+
+	HeadlessApp::HeadlessApp() {
+		VkmCpuProfiler::get().setThreadName("main");
+		createDemoScene(vkmDevice, modelRegistry, world); // Lives as long as the app
+		std::cout << "Device memory: " << vkmDevice.getAllocatorStats() << std::endl;
+	}
+
+	HeadlessApp::~HeadlessApp() {}
+
+	void HeadlessApp::run(uint32_t frameCount, const std::optional<VkmFrameCapture::Settings>& capture) {
+		using clock = std::chrono::steady_clock;
+
+		SimpleRenderSystem simpleRenderSystem{ vkmDevice, modelRegistry, vkmRenderer.getRenderTarget(), pipelineCompiler };
+
+		// Benchmarks should measure the real pipeline, not the fallback
+		while (!simpleRenderSystem.isPipelineReady()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		std::cout << "Startup: ready to render after "
+			<< std::chrono::duration<double, std::milli>(clock::now() - startTime).count() << " ms" << std::endl;
+
+		std::unique_ptr<VkmFrameCapture> frameCapture;
+		if (capture) {
+			frameCapture = std::make_unique<VkmFrameCapture>(vkmDevice, *capture);
+		}
+
+		std::vector<double> frameTimes;
+		frameTimes.reserve(frameCount);
+		auto runStart = clock::now();
+		for (uint32_t i = 0; i < frameCount; i++) {
+			VKM_PROFILE_SCOPE("frame");
+			auto frameStart = clock::now();
+			auto commandBuffer = vkmRenderer.beginFrame();
+			FrameInfo frameInfo{
+				vkmRenderer.getFrameIndex(),
+				frameTimes.empty() ? 0.f : static_cast<float>(frameTimes.back() / 1000.0),
+				commandBuffer,
+				&vkmRenderer.getGpuProfiler() };
+
+			spinSystem.update(world, threadPool);
+			simpleRenderSystem.prepareFrame(frameInfo, world);
+			vkmRenderer.beginSwapChainRenderPass(commandBuffer);
+			simpleRenderSystem.renderGameObjects(frameInfo);
+			vkmRenderer.endSwapChainRenderPass(commandBuffer);
+			if (frameCapture) {
+				frameCapture->recordCopy(commandBuffer, vkmRenderer.getColorImage(vkmRenderer.getFrameIndex()),
+					VkmOffscreenRenderer::COLOR_FORMAT, vkmRenderer.getExtent(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+			}
+			vkmRenderer.endFrame();
+			if (frameCapture) {
+				frameCapture->poll();
+			}
+			frameTimes.push_back(std::chrono::duration<double, std::milli>(clock::now() - frameStart).count());
+		}
+		vkmRenderer.waitIdle();
+		double totalMs = std::chrono::duration<double, std::milli>(clock::now() - runStart).count();
+		if (frameCapture) {
+			// Not part of totalMs, whatever the encoder still has queued is its backlog and not render time
+			frameCapture->flush();
+			std::cout << "Capture (" << VkmFrameCapture::encoderName(capture->encoder) << " to " << capture->output
+				<< "): " << frameCapture->getStats() << std::endl;
+		}
+
+		if (frameCount > 0) {
+			std::sort(frameTimes.begin(), frameTimes.end());
+			std::cout << "Headless: " << frameCount << " frames (" << WIDTH << "x" << HEIGHT << ") in " << totalMs
+				<< " ms, " << frameCount * 1000.0 / totalMs << " fps, median frame " << frameTimes[frameTimes.size() / 2]
+				<< " ms, p99 " << frameTimes[std::min<size_t>(frameTimes.size() - 1, frameTimes.size() * 99 / 100)]
+				<< " ms" << std::endl;
+		}
+		for (const auto& scope : vkmRenderer.getGpuProfiler().getAllStats()) {
+			std::cout << "GPU " << scope.first << ": " << scope.second << std::endl;
+		}
+
+		// No keyboard here, the trace of the run is always written
+		if (VkmCpuProfiler::get().writeChromeTrace("cpu_trace_headless.json")) {
+			std::cout << "CPU trace written to cpu_trace_headless.json" << std::endl;
+		}
+
+		vkDeviceWaitIdle(vkmDevice.device());
+	}
+
+	void HeadlessApp::benchmarkDrawPaths(uint32_t objectCount, uint32_t frameCount) {
+		using clock = std::chrono::steady_clock;
+
+		VkmWorld sprites{};
+		std::vector<VkmModelHandle> spriteModels = createSpriteGrid(vkmDevice, modelRegistry, sprites, objectCount);
+		SimpleRenderSystem simpleRenderSystem{ vkmDevice, modelRegistry, vkmRenderer.getRenderTarget(), pipelineCompiler };
+		while (!simpleRenderSystem.isPipelineReady()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		vkmRenderer.getGpuProfiler().setLogInterval(0.0);
+
+		const std::pair<SimpleRenderSystem::DrawPath, const char*> paths[] = {
+			{ SimpleRenderSystem::DrawPath::PushConstants, "push constants" },
+			{ SimpleRenderSystem::DrawPath::Instanced, "instanced" },
+			{ SimpleRenderSystem::DrawPath::GpuDriven, "GPU driven" } };
+		for (const auto& path : paths) {
+			simpleRenderSystem.setDrawPath(path.first);
+			// Inline into the primary, then secondary command buffers recorded on the pool
+			for (bool parallel : { false, true }) {
+				vkmRenderer.setParallelRecording(parallel ? &threadPool : nullptr);
+
+				// The GPU stats are a rolling window, a warm up pass pushes the previous run's samples out
+				const uint32_t warmupFrames = VkmGpuProfiler::HISTORY_SIZE;
+				double recordMs = 0.0;
+				auto runStart = clock::now();
+				for (uint32_t i = 0; i < warmupFrames + frameCount; i++) {
+					if (i == warmupFrames) {
+						recordMs = 0.0;
+						runStart = clock::now();
+					}
+					auto commandBuffer = vkmRenderer.beginFrame();
+					FrameInfo frameInfo{ vkmRenderer.getFrameIndex(), 0.f, commandBuffer, &vkmRenderer.getGpuProfiler() };
+
+					auto recordStart = clock::now();
+					spinSystem.update(sprites, threadPool);
+					simpleRenderSystem.prepareFrame(frameInfo, sprites);
+					vkmRenderer.beginSwapChainRenderPass(commandBuffer);
+					frameInfo.secondaryRecorder = vkmRenderer.getSecondaryRecorder();
+					simpleRenderSystem.renderGameObjects(frameInfo);
+					vkmRenderer.endSwapChainRenderPass(commandBuffer);
+					recordMs += std::chrono::duration<double, std::milli>(clock::now() - recordStart).count();
+					vkmRenderer.endFrame();
+				}
+				vkmRenderer.waitIdle();
+				double totalSeconds = std::chrono::duration<double>(clock::now() - runStart).count();
+
+				// Secondaries can't be timed on their own, the whole pass is the closest there is
+				uint32_t draws = simpleRenderSystem.getLastDrawCount();
+				std::cout << "Draw path " << path.second << (parallel ? " (secondaries, " : " (inline, ");
+				if (parallel) {
+					std::cout << vkmRenderer.getSecondaryRecorder()->getLastBufferCount() << " buffers, ";
+				}
+				std::cout << objectCount << " objects, " << draws << " draws/frame): record "
+					<< recordMs / frameCount << " ms/frame, " << draws * 1000.0 * frameCount / recordMs << " draws/s and "
+					<< objectCount * 1000.0 * frameCount / recordMs << " objects/s recorded, " << frameCount / totalSeconds
+					<< " fps, GPU " << vkmRenderer.getGpuProfiler().getStats(parallel ? "main pass" : "SimpleRenderSystem") << std::endl;
+				if (path.first == SimpleRenderSystem::DrawPath::PushConstants) {
+					const VkmRenderQueue::Stats& queueStats = simpleRenderSystem.getRenderQueueStats();
+					std::cout << "  binds skipped per frame: " << queueStats.pipelineBindsSkipped << " pipeline, "
+						<< queueStats.modelBindsSkipped << " model" << std::endl;
+				} else if (path.first == SimpleRenderSystem::DrawPath::GpuDriven && !parallel) {
+					std::cout << "  visible after GPU culling: " << simpleRenderSystem.getGpuCuller().getLastVisibleCount()
+						<< ", GPU cull " << vkmRenderer.getGpuProfiler().getStats("GPU cull") << std::endl;
+				}
+			}
+		}
+		vkmRenderer.setParallelRecording(nullptr);
+
+		vkDeviceWaitIdle(vkmDevice.device());
+		for (VkmModelHandle model : spriteModels) {
+			modelRegistry.release(model);
+		}
+	}
+
+} // Namespace vkm
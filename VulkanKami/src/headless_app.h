@@ -0,0 +1,52 @@
+#pragma once
+
+#include "vkm_device.h"
+#include "vkm_ecs.h"
+#include "vkm_frame_capture.h"
+#include "vkm_model_registry.h"
+#include "vkm_offscreen_renderer.h"
+#include "vkm_thread_pool.h"
+#include "vkm_pipeline_compiler.h"
+#include "spin_system.h"
+
+// Standard Library
+#include <chrono>
+#include <optional>
+#include <vector>
+
+namespace vkm {
+	// Same scene and render systems as FirstApp but rendered offscreen on a headless device,
+	// for render nodes and CI benchmarks (works with lavapipe)
+	class HeadlessApp {
+
+	public:
+		static constexpr uint32_t WIDTH = 800;
+		static constexpr uint32_t HEIGHT = 600;
+
+		HeadlessApp();
+		~HeadlessApp();
+
+		HeadlessApp(const HeadlessApp &) = delete;
+		HeadlessApp &operator=(const HeadlessApp &) = delete;
+
+		// Renders frameCount frames as fast as possible and prints the timings. With capture every frame is read
+		// back and written out by the capture's encoder thread while rendering goes on
+		void run(uint32_t frameCount, const std::optional<VkmFrameCapture::Settings>& capture = std::nullopt);
+		// Renders a grid of objectCount sprites with the push constant path, then the instanced path,
+		// then GPU driven, each recorded inline and then in parallel into secondary command buffers.
+		// Prints CPU record time, draws and objects per second and GPU time for each
+		void benchmarkDrawPaths(uint32_t objectCount, uint32_t frameCount);
+
+	private:
+		// ORDER HERE MATTERS
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		VkmDevice vkmDevice{};
+		VkmOffscreenRenderer vkmRenderer{ vkmDevice, { WIDTH, HEIGHT } };
+		VkmThreadPool threadPool{};
+		VkmPipelineCompiler pipelineCompiler{ vkmDevice, threadPool };
+
+		VkmModelRegistry modelRegistry{ vkmDevice };
+		VkmWorld world{};
+		SpinSystem spinSystem{};
+	};
+} // Namespace vkm
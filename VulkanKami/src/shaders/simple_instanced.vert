@@ -0,0 +1,18 @@
+#version 450
+
+// Per vertex (binding 0)
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec3 color;
+
+// Per instance (binding 1), replaces the push constants of simple_shader
+layout(location = 2) in vec4 instanceTransform; // mat2 columns packed as (c0.x, c0.y, c1.x, c1.y)
+layout(location = 3) in vec2 instanceOffset;
+layout(location = 4) in vec3 instanceColor;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+	mat2 transform = mat2(instanceTransform.xy, instanceTransform.zw);
+	gl_Position = vec4(transform * position + instanceOffset, 0.0, 1.0);
+	fragColor = instanceColor;
+}
@@ -1,4 +1,7 @@
 #include "simple_render_system.h"
+#include "vkm_cpu_profiler.h"
+#include "vkm_components.h"
+#include "vkm_secondary_recorder.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -8,6 +11,8 @@
 // Standard Libraries
 #include <stdexcept>
 #include <array>
+#include <algorithm>
+#include <cstddef>
 
 namespace vkm {
 
@@ -17,12 +22,29 @@ namespace vkm {
 		alignas(16) glm::vec3 color;
 	};
 
-	SimpleRenderSystem::SimpleRenderSystem(VkmDevice& device, VkRenderPass renderPass) : vkmDevice{ device } {
+	static_assert(sizeof(SimpleRenderSystem::InstanceData) == VkmGpuCuller::INSTANCE_STRIDE,
+		"cull.comp writes instances in the instanced pipeline's vertex layout");
+
+	SimpleRenderSystem::SimpleRenderSystem(
+		VkmDevice& device, VkmModelRegistry& modelRegistry, const VkmRenderTarget& renderTarget, VkmPipelineCompiler& pipelineCompiler)
+		: vkmDevice{ device }, modelRegistry{ modelRegistry } {
+		renderQueue.setPushConstantSize(sizeof(SimplePushConstantData));
 		createPipelineLayout();
-		createPipeline(renderPass);
+		createPipeline(renderTarget, pipelineCompiler);
+		gpuCuller = std::make_unique<VkmGpuCuller>(vkmDevice);
 	}
 
 	SimpleRenderSystem::~SimpleRenderSystem() {
+		// Both wait for builds that are still running, they use the layout destroyed below
+		vkmPipeline.reset();
+		instancedPipeline.reset();
+		fallbackPipeline.reset();
+		gpuCuller.reset();
+		for (auto& instanceBuffer : instanceBuffers) {
+			if (instanceBuffer.buffer != VK_NULL_HANDLE) {
+				vkmDevice.destroyBuffer(instanceBuffer.buffer, instanceBuffer.allocation);
+			}
+		}
 		vkDestroyPipelineLayout(vkmDevice.device(), pipelineLayout, nullptr);
 	}
 
@@ -47,48 +69,289 @@ namespace vkm {
 		}
 	}
 
-	void SimpleRenderSystem::createPipeline(VkRenderPass renderPass) {
+	void SimpleRenderSystem::createPipeline(const VkmRenderTarget& renderTarget, VkmPipelineCompiler& pipelineCompiler) {
 		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 		// auto pipelineConfig =
 			// VkmPipeline::defaultPipelineConfigInfo(vkmSwapChain->width(), vkmSwapChain->height());
-		PipelineConfigInfo pipelineConfig{};
-		VkmPipeline::defaultPipelineConfigInfo(pipelineConfig);
-		pipelineConfig.renderPass = renderPass;
-		pipelineConfig.pipelineLayout = pipelineLayout;
-		vkmPipeline = std::make_unique<VkmPipeline>(
-			vkmDevice,
+		auto pipelineConfig = std::make_unique<PipelineConfigInfo>();
+		VkmPipeline::defaultPipelineConfigInfo(*pipelineConfig);
+		VkmPipeline::setRenderTarget(*pipelineConfig, renderTarget);
+		pipelineConfig->pipelineLayout = pipelineLayout;
+
+		auto fallbackConfig = std::make_unique<PipelineConfigInfo>();
+		VkmPipeline::defaultPipelineConfigInfo(*fallbackConfig);
+		VkmPipeline::setRenderTarget(*fallbackConfig, renderTarget);
+		fallbackConfig->pipelineLayout = pipelineLayout;
+		fallbackConfig->createFlags = VK_PIPELINE_CREATE_DISABLE_OPTIMIZATION_BIT;
+
+		// Same layout (the push constant range just goes unused), per instance data comes in on binding 1
+		auto instancedConfig = std::make_unique<PipelineConfigInfo>();
+		VkmPipeline::defaultPipelineConfigInfo(*instancedConfig);
+		VkmPipeline::setRenderTarget(*instancedConfig, renderTarget);
+		instancedConfig->pipelineLayout = pipelineLayout;
+		instancedConfig->bindingDescriptions.push_back({ 1, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE });
+		instancedConfig->attributeDescriptions.push_back(
+			{ 2, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, transform) });
+		instancedConfig->attributeDescriptions.push_back(
+			{ 3, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(InstanceData, offset) });
+		instancedConfig->attributeDescriptions.push_back(
+			{ 4, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(InstanceData, color) });
+
+		// Fallback first so a worker picks it up before the optimized builds
+		fallbackPipeline = pipelineCompiler.enqueue(
+			"src/shaders/simple_shader.vert.spv",
+			"src/shaders/simple_shader.frag.spv",
+			std::move(fallbackConfig));
+		vkmPipeline = pipelineCompiler.enqueue(
 			"src/shaders/simple_shader.vert.spv",
 			"src/shaders/simple_shader.frag.spv",
-			pipelineConfig);
+			std::move(pipelineConfig));
+		instancedPipeline = pipelineCompiler.enqueue(
+			"src/shaders/simple_instanced.vert.spv",
+			"src/shaders/simple_instanced.frag.spv",
+			std::move(instancedConfig));
+	}
+
+
+	void SimpleRenderSystem::prepareFrame(FrameInfo &frameInfo, VkmWorld &world) {
+		VKM_PROFILE_SCOPE("SimpleRenderSystem::prepareFrame");
+		// Flatten what the draw paths need out of the world's chunks, then all matrices in one SIMD pass
+		const uint32_t objectCount = world.count<Transform2dComponent, ModelComponent, ColorComponent>();
+		renderList.transforms.resize(objectCount);
+		renderList.models.resize(objectCount);
+		renderList.colors.resize(objectCount);
+		uint32_t next = 0;
+		world.forEachChunk<Transform2dComponent, ModelComponent, ColorComponent>(
+			[this, &next](uint32_t count, Transform2dComponent* transforms, ModelComponent* models, ColorComponent* colors) {
+				for (uint32_t i = 0; i < count; i++, next++) {
+					renderList.transforms.set(next, transforms[i]);
+					renderList.models[next] = modelRegistry.get(models[i].model);
+					renderList.colors[next] = colors[i].color;
+				}
+			});
+		renderList.transforms.computeMatrices();
+
+		culledFrameIndex = -1;
+		if (drawPath == DrawPath::GpuDriven && instancedPipeline.get() != nullptr) {
+			gpuCuller->cull(frameInfo, renderList);
+			culledFrameIndex = frameInfo.frameIndex;
+		}
+	}
+
+	void SimpleRenderSystem::renderGameObjects(FrameInfo &frameInfo) {
+		VKM_PROFILE_SCOPE("SimpleRenderSystem::renderGameObjects");
+		if (frameInfo.secondaryRecorder != nullptr) {
+			renderSecondaries(frameInfo);
+			return;
+		}
+
+		VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+		VkmGpuScope gpuScope{ frameInfo.gpuProfiler, commandBuffer, "SimpleRenderSystem" };
+
+		if (drawPath == DrawPath::GpuDriven && culledFrameIndex == frameInfo.frameIndex) {
+			instancedPipeline.get()->bind(commandBuffer);
+			gpuCuller->draw(frameInfo);
+			lastDrawCount = gpuCuller->getLastDrawCount();
+		} else if (drawPath != DrawPath::PushConstants && instancedPipeline.get() != nullptr) {
+			renderInstanced(frameInfo);
+		} else {
+			renderPushConstants(commandBuffer);
+		}
 	}
 
+	void SimpleRenderSystem::renderPushConstants(VkCommandBuffer commandBuffer) {
+		VkmPipeline* pipeline = pushConstantPipeline();
+		if (pipeline == nullptr) {
+			lastDrawCount = 0;
+			return;
+		}
 
-	void SimpleRenderSystem::renderGameObjects(VkCommandBuffer commandBuffer, std::vector<VkmGameObject> &gameObjects) {
-		int i = 0;
-		for (auto& obj : gameObjects) {
-			i += 1;
-			obj.transform2d.rotation =
-				glm::mod<float>(obj.transform2d.rotation + 0.00005f * i, 2.f * glm::pi<float>());
+		renderQueue.begin();
+		pushObjects(renderQueue, pipeline, 0, renderList.size());
+		renderQueue.submit(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+		renderQueueStats = renderQueue.getStats();
+		lastDrawCount = renderQueueStats.drawCount;
+	}
+
+	void SimpleRenderSystem::renderInstanced(FrameInfo &frameInfo) {
+		const uint32_t objectCount = renderList.size();
+		lastDrawCount = 0;
+		if (objectCount == 0) {
+			return;
 		}
 
-		vkmPipeline->bind(commandBuffer);
+		sortByModel();
+		InstanceBuffer& instanceBuffer = instanceBufferFor(frameInfo.frameIndex, objectCount);
+		writeInstances(static_cast<InstanceData*>(instanceBuffer.allocation.mappedData), 0, objectCount);
+		lastDrawCount = drawInstances(frameInfo.commandBuffer, instancedPipeline.get(), instanceBuffer.buffer, 0, objectCount);
+	}
+
+	void SimpleRenderSystem::renderSecondaries(FrameInfo &frameInfo) {
+		VkmSecondaryRecorder& recorder = *frameInfo.secondaryRecorder;
+		// No timestamps: the primary can't take any inside this pass and the profiler isn't thread safe
 
-		for (auto& obj : gameObjects) {
+		if (drawPath == DrawPath::GpuDriven && culledFrameIndex == frameInfo.frameIndex) {
+			// Already one indirect draw per model, nothing to split
+			VkmPipeline* pipeline = instancedPipeline.get();
+			recorder.record(1, [this, &frameInfo, pipeline](uint32_t, VkCommandBuffer commandBuffer) {
+				FrameInfo jobInfo = frameInfo;
+				jobInfo.commandBuffer = commandBuffer;
+				jobInfo.gpuProfiler = nullptr;
+				pipeline->bind(commandBuffer);
+				gpuCuller->draw(jobInfo);
+			});
+			lastDrawCount = gpuCuller->getLastDrawCount();
+			return;
+		}
+
+		const uint32_t objectCount = renderList.size();
+		lastDrawCount = 0;
+		if (objectCount == 0) {
+			return;
+		}
+		// Contiguous ranges, so concatenating the jobs' buffers in job order draws in the same order as one buffer would
+		const uint32_t jobCount = std::max(1u,
+			std::min(recorder.maxJobCount(), (objectCount + MIN_OBJECTS_PER_JOB - 1) / MIN_OBJECTS_PER_JOB));
+		auto rangeBegin = [objectCount, jobCount](uint32_t job) {
+			return static_cast<uint32_t>(static_cast<uint64_t>(objectCount) * job / jobCount);
+		};
+		jobDrawCounts.assign(jobCount, 0);
+
+		if (drawPath != DrawPath::PushConstants && instancedPipeline.get() != nullptr) {
+			// Sorting and (re)allocating the buffer stay on this thread, jobs fill and draw their own slice
+			sortByModel();
+			InstanceBuffer& instanceBuffer = instanceBufferFor(frameInfo.frameIndex, objectCount);
+			auto* instances = static_cast<InstanceData*>(instanceBuffer.allocation.mappedData);
+			VkBuffer buffer = instanceBuffer.buffer;
+			VkmPipeline* pipeline = instancedPipeline.get();
+			recorder.record(jobCount, [&](uint32_t job, VkCommandBuffer commandBuffer) {
+				writeInstances(instances, rangeBegin(job), rangeBegin(job + 1));
+				jobDrawCounts[job] = drawInstances(commandBuffer, pipeline, buffer, rangeBegin(job), rangeBegin(job + 1));
+			});
+		} else {
+			while (jobQueues.size() < jobCount) {
+				jobQueues.push_back(std::make_unique<VkmRenderQueue>());
+				jobQueues.back()->setPushConstantSize(sizeof(SimplePushConstantData));
+			}
+			// Each job sorts its own range, state is only deduplicated within a job
+			VkmPipeline* pipeline = pushConstantPipeline();
+			if (pipeline == nullptr) {
+				return;
+			}
+			recorder.record(jobCount, [&](uint32_t job, VkCommandBuffer commandBuffer) {
+				VkmRenderQueue& queue = *jobQueues[job];
+				queue.begin();
+				pushObjects(queue, pipeline, rangeBegin(job), rangeBegin(job + 1));
+				queue.submit(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+				jobDrawCounts[job] = queue.getStats().drawCount;
+			});
+
+			renderQueueStats = {};
+			for (uint32_t job = 0; job < jobCount; job++) {
+				const VkmRenderQueue::Stats& stats = jobQueues[job]->getStats();
+				renderQueueStats.drawCount += stats.drawCount;
+				renderQueueStats.pipelineBinds += stats.pipelineBinds;
+				renderQueueStats.pipelineBindsSkipped += stats.pipelineBindsSkipped;
+				renderQueueStats.modelBinds += stats.modelBinds;
+				renderQueueStats.modelBindsSkipped += stats.modelBindsSkipped;
+			}
+		}
+
+		for (uint32_t drawCount : jobDrawCounts) {
+			lastDrawCount += drawCount;
+		}
+	}
+
+	VkmPipeline* SimpleRenderSystem::pushConstantPipeline() {
+		// The fallback stays alive with the system, frames still in flight may have recorded it.
+		// Null for the first frame or two, before even the fallback is built
+		VkmPipeline* pipeline = vkmPipeline.get();
+		return pipeline != nullptr ? pipeline : fallbackPipeline.get();
+	}
+
+	void SimpleRenderSystem::pushObjects(VkmRenderQueue& queue, VkmPipeline* pipeline, uint32_t begin, uint32_t end) {
+		// No materials yet and everything is on one plane, so the key only sorts by pipeline and model
+		const VkmTransformBatch& transforms = renderList.transforms;
+		for (uint32_t i = begin; i < end; i++) {
 			SimplePushConstantData push{};
-			push.offset = obj.transform2d.translation;
-			push.color = obj.color;
-			push.transform = obj.transform2d.mat2();
-
-			vkCmdPushConstants(
-				commandBuffer,
-				pipelineLayout,
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-				0,
-				sizeof(SimplePushConstantData),
-				&push);
-			obj.model->bind(commandBuffer);
-			obj.model->draw(commandBuffer);
+			push.offset = { transforms.translationX[i], transforms.translationY[i] };
+			push.color = renderList.colors[i];
+			push.transform = transforms.matrix(i);
+			queue.push(pipeline, renderList.models[i], 0, 0.f, &push);
+		}
+	}
+
+	void SimpleRenderSystem::sortByModel() {
+		// Objects sharing a model have to be next to each other in the instance buffer to go out in one draw
+		const uint32_t objectCount = renderList.size();
+		const std::vector<VkmModel*>& models = renderList.models;
+		sortedObjects.resize(objectCount);
+		for (uint32_t i = 0; i < objectCount; i++) {
+			sortedObjects[i] = i;
+		}
+		std::stable_sort(sortedObjects.begin(), sortedObjects.end(), [&models](uint32_t a, uint32_t b) {
+			return models[a] < models[b];
+		});
+	}
+
+	void SimpleRenderSystem::writeInstances(InstanceData* instances, uint32_t begin, uint32_t end) {
+		const VkmTransformBatch& transforms = renderList.transforms;
+		for (uint32_t i = begin; i < end; i++) {
+			const uint32_t object = sortedObjects[i];
+			instances[i].transform = {
+				transforms.col0x[object], transforms.col0y[object], transforms.col1x[object], transforms.col1y[object] };
+			instances[i].offset = { transforms.translationX[object], transforms.translationY[object] };
+			instances[i].color = renderList.colors[object];
+		}
+	}
+
+	uint32_t SimpleRenderSystem::drawInstances(
+		VkCommandBuffer commandBuffer, VkmPipeline* pipeline, VkBuffer instanceBuffer, uint32_t begin, uint32_t end) {
+		pipeline->bind(commandBuffer);
+		VkDeviceSize instanceOffset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer, &instanceOffset);
+
+		const std::vector<VkmModel*>& models = renderList.models;
+		uint32_t drawCount = 0;
+		uint32_t first = begin;
+		while (first < end) {
+			VkmModel* model = models[sortedObjects[first]];
+			uint32_t last = first + 1;
+			while (last < end && models[sortedObjects[last]] == model) {
+				last++;
+			}
+
+			// Only touches binding 0, the instance buffer stays bound
+			model->bind(commandBuffer);
+			model->draw(commandBuffer, last - first, first);
+			drawCount++;
+			first = last;
+		}
+		return drawCount;
+	}
+
+	SimpleRenderSystem::InstanceBuffer& SimpleRenderSystem::instanceBufferFor(int frameIndex, uint32_t instanceCount) {
+		if (instanceBuffers.size() <= static_cast<size_t>(frameIndex)) {
+			instanceBuffers.resize(frameIndex + 1);
+		}
+
+		// The renderer has already waited for this slot's last frame, so nothing in flight still reads the old buffer
+		InstanceBuffer& instanceBuffer = instanceBuffers[frameIndex];
+		if (instanceBuffer.capacity < instanceCount) {
+			if (instanceBuffer.buffer != VK_NULL_HANDLE) {
+				vkmDevice.destroyBuffer(instanceBuffer.buffer, instanceBuffer.allocation);
+			}
+			uint32_t capacity = std::max(instanceCount, instanceBuffer.capacity * 2);
+			capacity = std::max(capacity, 64u);
+			vkmDevice.createBuffer(
+				sizeof(InstanceData) * capacity,
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				instanceBuffer.buffer,
+				instanceBuffer.allocation);
+			instanceBuffer.capacity = capacity;
 		}
+		return instanceBuffer;
 	}
 
-} // Namespace vkm
\ No newline at end of file
+} // Namespace vkm
@@ -1,8 +1,14 @@
 #pragma once
 
 #include "vkm_pipeline.h"
+#include "vkm_pipeline_compiler.h"
 #include "vkm_device.h"
-#include "vkm_game_object.h"
+#include "vkm_ecs.h"
+#include "vkm_model_registry.h"
+#include "vkm_frame_info.h"
+#include "vkm_render_queue.h"
+#include "vkm_gpu_culler.h"
+#include "vkm_render_list.h"
 
 // Standard Library
 #include <memory>
@@ -12,23 +18,90 @@ namespace vkm {
 	class SimpleRenderSystem {
 
 	public:
+		enum class DrawPath {
+			PushConstants, // One push + draw per object
+			Instanced, // Per object data in a per frame instance buffer, one draw per model
+			GpuDriven // Culled on the GPU into indirect draws, see VkmGpuCuller
+		};
 
-		SimpleRenderSystem(VkmDevice& device, VkRenderPass renderPass);
+		// What the instanced vertex shader reads per instance (binding 1)
+		struct InstanceData {
+			glm::vec4 transform; // mat2 columns packed as (c0.x, c0.y, c1.x, c1.y)
+			glm::vec2 offset;
+			glm::vec3 color;
+		};
+
+		SimpleRenderSystem(
+			VkmDevice& device, VkmModelRegistry& modelRegistry, const VkmRenderTarget& renderTarget, VkmPipelineCompiler& pipelineCompiler);
 		~SimpleRenderSystem();
 
 		SimpleRenderSystem(const VkmWindow &) = delete;
 		SimpleRenderSystem &operator=(const VkmWindow &) = delete;
 
-		void renderGameObjects(VkCommandBuffer commandBuffer, std::vector<VkmGameObject> &gameObjects);
+		// Fewer objects than this per recording job isn't worth another secondary command buffer
+		static constexpr uint32_t MIN_OBJECTS_PER_JOB = 1024;
+
+		// Every frame before the render pass begins: gathers every entity with a transform, model and color out of
+		// the world, computes their matrices and records the GPU culling pass. renderGameObjects draws that list,
+		// split over secondary command buffers when the frame has a secondary recorder
+		void prepareFrame(FrameInfo &frameInfo, VkmWorld &world);
+		void renderGameObjects(FrameInfo &frameInfo);
+		bool isPipelineReady() { return vkmPipeline.isReady() && instancedPipeline.isReady(); }
+
+		// Instanced and GpuDriven fall back to push constants until the instanced pipeline has compiled
+		void setDrawPath(DrawPath path) { drawPath = path; }
+		DrawPath getDrawPath() const { return drawPath; }
+		uint32_t getLastDrawCount() const { return lastDrawCount; }
+		VkmGpuCuller& getGpuCuller() { return *gpuCuller; }
+		// Binds done and skipped by the push constant path's last frame (summed over jobs when recorded in parallel)
+		const VkmRenderQueue::Stats& getRenderQueueStats() const { return renderQueueStats; }
 
 	private:
+		struct InstanceBuffer {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkmAllocation allocation;
+			uint32_t capacity = 0; // In instances
+		};
+
 		void createPipelineLayout();
-		void createPipeline(VkRenderPass renderPass);
+		void createPipeline(const VkmRenderTarget& renderTarget, VkmPipelineCompiler& pipelineCompiler);
+		void renderPushConstants(VkCommandBuffer commandBuffer);
+		void renderInstanced(FrameInfo &frameInfo);
+		void renderSecondaries(FrameInfo &frameInfo);
+		VkmPipeline* pushConstantPipeline();
+		void pushObjects(VkmRenderQueue& queue, VkmPipeline* pipeline, uint32_t begin, uint32_t end);
+		// sortedObjects = object indices grouped by model
+		void sortByModel();
+		// Instances [begin, end) in sortedObjects order
+		void writeInstances(InstanceData* instances, uint32_t begin, uint32_t end);
+		// Binds pipeline and the instance buffer, returns the number of draws
+		uint32_t drawInstances(
+			VkCommandBuffer commandBuffer, VkmPipeline* pipeline, VkBuffer instanceBuffer, uint32_t begin, uint32_t end);
+		InstanceBuffer& instanceBufferFor(int frameIndex, uint32_t instanceCount);
+
 		// ORDER HERE MATTERS
 		VkmDevice& vkmDevice;
+		VkmModelRegistry& modelRegistry;
 
 
-		std::unique_ptr<VkmPipeline> vkmPipeline;
+		// Unoptimized build of the same shaders, queued first and quick to build so there is something to draw
+		// with while the real pipeline is still on a worker thread
+		VkmPendingPipeline fallbackPipeline;
+		VkmPendingPipeline vkmPipeline;
+		VkmPendingPipeline instancedPipeline;
 		VkPipelineLayout pipelineLayout;
+
+		DrawPath drawPath = DrawPath::Instanced;
+		uint32_t lastDrawCount = 0;
+		VkmRenderQueue renderQueue;
+		std::vector<std::unique_ptr<VkmRenderQueue>> jobQueues; // One per recording job, jobs run concurrently
+		std::vector<uint32_t> jobDrawCounts;
+		VkmRenderQueue::Stats renderQueueStats{};
+		VkmRenderList renderList; // Built by prepareFrame
+		std::unique_ptr<VkmGpuCuller> gpuCuller;
+		int culledFrameIndex = -1; // Frame slot prepareFrame recorded the culling pass for, -1 if it didn't
+		// One per frame in flight, a frame only touches its own so the CPU never writes what the GPU reads
+		std::vector<InstanceBuffer> instanceBuffers;
+		std::vector<uint32_t> sortedObjects; // Scratch, object indices grouped by model
 	};
 } // Namespace vkm
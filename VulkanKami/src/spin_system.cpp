@@ -0,0 +1,23 @@
+#include "spin_system.h"
+#include "vkm_components.h"
+#include "vkm_cpu_profiler.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+namespace vkm {
+
+	void SpinSystem::update(VkmWorld &world, VkmThreadPool &threadPool) {
+		VKM_PROFILE_SCOPE("SpinSystem::update");
+		world.parallelForEachChunk<Transform2dComponent, SpinComponent>(threadPool,
+			[](uint32_t count, Transform2dComponent* transforms, SpinComponent* spins) {
+				for (uint32_t i = 0; i < count; i++) {
+					transforms[i].rotation =
+						glm::mod<float>(transforms[i].rotation + spins[i].speed, 2.f * glm::pi<float>());
+				}
+			});
+	}
+
+} // Namespace vkm
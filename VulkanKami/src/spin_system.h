@@ -0,0 +1,13 @@
+#pragma once
+
+#include "vkm_ecs.h"
+#include "vkm_thread_pool.h"
+
+namespace vkm {
+	// Turns every entity with a SpinComponent, chunks are spread over the thread pool
+	class SpinSystem {
+
+	public:
+		void update(VkmWorld &world, VkmThreadPool &threadPool);
+	};
+} // Namespace vkm
@@ -0,0 +1,92 @@
+#include "transform_benchmark.h"
+#include "vkm_transform_batch.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// Standard Libraries
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace vkm {
+
+	void runTransformBenchmark(uint32_t objectCount, uint32_t iterations) {
+		using clock = std::chrono::steady_clock;
+		if (objectCount == 0 || iterations == 0) {
+			return;
+		}
+
+		// Only the transforms matter here, no models
+		std::vector<Transform2dComponent> transforms(objectCount);
+		for (uint32_t i = 0; i < objectCount; i++) {
+			transforms[i].translation = { std::fmod(i * 0.37f, 2.f) - 1.f, std::fmod(i * 0.71f, 2.f) - 1.f };
+			transforms[i].scale = glm::vec2(.5f) + (i % 16) * 0.025f;
+			transforms[i].rotation = i * glm::pi<float>() * .025f;
+		}
+
+		// What renderGameObjects used to do per object: spin, then mat2() in the draw loop
+		std::vector<glm::mat2> scalarMatrices(objectCount);
+		float checksum = 0.f;
+		auto scalarStart = clock::now();
+		for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+			int i = 0;
+			for (auto& transform : transforms) {
+				i += 1;
+				transform.rotation = glm::mod<float>(transform.rotation + 0.00005f * i, 2.f * glm::pi<float>());
+				scalarMatrices[i - 1] = transform.mat2();
+			}
+			checksum += scalarMatrices[iteration % objectCount][0][0];
+		}
+		double scalarSeconds = std::chrono::duration<double>(clock::now() - scalarStart).count();
+		std::cout << "Transforms: " << objectCount << " objects x " << iterations << " iterations" << std::endl;
+		std::cout << "  Transform2dComponent::mat2: " << objectCount * static_cast<double>(iterations) / scalarSeconds
+			<< " objects/s" << std::endl;
+
+		const VkmTransformBatch::Kernel kernels[] = {
+			VkmTransformBatch::Kernel::Scalar, VkmTransformBatch::Kernel::Sse2, VkmTransformBatch::Kernel::Avx2 };
+		for (auto kernel : kernels) {
+			if (static_cast<int>(kernel) > static_cast<int>(VkmTransformBatch::bestKernel())) {
+				std::cout << "  batch " << VkmTransformBatch::kernelName(kernel) << ": not supported on this CPU" << std::endl;
+				continue;
+			}
+
+			VkmTransformBatch batch;
+			batch.setKernel(kernel);
+			batch.resize(objectCount);
+			for (uint32_t i = 0; i < objectCount; i++) {
+				batch.set(i, transforms[i]);
+			}
+			auto batchStart = clock::now();
+			for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+				batch.advanceRotations(0.00005f);
+				batch.computeMatrices();
+				checksum += batch.col0x[iteration % objectCount];
+			}
+			double batchSeconds = std::chrono::duration<double>(clock::now() - batchStart).count();
+
+			// Same rotations in, so the matrices should agree with mat2() to float precision
+			float maxError = 0.f;
+			for (uint32_t i = 0; i < objectCount; i++) {
+				Transform2dComponent reference = transforms[i];
+				reference.rotation = batch.rotation[i];
+				glm::mat2 expected = reference.mat2();
+				glm::mat2 actual = batch.matrix(i);
+				for (int column = 0; column < 2; column++) {
+					maxError = std::max(maxError, glm::length(expected[column] - actual[column]));
+				}
+			}
+
+			std::cout << "  batch " << VkmTransformBatch::kernelName(kernel) << ": "
+				<< objectCount * static_cast<double>(iterations) / batchSeconds << " objects/s ("
+				<< scalarSeconds / batchSeconds << "x), max error " << maxError << std::endl;
+		}
+		// Keeps the optimizer from throwing the loops away
+		std::cout << "  (checksum " << checksum << ")" << std::endl;
+	}
+
+} // Namespace vkm
@@ -0,0 +1,12 @@
+#pragma once
+
+// Standard Library
+#include <cstdint>
+
+namespace vkm {
+
+	// CPU only, no device needed. Times the per object Transform2dComponent::mat2 path against
+	// VkmTransformBatch with every kernel the CPU supports and prints objects/second for each
+	void runTransformBenchmark(uint32_t objectCount, uint32_t iterations);
+
+} // Namespace vkm
@@ -0,0 +1,274 @@
+#include "vkm_allocator.h"
+
+// Standard Libraries
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <iterator>
+#include <stdexcept>
+
+namespace vkm {
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	VkmAllocator::VkmAllocator(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize preferredBlockSize)
+		: device{ device }, preferredBlockSize{ preferredBlockSize } {
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+		maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+		pools.resize(memoryProperties.memoryTypeCount * 2);
+	}
+
+	VkmAllocator::~VkmAllocator() {
+		// Anything still alive here is a leak, but the memory still has to go back to the driver
+		for (uint32_t i = 0; i < pools.size(); i++) {
+			for (auto& block : pools[i].blocks) {
+				freeDeviceMemory(block.memory, block.mapped != nullptr);
+			}
+		}
+		pools.clear();
+	}
+
+	VkmAllocation VkmAllocator::allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool linearResource) {
+		assert(memoryType < memoryProperties.memoryTypeCount && "Invalid memory type");
+		assert((requirements.memoryTypeBits & (1u << memoryType)) && "Memory type not allowed by the resource");
+
+		VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+		const auto flags = memoryProperties.memoryTypes[memoryType].propertyFlags;
+		if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+			// Flushing/invalidating happens in nonCoherentAtomSize chunks, keep neighbours out of each other's atoms
+			alignment = std::max(alignment, nonCoherentAtomSize);
+		}
+
+		VkmAllocation allocation{};
+		allocation.memoryType = memoryType;
+		allocation.size = requirements.size;
+		allocation.poolIndex = memoryType * 2 + (linearResource ? 0 : 1);
+
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		const VkDeviceSize blockSize = blockSizeFor(memoryType);
+		if (requirements.size > blockSize / 2 || (flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+			// Big resources (render targets etc) would waste most of a block, give them their own memory.
+			// Lazily allocated memory is only backed once the driver needs it, a shared block would always be backed
+			void* mapped = nullptr;
+			allocation.memory = allocateDeviceMemory(requirements.size, memoryType, &mapped);
+			allocation.mappedData = mapped;
+			allocation.dedicated = true;
+			dedicatedCount++;
+			dedicatedBytes += requirements.size;
+			return allocation;
+		}
+
+		Pool& pool = pools[allocation.poolIndex];
+		for (auto& block : pool.blocks) {
+			VkDeviceSize offset;
+			if (suballocate(block, requirements.size, alignment, offset)) {
+				allocation.memory = block.memory;
+				allocation.offset = offset;
+				allocation.blockId = block.id;
+				allocation.mappedData = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+				return allocation;
+			}
+		}
+
+		// No block had room, grab a new one from the driver
+		Block block{};
+		block.size = blockSize;
+		block.memory = allocateDeviceMemory(blockSize, memoryType, &block.mapped);
+		block.id = pool.nextBlockId++;
+		block.freeRanges[0] = blockSize;
+
+		VkDeviceSize offset;
+		bool fits = suballocate(block, requirements.size, alignment, offset);
+		assert(fits && "Fresh block too small for allocation");
+		(void)fits;
+
+		allocation.memory = block.memory;
+		allocation.offset = offset;
+		allocation.blockId = block.id;
+		allocation.mappedData = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+		pool.blocks.push_back(std::move(block));
+		return allocation;
+	}
+
+	void VkmAllocator::free(VkmAllocation& allocation) {
+		if (allocation.memory == VK_NULL_HANDLE) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		if (allocation.dedicated) {
+			freeDeviceMemory(allocation.memory, allocation.mappedData != nullptr);
+			dedicatedCount--;
+			dedicatedBytes -= allocation.size;
+			allocation = VkmAllocation{};
+			return;
+		}
+
+		Pool& pool = pools[allocation.poolIndex];
+		auto blockIt = std::find_if(pool.blocks.begin(), pool.blocks.end(),
+			[&](const Block& block) { return block.id == allocation.blockId; });
+		assert(blockIt != pool.blocks.end() && "Freeing allocation from unknown block");
+		Block& block = *blockIt;
+
+		// Put the range back and merge it with the free neighbours on either side
+		VkDeviceSize offset = allocation.offset;
+		VkDeviceSize size = allocation.size;
+		auto next = block.freeRanges.lower_bound(offset);
+		if (next != block.freeRanges.begin()) {
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == offset) {
+				offset = prev->first;
+				size += prev->second;
+				block.freeRanges.erase(prev);
+			}
+		}
+		if (next != block.freeRanges.end() && offset + size == next->first) {
+			size += next->second;
+			block.freeRanges.erase(next);
+		}
+		block.freeRanges[offset] = size;
+		block.allocationCount--;
+
+		// Keep one empty block around per pool so a load/unload cycle doesn't hammer the driver
+		if (block.allocationCount == 0 && pool.blocks.size() > 1) {
+			freeDeviceMemory(block.memory, block.mapped != nullptr);
+			pool.blocks.erase(blockIt);
+		}
+
+		allocation = VkmAllocation{};
+	}
+
+	bool VkmAllocator::suballocate(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+		// Best fit: the smallest free range that can hold the aligned allocation
+		auto best = block.freeRanges.end();
+		VkDeviceSize bestSize = 0;
+		for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+			VkDeviceSize alignedOffset = alignUp(it->first, alignment);
+			VkDeviceSize padding = alignedOffset - it->first;
+			if (padding + size <= it->second && (best == block.freeRanges.end() || it->second < bestSize)) {
+				best = it;
+				bestSize = it->second;
+			}
+		}
+		if (best == block.freeRanges.end()) {
+			return false;
+		}
+
+		VkDeviceSize rangeOffset = best->first;
+		VkDeviceSize rangeSize = best->second;
+		offset = alignUp(rangeOffset, alignment);
+		block.freeRanges.erase(best);
+
+		// Alignment padding in front stays free, as does whatever is left behind the allocation
+		if (offset > rangeOffset) {
+			block.freeRanges[rangeOffset] = offset - rangeOffset;
+		}
+		VkDeviceSize end = offset + size;
+		if (end < rangeOffset + rangeSize) {
+			block.freeRanges[end] = rangeOffset + rangeSize - end;
+		}
+		block.allocationCount++;
+		return true;
+	}
+
+	VkDeviceMemory VkmAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped) {
+		if (liveDeviceAllocations >= maxAllocationCount) {
+			throw std::runtime_error("Exceeded maxMemoryAllocationCount!");
+		}
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate device memory!");
+		}
+		liveDeviceAllocations++;
+
+		*mapped = nullptr;
+		if (isHostVisible(memoryType)) {
+			if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+				*mapped = nullptr;
+				freeDeviceMemory(memory, false);
+				throw std::runtime_error("Failed to map device memory!");
+			}
+		}
+		return memory;
+	}
+
+	void VkmAllocator::freeDeviceMemory(VkDeviceMemory memory, bool mapped) {
+		if (mapped) {
+			vkUnmapMemory(device, memory);
+		}
+		vkFreeMemory(device, memory, nullptr);
+		liveDeviceAllocations--;
+	}
+
+	VkDeviceSize VkmAllocator::blockSizeFor(uint32_t memoryType) const {
+		// Small heaps (e.g. the 256MB BAR heap) get smaller blocks so one block can't eat the whole heap
+		const VkDeviceSize heapSize =
+			memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+		return std::min(preferredBlockSize, heapSize / 8);
+	}
+
+	bool VkmAllocator::isHostVisible(uint32_t memoryType) const {
+		return (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+	}
+
+	VkmAllocator::Stats VkmAllocator::getStats() const {
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		Stats stats{};
+		stats.dedicatedAllocationCount = dedicatedCount;
+		stats.dedicatedBytes = dedicatedBytes;
+		stats.allocationCount = dedicatedCount;
+		for (const auto& pool : pools) {
+			for (const auto& block : pool.blocks) {
+				stats.blockCount++;
+				stats.blockBytes += block.size;
+				stats.allocationCount += block.allocationCount;
+				for (const auto& range : block.freeRanges) {
+					stats.freeRangeCount++;
+					stats.freeBytes += range.second;
+					stats.largestFreeRange = std::max(stats.largestFreeRange, range.second);
+				}
+			}
+		}
+		stats.usedBytes = stats.blockBytes - stats.freeBytes;
+		if (stats.freeBytes > 0) {
+			stats.fragmentation = 1.f - static_cast<float>(stats.largestFreeRange) / static_cast<float>(stats.freeBytes);
+		}
+		return stats;
+	}
+
+	uint32_t VkmAllocator::deviceAllocationCount() const {
+		std::lock_guard<std::mutex> lock{ mutex };
+		return liveDeviceAllocations;
+	}
+
+	std::ostream& operator<<(std::ostream& os, const VkmAllocator::Stats& stats) {
+		constexpr double MB = 1024.0 * 1024.0;
+		auto flags = os.flags();
+		os << std::fixed << std::setprecision(2)
+			<< "blocks: " << stats.blockCount << " (" << stats.blockBytes / MB << " MB)"
+			<< ", dedicated: " << stats.dedicatedAllocationCount << " (" << stats.dedicatedBytes / MB << " MB)"
+			<< ", live allocations: " << stats.allocationCount
+			<< ", used: " << stats.usedBytes / MB << " MB"
+			<< ", free: " << stats.freeBytes / MB << " MB in " << stats.freeRangeCount << " ranges"
+			<< ", fragmentation: " << stats.fragmentation * 100.f << "%";
+		os.flags(flags);
+		return os;
+	}
+
+} // Namespace vkm
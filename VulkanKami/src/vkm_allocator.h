@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// Standard Library
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace vkm {
+
+	// A piece of device memory handed out by VkmAllocator.
+	// Resources are bound to memory at offset, never to the start of the block
+	struct VkmAllocation {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		void* mappedData = nullptr; // Only set for HOST_VISIBLE memory (blocks stay mapped for their lifetime)
+		uint32_t memoryType = 0;
+		uint32_t poolIndex = 0;
+		uint32_t blockId = 0;
+		bool dedicated = false;
+	};
+
+	// Pools device memory per memory type so thousands of buffers/images share a handful of
+	// vkAllocateMemory calls. Each pool owns large blocks that are carved up with a best fit free list
+	class VkmAllocator {
+	public:
+		static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+		struct Stats {
+			uint32_t blockCount = 0;
+			uint32_t dedicatedAllocationCount = 0;
+			uint32_t allocationCount = 0; // Live sub-allocations (dedicated ones included)
+			uint32_t freeRangeCount = 0;
+			VkDeviceSize blockBytes = 0; // Memory reserved from the driver for blocks
+			VkDeviceSize dedicatedBytes = 0;
+			VkDeviceSize usedBytes = 0; // Bytes inside blocks handed out (including alignment padding)
+			VkDeviceSize freeBytes = 0;
+			VkDeviceSize largestFreeRange = 0;
+			float fragmentation = 0.f; // 0 = all free space is one range, close to 1 = scattered
+		};
+
+		VkmAllocator(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE);
+		~VkmAllocator();
+
+		VkmAllocator(const VkmAllocator &) = delete;
+		VkmAllocator &operator=(const VkmAllocator &) = delete;
+
+		// linearResource is true for buffers and linear images, false for optimal tiling images.
+		// They are kept in separate pools so bufferImageGranularity never has to be considered
+		VkmAllocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool linearResource);
+		void free(VkmAllocation& allocation);
+
+		Stats getStats() const;
+		uint32_t deviceAllocationCount() const;
+
+	private:
+		struct Block {
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			void* mapped = nullptr;
+			uint32_t id = 0;
+			uint32_t allocationCount = 0;
+			std::map<VkDeviceSize, VkDeviceSize> freeRanges; // offset -> size, never adjacent
+		};
+
+		struct Pool {
+			std::vector<Block> blocks;
+			uint32_t nextBlockId = 0;
+		};
+
+		VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped);
+		void freeDeviceMemory(VkDeviceMemory memory, bool mapped);
+		VkDeviceSize blockSizeFor(uint32_t memoryType) const;
+		bool isHostVisible(uint32_t memoryType) const;
+		static bool suballocate(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+
+		VkDevice device;
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		VkDeviceSize nonCoherentAtomSize;
+		uint32_t maxAllocationCount;
+		VkDeviceSize preferredBlockSize;
+
+		mutable std::mutex mutex;
+		std::vector<Pool> pools; // Two per memory type: [type * 2] linear, [type * 2 + 1] optimal
+		uint32_t dedicatedCount = 0;
+		VkDeviceSize dedicatedBytes = 0;
+		uint32_t liveDeviceAllocations = 0;
+	};
+
+	std::ostream& operator<<(std::ostream& os, const VkmAllocator::Stats& stats);
+
+} // Namespace vkm
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "vkm_model_registry.h"
+
+namespace vkm {
+
+	// Plain data components for VkmWorld, systems decide what to do with them
+
+	struct Transform2dComponent {
+		glm::vec2 translation{};
+		glm::vec2 scale{ 1.f, 1.f };
+		float rotation;
+
+		glm::mat2 mat2() { 
+			const float s = glm::sin(rotation);
+			const float c = glm::cos(rotation);
+			glm::mat2 rotMatrix{ {c, s}, {-s, c} };
+			glm::mat2 scaleMat{ {scale.x, .0f}, {.0f, scale.y} }; // TAKES COLUMNS AS PARAMATERS NOT ROWS
+			return rotMatrix * scaleMat; 
+		}
+	};
+
+	// Doesn't hold a reference, whoever created the model in the registry keeps it alive
+	struct ModelComponent {
+		VkmModelHandle model{};
+	};
+
+	struct ColorComponent {
+		glm::vec3 color{};
+	};
+
+	// Radians added to the rotation every frame, see SpinSystem
+	struct SpinComponent {
+		float speed = 0.f;
+	};
+}
@@ -0,0 +1,126 @@
+#include "vkm_cpu_profiler.h"
+
+// Standard Libraries
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace vkm {
+
+	VkmCpuProfiler& VkmCpuProfiler::get() {
+		static VkmCpuProfiler profiler;
+		return profiler;
+	}
+
+	VkmCpuProfiler::ThreadBuffer& VkmCpuProfiler::threadBuffer() {
+		// The shared_ptr in buffers keeps it alive, this is just the fast path lookup
+		thread_local ThreadBuffer* buffer = nullptr;
+		if (buffer == nullptr) {
+			auto newBuffer = std::make_shared<ThreadBuffer>();
+			std::lock_guard<std::mutex> lock{ registryMutex };
+			newBuffer->threadId = static_cast<uint32_t>(buffers.size());
+			newBuffer->threadName = "thread " + std::to_string(newBuffer->threadId);
+			buffers.push_back(newBuffer);
+			buffer = newBuffer.get();
+		}
+		return *buffer;
+	}
+
+	void VkmCpuProfiler::record(const char* name, uint64_t startNs, uint64_t endNs) {
+		ThreadBuffer& buffer = threadBuffer();
+		uint64_t index = buffer.writeIndex.load(std::memory_order_relaxed);
+		Event& event = buffer.events[index % EVENTS_PER_THREAD];
+		event.name.store(name, std::memory_order_relaxed);
+		event.start.store(startNs, std::memory_order_relaxed);
+		event.end.store(endNs, std::memory_order_relaxed);
+		// Publishes the event to writeChromeTrace
+		buffer.writeIndex.store(index + 1, std::memory_order_release);
+	}
+
+	void VkmCpuProfiler::setThreadName(const std::string& name) {
+		ThreadBuffer& buffer = threadBuffer();
+		std::lock_guard<std::mutex> lock{ registryMutex };
+		buffer.threadName = name;
+	}
+
+	static void writeEscaped(std::ofstream& out, const char* text) {
+		for (const char* c = text; *c; c++) {
+			if (*c == '"' || *c == '\\') {
+				out << '\\';
+			}
+			out << *c;
+		}
+	}
+
+	bool VkmCpuProfiler::writeChromeTrace(const std::string& path) {
+		struct Snapshot {
+			uint32_t threadId;
+			std::string threadName;
+			std::vector<std::pair<const char*, std::pair<uint64_t, uint64_t>>> events;
+		};
+
+		std::vector<std::shared_ptr<ThreadBuffer>> threads;
+		std::vector<std::string> threadNames;
+		{
+			std::lock_guard<std::mutex> lock{ registryMutex };
+			threads = buffers;
+			for (const auto& thread : threads) {
+				threadNames.push_back(thread->threadName);
+			}
+		}
+
+		std::vector<Snapshot> snapshots;
+		for (size_t t = 0; t < threads.size(); t++) {
+			ThreadBuffer& buffer = *threads[t];
+			Snapshot snapshot{ buffer.threadId, threadNames[t], {} };
+
+			uint64_t end = buffer.writeIndex.load(std::memory_order_acquire);
+			uint64_t begin = end > EVENTS_PER_THREAD ? end - EVENTS_PER_THREAD : 0;
+			snapshot.events.reserve(static_cast<size_t>(end - begin));
+			for (uint64_t i = begin; i < end; i++) {
+				const Event& event = buffer.events[i % EVENTS_PER_THREAD];
+				snapshot.events.push_back({ event.name.load(std::memory_order_relaxed),
+					{ event.start.load(std::memory_order_relaxed), event.end.load(std::memory_order_relaxed) } });
+			}
+
+			// The owning thread kept writing while we copied, anything it lapped is garbage now.
+			// The slot for index `after` may be half written, so it counts as lapped too
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t after = buffer.writeIndex.load(std::memory_order_relaxed);
+			uint64_t firstValid = after >= EVENTS_PER_THREAD ? after - EVENTS_PER_THREAD + 1 : 0;
+			if (firstValid > begin) {
+				size_t overwritten = static_cast<size_t>(std::min(firstValid - begin, end - begin));
+				snapshot.events.erase(snapshot.events.begin(), snapshot.events.begin() + overwritten);
+			}
+			snapshots.push_back(std::move(snapshot));
+		}
+
+		std::ofstream out{ path, std::ios::trunc };
+		if (!out.is_open()) {
+			return false;
+		}
+
+		// Complete ("X") events, timestamps are in microseconds
+		out << std::fixed << std::setprecision(3);
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+		for (const auto& snapshot : snapshots) {
+			out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << snapshot.threadId
+				<< ",\"args\":{\"name\":\"";
+			writeEscaped(out, snapshot.threadName.c_str());
+			out << "\"}}";
+			first = false;
+
+			for (const auto& event : snapshot.events) {
+				out << ",\n{\"name\":\"";
+				writeEscaped(out, event.first ? event.first : "?");
+				out << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << snapshot.threadId
+					<< ",\"ts\":" << event.second.first / 1000.0
+					<< ",\"dur\":" << (event.second.second - event.second.first) / 1000.0 << "}";
+			}
+		}
+		out << "\n]}\n";
+		return out.good();
+	}
+
+} // Namespace vkm
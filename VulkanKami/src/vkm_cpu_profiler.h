@@ -0,0 +1,99 @@
+#pragma once
+
+// Standard Library
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace vkm {
+
+	// Scoped CPU markers for finding out where frame time goes. Every thread records into its own
+	// fixed size ring (no locks on the hot path, only the first marker on a thread takes the registry lock),
+	// writeChromeTrace dumps whatever is still in the rings as Chrome trace-event JSON (chrome://tracing, Perfetto)
+	class VkmCpuProfiler {
+	public:
+		static constexpr uint32_t EVENTS_PER_THREAD = 1 << 16;
+
+		static VkmCpuProfiler& get();
+
+		VkmCpuProfiler(const VkmCpuProfiler &) = delete;
+		VkmCpuProfiler &operator=(const VkmCpuProfiler &) = delete;
+
+		// Nanoseconds since the profiler was created
+		uint64_t now() const {
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - epoch).count());
+		}
+
+		// name has to outlive the profiler (string literals), only the pointer is stored
+		void record(const char* name, uint64_t startNs, uint64_t endNs);
+		// Shows up as the thread's name in the trace viewer
+		void setThreadName(const std::string& name);
+
+		void setEnabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+		bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+		// Safe to call while other threads keep recording. Returns false if the file couldn't be written
+		bool writeChromeTrace(const std::string& path);
+
+	private:
+		struct Event {
+			std::atomic<const char*> name{ nullptr };
+			std::atomic<uint64_t> start{ 0 };
+			std::atomic<uint64_t> end{ 0 };
+		};
+
+		struct ThreadBuffer {
+			uint32_t threadId = 0;
+			std::string threadName; // Guarded by registryMutex
+			std::unique_ptr<Event[]> events{ new Event[EVENTS_PER_THREAD] };
+			std::atomic<uint64_t> writeIndex{ 0 };
+		};
+
+		VkmCpuProfiler() = default;
+		ThreadBuffer& threadBuffer();
+
+		std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+		std::atomic<bool> enabled{ true };
+
+		std::mutex registryMutex;
+		std::vector<std::shared_ptr<ThreadBuffer>> buffers; // Never shrinks, buffers outlive their threads
+	};
+
+	class VkmCpuScope {
+	public:
+		explicit VkmCpuScope(const char* name) : name{ name } {
+			VkmCpuProfiler& profiler = VkmCpuProfiler::get();
+			if (profiler.isEnabled()) {
+				start = profiler.now();
+			}
+		}
+		~VkmCpuScope() {
+			VkmCpuProfiler& profiler = VkmCpuProfiler::get();
+			if (start != UINT64_MAX && profiler.isEnabled()) {
+				profiler.record(name, start, profiler.now());
+			}
+		}
+
+		VkmCpuScope(const VkmCpuScope &) = delete;
+		VkmCpuScope &operator=(const VkmCpuScope &) = delete;
+
+	private:
+		const char* name;
+		uint64_t start = UINT64_MAX;
+	};
+
+} // Namespace vkm
+
+// Define VKM_DISABLE_CPU_PROFILER to compile every marker out
+#ifdef VKM_DISABLE_CPU_PROFILER
+#define VKM_PROFILE_SCOPE(name)
+#else
+#define VKM_PROFILE_CONCAT_INNER(a, b) a##b
+#define VKM_PROFILE_CONCAT(a, b) VKM_PROFILE_CONCAT_INNER(a, b)
+#define VKM_PROFILE_SCOPE(name) ::vkm::VkmCpuScope VKM_PROFILE_CONCAT(vkmCpuScope, __LINE__){ name }
+#endif
@@ -1,7 +1,11 @@
 #include "vkm_device.h"
 
 // std headers
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <set>
 #include <unordered_set>
@@ -47,24 +51,46 @@ void DestroyDebugUtilsMessengerEXT(
 }
 
 // class member functions
-VkmDevice::VkmDevice(VkmWindow &window) : window{window} {
+VkmDevice::VkmDevice(VkmWindow &window) : window{&window} {
+  deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  init();
+}
+
+VkmDevice::VkmDevice() { init(); }
+
+void VkmDevice::init() {
   createInstance(); // Initializes the Vulkan library and creates a Vulkan instance
   setupDebugMessenger(); // Sets up a debug messenger that will handle any debug messages from Vulkan
   createSurface(); // Creates a surface such as a window or screen to render on (GLFW)
   pickPhysicalDevice(); // Select the GPU we are using
   createLogicalDevice(); // Create a interface to interact with the GPU
-  createCommandPool(); // Command pools manage the memory that is used to store the command buffers
+  createAllocator(); // Sub-allocates buffer/image memory out of large per memory type blocks
+  createPipelineCache(); // Loads the pipeline cache from the last run so pipelines don't recompile
+  createStagingRing(); // Host visible ring that uploads into device local buffers go through
+  createFrameTimeline(); // Timeline semaphore every frame signals its number on
 }
 
 VkmDevice::~VkmDevice() {
-  vkDestroyCommandPool(device_, commandPool, nullptr);
+  flushDeletionQueue();
+  vkDestroySemaphore(device_, frameTimeline_, nullptr);
+  stagingRing_.reset();
+  assert(activeOneShots.empty() && "Single time commands still recording");
+  for (OneShotCommands &oneShot : freeOneShots) {
+    vkDestroyFence(device_, oneShot.fence, nullptr);
+    vkDestroyCommandPool(device_, oneShot.pool, nullptr);  // Frees the buffer too
+  }
+  allocator.reset();
+  savePipelineCache();
+  vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
   vkDestroyDevice(device_, nullptr);
 
   if (enableValidationLayers) {
     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
   }
 
-  vkDestroySurfaceKHR(instance, surface_, nullptr);
+  if (surface_ != VK_NULL_HANDLE) {
+    vkDestroySurfaceKHR(instance, surface_, nullptr);
+  }
   vkDestroyInstance(instance, nullptr);
 }
 
@@ -79,7 +105,8 @@ void VkmDevice::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  // Timeline semaphores are core in 1.2 (the minimum), dynamic rendering in 1.3 (used when the device has it)
+  appInfo.apiVersion = VK_API_VERSION_1_3;
 
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -137,7 +164,10 @@ void VkmDevice::createLogicalDevice() {
   QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-  std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+  std::set<uint32_t> uniqueQueueFamilies = {
+      indices.graphicsFamily,
+      indices.presentFamily,
+      indices.transferFamily};
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -149,11 +179,33 @@ void VkmDevice::createLogicalDevice() {
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
+  // Optional features, turned on when the device has them
+  const bool vulkan13 = properties.apiVersion >= VK_API_VERSION_1_3;
+  VkPhysicalDeviceVulkan13Features supported13Features = {};
+  supported13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  VkPhysicalDeviceFeatures2 supportedFeatures = {};
+  supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  supportedFeatures.pNext = vulkan13 ? &supported13Features : nullptr;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+  dynamicRendering_ = vulkan13 && supported13Features.dynamicRendering == VK_TRUE;
+
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+  VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+  vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  vulkan12Features.timelineSemaphore = VK_TRUE;
+
+  VkPhysicalDeviceVulkan13Features vulkan13Features = {};
+  vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  vulkan13Features.dynamicRendering = VK_TRUE;
+  if (dynamicRendering_) {
+    vulkan12Features.pNext = &vulkan13Features;
+  }
+
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  createInfo.pNext = &vulkan12Features;
 
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
@@ -177,40 +229,159 @@ void VkmDevice::createLogicalDevice() {
 
   vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
   vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+  vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
+  queueFamilyIndices_ = indices;
+}
+
+void VkmDevice::createAllocator() {
+  allocator = std::make_unique<VkmAllocator>(device_, physicalDevice);
+}
+
+void VkmDevice::createPipelineCache() {
+  std::vector<char> data;
+  std::ifstream file{PIPELINE_CACHE_FILE, std::ios::ate | std::ios::binary};
+  if (file.is_open()) {
+    data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(data.data(), data.size());
+  }
+
+  // A cache from another GPU or driver version is useless (and some drivers don't check it
+  // themselves), so anything that doesn't match starts from an empty cache
+  if (!data.empty() && !isPipelineCacheCompatible(data)) {
+    std::cout << "pipeline cache: " << PIPELINE_CACHE_FILE << " is from another device/driver, ignoring"
+              << std::endl;
+    data.clear();
+  }
+
+  VkPipelineCacheCreateInfo createInfo = {};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = data.size();
+  createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+  if (vkCreatePipelineCache(device_, &createInfo, nullptr, &pipelineCache_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline cache!");
+  }
+
+  pipelineStats.warm = !data.empty();
+  pipelineStats.loadedBytes = data.size();
+  std::cout << "pipeline cache: " << (pipelineStats.warm ? "warm, " : "cold, ") << data.size()
+            << " bytes loaded" << std::endl;
+}
+
+bool VkmDevice::isPipelineCacheCompatible(const std::vector<char> &data) {
+  VkPipelineCacheHeaderVersionOne header;
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+
+  return header.headerSize >= sizeof(header) && header.headerSize <= data.size() &&
+         header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+         memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void VkmDevice::savePipelineCache() {
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device_, pipelineCache_, &size, nullptr) != VK_SUCCESS || size == 0) {
+    return;
+  }
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(device_, pipelineCache_, &size, data.data()) != VK_SUCCESS) {
+    return;
+  }
+
+  // Write to a temp file and swap it in so a crash mid write can't leave a truncated cache
+  const std::string tempPath = std::string{PIPELINE_CACHE_FILE} + ".tmp";
+  {
+    std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+    if (!file.is_open()) {
+      std::cerr << "pipeline cache: failed to open " << tempPath << " for writing" << std::endl;
+      return;
+    }
+    file.write(data.data(), size);
+  }
+  std::remove(PIPELINE_CACHE_FILE);
+  if (std::rename(tempPath.c_str(), PIPELINE_CACHE_FILE) != 0) {
+    std::cerr << "pipeline cache: failed to write " << PIPELINE_CACHE_FILE << std::endl;
+  }
 }
 
-void VkmDevice::createCommandPool() {
-  QueueFamilyIndices queueFamilyIndices = findPhysicalQueueFamilies();
+void VkmDevice::recordPipelineCreation(double milliseconds) {
+  std::lock_guard<std::mutex> lock{pipelineStatsMutex};
+  pipelineStats.pipelineCount++;
+  pipelineStats.totalCreateMs += milliseconds;
+  pipelineStats.maxCreateMs = std::max(pipelineStats.maxCreateMs, milliseconds);
+}
+
+PipelineCacheStats VkmDevice::getPipelineCacheStats() {
+  std::lock_guard<std::mutex> lock{pipelineStatsMutex};
+  return pipelineStats;
+}
 
+VkCommandPool VkmDevice::createCommandPool(VkCommandPoolCreateFlags flags) {
   VkCommandPoolCreateInfo poolInfo = {};
   poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-  poolInfo.flags =
-      VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = queueFamilyIndices_.graphicsFamily;
+  poolInfo.flags = flags;
 
+  VkCommandPool commandPool;
   if (vkCreateCommandPool(device_, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
     throw std::runtime_error("failed to create command pool!");
   }
+  return commandPool;
 }
 
-void VkmDevice::createSurface() { window.createWindowSurface(instance, &surface_); }
+void VkmDevice::createStagingRing() { stagingRing_ = std::make_unique<VkmStagingRing>(*this); }
+
+void VkmDevice::createFrameTimeline() {
+  VkSemaphoreTypeCreateInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  timelineInfo.initialValue = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &timelineInfo;
+  if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &frameTimeline_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create frame timeline semaphore!");
+  }
+}
+
+void VkmDevice::createSurface() {
+  if (isHeadless()) {
+    return;
+  }
+  window->createWindowSurface(instance, &surface_);
+}
 
 bool VkmDevice::isDeviceSuitable(VkPhysicalDevice device) {
   QueueFamilyIndices indices = findQueueFamilies(device);
 
   bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-  bool swapChainAdequate = false;
-  if (extensionsSupported) {
+  bool swapChainAdequate = isHeadless();
+  if (extensionsSupported && !isHeadless()) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
 
-  VkPhysicalDeviceFeatures supportedFeatures;
-  vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(device, &deviceProperties);
+  if (deviceProperties.apiVersion < VK_API_VERSION_1_2) {
+    return false;
+  }
+
+  VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+  vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceFeatures2 supportedFeatures = {};
+  supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  supportedFeatures.pNext = &vulkan12Features;
+  vkGetPhysicalDeviceFeatures2(device, &supportedFeatures);
 
   return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-         supportedFeatures.samplerAnisotropy;
+         supportedFeatures.features.samplerAnisotropy && vulkan12Features.timelineSemaphore;
 }
 
 void VkmDevice::populateDebugMessengerCreateInfo(
@@ -261,11 +432,13 @@ bool VkmDevice::checkValidationLayerSupport() {
 }
 
 std::vector<const char *> VkmDevice::getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-  std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  std::vector<const char *> extensions;
+  if (!isHeadless()) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
   if (enableValidationLayers) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -326,25 +499,60 @@ QueueFamilyIndices VkmDevice::findQueueFamilies(VkPhysicalDevice device) {
   std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
   vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-  int i = 0;
+  // Transfer family preference: transfer only (the DMA engines) > any other non graphics family
+  // (async compute, can always copy) > graphics
+  int transferScore = -1;
+
+  uint32_t i = 0;
   for (const auto &queueFamily : queueFamilies) {
-    if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+    if (queueFamily.queueCount == 0) {
+      i++;
+      continue;
+    }
+    const bool graphics = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+    const bool compute = queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT;
+    const bool transfer = queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT;
+
+    if (graphics && !indices.graphicsFamilyHasValue) {
       indices.graphicsFamily = i;
       indices.graphicsFamilyHasValue = true;
     }
     VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
-    if (queueFamily.queueCount > 0 && presentSupport) {
+    if (!isHeadless()) {
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+    }
+    if (presentSupport && !indices.presentFamilyHasValue) {
       indices.presentFamily = i;
       indices.presentFamilyHasValue = true;
     }
-    if (indices.isComplete()) {
-      break;
+
+    int score = -1;
+    if (transfer && !graphics && !compute) {
+      score = 2;
+    } else if (!graphics && (transfer || compute)) {
+      score = 1;
+    }
+    if (score > transferScore) {
+      indices.transferFamily = i;
+      indices.transferFamilyHasValue = true;
+      transferScore = score;
     }
 
     i++;
   }
 
+  // Nothing gets presented without a surface, the graphics queue stands in so the rest of the code
+  // doesn't have to care
+  if (isHeadless() && indices.graphicsFamilyHasValue) {
+    indices.presentFamily = indices.graphicsFamily;
+    indices.presentFamilyHasValue = true;
+  }
+
+  if (!indices.transferFamilyHasValue && indices.graphicsFamilyHasValue) {
+    indices.transferFamily = indices.graphicsFamily;
+    indices.transferFamilyHasValue = true;
+  }
+
   return indices;
 }
 
@@ -391,16 +599,31 @@ VkFormat VkmDevice::findSupportedFormat(
 }
 
 uint32_t VkmDevice::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+  uint32_t memoryType;
+  if (!tryFindMemoryType(typeFilter, properties, memoryType)) {
+    throw std::runtime_error("failed to find suitable memory type!");
+  }
+  return memoryType;
+}
+
+bool VkmDevice::tryFindMemoryType(
+    uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &memoryType) {
   VkPhysicalDeviceMemoryProperties memProperties;
   vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
   for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
     if ((typeFilter & (1 << i)) &&
         (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-      return i;
+      memoryType = i;
+      return true;
     }
   }
+  return false;
+}
 
-  throw std::runtime_error("failed to find suitable memory type!");
+VkMemoryPropertyFlags VkmDevice::getMemoryPropertyFlags(uint32_t memoryType) {
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+  return memProperties.memoryTypes[memoryType].propertyFlags;
 }
 
 void VkmDevice::createBuffer(
@@ -408,12 +631,23 @@ void VkmDevice::createBuffer(
     VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties,
     VkBuffer &buffer,
-    VkDeviceMemory &bufferMemory) {
+    VkmAllocation &bufferAllocation,
+    VkMemoryPropertyFlags preferredProperties) {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
   bufferInfo.usage = usage;
-  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  // Buffers filled on the transfer queue and read on the graphics queue are shared concurrently,
+  // the alternative is a release/acquire ownership transfer per upload
+  uint32_t sharedFamilies[] = {queueFamilyIndices_.graphicsFamily, queueFamilyIndices_.transferFamily};
+  if ((usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) &&
+      queueFamilyIndices_.transferFamily != queueFamilyIndices_.graphicsFamily) {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = 2;
+    bufferInfo.pQueueFamilyIndices = sharedFamilies;
+  } else {
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  }
 
   if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
     throw std::runtime_error("failed to create vertex buffer!");
@@ -422,113 +656,241 @@ void VkmDevice::createBuffer(
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+  uint32_t memoryType;
+  if (preferredProperties == 0 ||
+      !tryFindMemoryType(memRequirements.memoryTypeBits, properties | preferredProperties, memoryType)) {
+    memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
+  }
+  bufferAllocation = allocator->allocate(memRequirements, memoryType, true);
 
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate vertex buffer memory!");
+  if (vkBindBufferMemory(device_, buffer, bufferAllocation.memory, bufferAllocation.offset) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to bind vertex buffer memory!");
   }
+}
 
-  vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+void VkmDevice::destroyBuffer(VkBuffer buffer, VkmAllocation &bufferAllocation) {
+  vkDestroyBuffer(device_, buffer, nullptr);
+  allocator->free(bufferAllocation);
 }
 
 VkCommandBuffer VkmDevice::beginSingleTimeCommands() {
-  VkCommandBufferAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandPool = commandPool;
-  allocInfo.commandBufferCount = 1;
+  OneShotCommands oneShot;
+  {
+    std::lock_guard<std::mutex> lock{oneShotMutex};
+    if (!freeOneShots.empty()) {
+      oneShot = freeOneShots.back();
+      freeOneShots.pop_back();
+    } else {
+      // Its own pool, so recording doesn't need the lock and the reset afterwards is one call
+      oneShot.pool = createCommandPool(VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+      VkCommandBufferAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      allocInfo.commandPool = oneShot.pool;
+      allocInfo.commandBufferCount = 1;
+      if (vkAllocateCommandBuffers(device_, &allocInfo, &oneShot.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate single time command buffer!");
+      }
 
-  VkCommandBuffer commandBuffer;
-  vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer);
+      // Wait on our own fence rather than vkQueueWaitIdle so frames already in flight aren't drained
+      VkFenceCreateInfo fenceInfo{};
+      fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+      if (vkCreateFence(device_, &fenceInfo, nullptr, &oneShot.fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create single time command fence!");
+      }
+    }
+    activeOneShots.push_back(oneShot);
+  }
 
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-  vkBeginCommandBuffer(commandBuffer, &beginInfo);
-  return commandBuffer;
+  vkBeginCommandBuffer(oneShot.commandBuffer, &beginInfo);
+  return oneShot.commandBuffer;
 }
 
 void VkmDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
   vkEndCommandBuffer(commandBuffer);
 
+  OneShotCommands oneShot;
+  {
+    std::lock_guard<std::mutex> lock{oneShotMutex};
+    auto it = std::find_if(activeOneShots.begin(), activeOneShots.end(), [commandBuffer](const OneShotCommands &active) {
+      return active.commandBuffer == commandBuffer;
+    });
+    assert(it != activeOneShots.end() && "Not from beginSingleTimeCommands");
+    oneShot = *it;
+    *it = activeOneShots.back();
+    activeOneShots.pop_back();
+  }
+
   VkSubmitInfo submitInfo{};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
 
-  vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphicsQueue_);
+  {
+    std::lock_guard<std::mutex> lock{queueMutex_};
+    vkQueueSubmit(graphicsQueue_, 1, &submitInfo, oneShot.fence);
+  }
+  vkWaitForFences(device_, 1, &oneShot.fence, VK_TRUE, UINT64_MAX);
 
-  vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
+  vkResetFences(device_, 1, &oneShot.fence);
+  vkResetCommandPool(device_, oneShot.pool, 0);
+  std::lock_guard<std::mutex> lock{oneShotMutex};
+  freeOneShots.push_back(oneShot);
 }
 
-void VkmDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-  VkBufferCopy copyRegion{};
-  copyRegion.srcOffset = 0;  // Optional
-  copyRegion.dstOffset = 0;  // Optional
-  copyRegion.size = size;
-  vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-  endSingleTimeCommands(commandBuffer);
+VkmUploadTicket VkmDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+  return stagingRing_->copyBuffer(srcBuffer, dstBuffer, size);
 }
 
-void VkmDevice::copyBufferToImage(
+VkmUploadTicket VkmDevice::copyBufferToImage(
     VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-  VkBufferImageCopy region{};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
-
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = layerCount;
+  return stagingRing_->copyBufferToImage(buffer, image, width, height, layerCount);
+}
 
-  region.imageOffset = {0, 0, 0};
-  region.imageExtent = {width, height, 1};
+void VkmDevice::waitForUploadOnNextSubmit(VkmUploadTicket ticket) {
+  std::lock_guard<std::mutex> lock{pendingUploadMutex};
+  // Timeline values only go up, so waiting on the highest one covers the rest
+  pendingUploadWait = std::max(pendingUploadWait, ticket.value);
+}
 
-  vkCmdCopyBufferToImage(
-      commandBuffer,
-      buffer,
-      image,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      1,
-      &region);
-  endSingleTimeCommands(commandBuffer);
+VkmUploadTicket VkmDevice::takePendingUploadWait() {
+  std::lock_guard<std::mutex> lock{pendingUploadMutex};
+  VkmUploadTicket ticket{pendingUploadWait};
+  pendingUploadWait = 0;
+  return ticket;
 }
 
 void VkmDevice::createImageWithInfo(
     const VkImageCreateInfo &imageInfo,
     VkMemoryPropertyFlags properties,
     VkImage &image,
-    VkDeviceMemory &imageMemory) {
-  if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+    VkmAllocation &imageAllocation,
+    VkMemoryPropertyFlags preferredProperties) {
+  // Same as createBuffer: images the staging ring copies into on the transfer queue are shared with the
+  // graphics queue instead of needing an ownership transfer
+  VkImageCreateInfo createInfo = imageInfo;
+  uint32_t sharedFamilies[] = {queueFamilyIndices_.graphicsFamily, queueFamilyIndices_.transferFamily};
+  if ((imageInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) &&
+      imageInfo.sharingMode == VK_SHARING_MODE_EXCLUSIVE &&
+      queueFamilyIndices_.transferFamily != queueFamilyIndices_.graphicsFamily) {
+    createInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    createInfo.queueFamilyIndexCount = 2;
+    createInfo.pQueueFamilyIndices = sharedFamilies;
+  }
+
+  if (vkCreateImage(device_, &createInfo, nullptr, &image) != VK_SUCCESS) {
     throw std::runtime_error("failed to create image!");
   }
 
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate image memory!");
+  uint32_t memoryType;
+  if (preferredProperties == 0 ||
+      !tryFindMemoryType(memRequirements.memoryTypeBits, properties | preferredProperties, memoryType)) {
+    memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
   }
+  imageAllocation = allocator->allocate(
+      memRequirements, memoryType, imageInfo.tiling == VK_IMAGE_TILING_LINEAR);
 
-  if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
+  if (vkBindImageMemory(device_, image, imageAllocation.memory, imageAllocation.offset) !=
+      VK_SUCCESS) {
     throw std::runtime_error("failed to bind image memory!");
   }
 }
 
+void VkmDevice::destroyImage(VkImage image, VkmAllocation &imageAllocation) {
+  vkDestroyImage(device_, image, nullptr);
+  allocator->free(imageAllocation);
+}
+
+VkmAllocation VkmDevice::allocateImageMemory(
+    const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties) {
+  return allocator->allocate(
+      requirements, findMemoryType(requirements.memoryTypeBits, properties), false);
+}
+
+uint64_t VkmDevice::currentFrame() {
+  std::lock_guard<std::mutex> lock{deletionMutex};
+  return currentFrame_;
+}
+
+uint64_t VkmDevice::completedFrame() {
+  uint64_t value = 0;
+  vkGetSemaphoreCounterValue(device_, frameTimeline_, &value);
+  return value;
+}
+
+void VkmDevice::waitForFrame(uint64_t frame) {
+  if (frame == 0 || completedFrame() >= frame) {
+    return;
+  }
+  VkSemaphoreWaitInfo waitInfo{};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &frameTimeline_;
+  waitInfo.pValues = &frame;
+  vkWaitSemaphores(device_, &waitInfo, UINT64_MAX);
+}
+
+void VkmDevice::deferDestruction(std::function<void()> destroy, VkmUploadTicket upload) {
+  std::lock_guard<std::mutex> lock{deletionMutex};
+  deletionQueue.push_back({currentFrame_, std::move(destroy), upload});
+}
+
+void VkmDevice::deferDestroyBuffer(
+    VkBuffer buffer, const VkmAllocation &bufferAllocation, VkmUploadTicket upload) {
+  deferDestruction(
+      [this, buffer, allocation = bufferAllocation]() mutable { destroyBuffer(buffer, allocation); },
+      upload);
+}
+
+void VkmDevice::deferDestroyImage(VkImage image, const VkmAllocation &imageAllocation) {
+  deferDestruction([this, image, allocation = imageAllocation]() mutable {
+    destroyImage(image, allocation);
+  });
+}
+
+void VkmDevice::advanceFrame() {
+  std::lock_guard<std::mutex> lock{deletionMutex};
+  currentFrame_++;
+}
+
+void VkmDevice::retireFrames(uint64_t completedFrame) {
+  // Run outside the lock, destroying one thing can queue another (a model's buffers, say)
+  std::vector<std::function<void()>> ready;
+  {
+    std::lock_guard<std::mutex> lock{deletionMutex};
+    // An entry still waiting on its upload holds up the ones behind it, uploads finish long before frames do
+    while (!deletionQueue.empty() && deletionQueue.front().frame <= completedFrame &&
+           (deletionQueue.front().upload.value == 0 || isUploadComplete(deletionQueue.front().upload))) {
+      ready.push_back(std::move(deletionQueue.front().destroy));
+      deletionQueue.pop_front();
+    }
+  }
+  for (auto &destroy : ready) {
+    destroy();
+  }
+}
+
+void VkmDevice::flushDeletionQueue() {
+  // Entries can wait on uploads that were recorded but never submitted, this submits them too
+  stagingRing_->waitIdle();
+  vkDeviceWaitIdle(device_);
+  while (pendingDestructionCount() > 0) {
+    retireFrames(UINT64_MAX);
+  }
+}
+
+size_t VkmDevice::pendingDestructionCount() {
+  std::lock_guard<std::mutex> lock{deletionMutex};
+  return deletionQueue.size();
+}
+
 }  // namespace lve
\ No newline at end of file
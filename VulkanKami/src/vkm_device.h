@@ -1,8 +1,14 @@
 #pragma once
 
 #include "vkm_window.h"
+#include "vkm_allocator.h"
+#include "vkm_staging_ring.h"
 
 // std lib headers
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -14,12 +20,25 @@ struct SwapChainSupportDetails {
   std::vector<VkPresentModeKHR> presentModes;
 };
 
+// Pipeline creation timings, used to compare a cold launch with one that found a valid cache on disk
+struct PipelineCacheStats {
+  bool warm = false;  // A cache file matching this GPU/driver was loaded at startup
+  size_t loadedBytes = 0;
+  uint32_t pipelineCount = 0;
+  double totalCreateMs = 0.0;
+  double maxCreateMs = 0.0;
+};
+
 struct QueueFamilyIndices {
   uint32_t graphicsFamily;
   uint32_t presentFamily;
+  uint32_t transferFamily;  // Dedicated transfer family when there is one, otherwise graphics
   bool graphicsFamilyHasValue = false;
   bool presentFamilyHasValue = false;
-  bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
+  bool transferFamilyHasValue = false;
+  bool isComplete() {
+    return graphicsFamilyHasValue && presentFamilyHasValue && transferFamilyHasValue;
+  }
 };
 
 class VkmDevice {
@@ -30,7 +49,12 @@ class VkmDevice {
   const bool enableValidationLayers = true;
 #endif
 
+  static constexpr const char *PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
   VkmDevice(VkmWindow &window);
+  // Headless: no window, no VkSurfaceKHR and no swapchain extension, for offscreen rendering
+  // on machines without a display (render nodes, CI with lavapipe)
+  VkmDevice();
   ~VkmDevice();
 
   // Not copyable or movable
@@ -39,46 +63,128 @@ class VkmDevice {
   VkmDevice(VkmDevice &&) = delete;
   VkmDevice &operator=(VkmDevice &&) = delete;
 
-  VkCommandPool getCommandPool() { return commandPool; }
+  // Graphics family pool, owned by the caller. No shared pool on purpose: a pool can only be used by one
+  // thread at a time, so each frame slot (and recording job) gets its own and resets it as a whole
+  VkCommandPool createCommandPool(VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
   VkDevice device() { return device_; }
   VkSurfaceKHR surface() { return surface_; }
+  VkPhysicalDevice getPhysicalDevice() { return physicalDevice; }
+  bool isHeadless() const { return window == nullptr; }
   VkQueue graphicsQueue() { return graphicsQueue_; }
   VkQueue presentQueue() { return presentQueue_; }
+  VkQueue transferQueue() { return transferQueue_; }
+  // Queues can alias each other (graphics == present == transfer on a lot of hardware)
+  // and vkQueueSubmit/vkQueuePresentKHR need external sync, so every submit goes through this
+  std::mutex &queueMutex() { return queueMutex_; }
+  // Shared by every pipeline, persisted to PIPELINE_CACHE_FILE between runs
+  VkPipelineCache pipelineCache() { return pipelineCache_; }
+  void recordPipelineCreation(double milliseconds);
+  PipelineCacheStats getPipelineCacheStats();
+
+  // Optional feature, enabled at device creation when supported.
+  // Vulkan 1.3 vkCmdBeginRendering, passes without VkRenderPass/VkFramebuffer objects
+  bool supportsDynamicRendering() const { return dynamicRendering_; }
 
   SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
   uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+  // Same without throwing, false when no allowed type has all of properties
+  bool tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &memoryType);
+  VkMemoryPropertyFlags getMemoryPropertyFlags(uint32_t memoryType);
   QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(physicalDevice); }
   VkFormat findSupportedFormat(
       const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
   // Buffer Helper Functions
+  // Memory comes from the pooled allocator, so resources must be released with destroyBuffer/destroyImage
   void createBuffer(
       VkDeviceSize size,
       VkBufferUsageFlags usage,
       VkMemoryPropertyFlags properties,
       VkBuffer &buffer,
-      VkDeviceMemory &bufferMemory);
+      VkmAllocation &bufferAllocation,
+      VkMemoryPropertyFlags preferredProperties = 0);  // Same as for createImageWithInfo
+  void destroyBuffer(VkBuffer buffer, VkmAllocation &bufferAllocation);
+  // Goes through the staging ring into (usually DEVICE_LOCAL) dstBuffer, which needs TRANSFER_DST usage.
+  // Uploads are batched until flushUploads() so loading many meshes costs one submit on the
+  // transfer queue. The ticket tells when the data has landed, see waitForUploadOnNextSubmit
+  VkmUploadTicket uploadToBuffer(
+      VkBuffer dstBuffer, const void *data, VkDeviceSize size, VkDeviceSize dstOffset = 0) {
+    return stagingRing_->uploadToBuffer(dstBuffer, data, size, dstOffset);
+  }
+  VkmUploadTicket flushUploads() { return stagingRing_->flush(); }
+
+  bool isUploadComplete(VkmUploadTicket ticket) const { return stagingRing_->isComplete(ticket); }
+  void waitForUpload(VkmUploadTicket ticket) const { stagingRing_->wait(ticket); }
+  // Makes the next graphics submit wait (GPU side) for the ticket instead of stalling the CPU.
+  // Called while recording when a resource is used for the first time
+  void waitForUploadOnNextSubmit(VkmUploadTicket ticket);
+  // Highest ticket registered since the last call, 0 if there is nothing to wait on
+  VkmUploadTicket takePendingUploadWait();
+  VkSemaphore uploadTimelineSemaphore() const { return stagingRing_->timelineSemaphore(); }
+
+  // Blocking one shot submits on the graphics queue, from any thread. Buffers come from a pool of
+  // (command pool, buffer, fence) sets that are reset and reused, so nothing is allocated after warm up
   VkCommandBuffer beginSingleTimeCommands();
   void endSingleTimeCommands(VkCommandBuffer commandBuffer);
-  void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-  void copyBufferToImage(
+  // Recorded into the current transfer batch, not submitted until flushUploads()
+  VkmUploadTicket copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+  VkmUploadTicket copyBufferToImage(
       VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 
+  // preferredProperties are added to properties when a memory type has them all
+  // (LAZILY_ALLOCATED for transient attachments), otherwise properties alone is enough.
+  // TRANSFER_DST images are made CONCURRENT between graphics and transfer when those families differ
   void createImageWithInfo(
       const VkImageCreateInfo &imageInfo,
       VkMemoryPropertyFlags properties,
       VkImage &image,
-      VkDeviceMemory &imageMemory);
+      VkmAllocation &imageAllocation,
+      VkMemoryPropertyFlags preferredProperties = 0);
+  void destroyImage(VkImage image, VkmAllocation &imageAllocation);
+  // Memory that isn't bound to anything yet, for several optimal tiling images sharing it (render graph aliasing)
+  VkmAllocation allocateImageMemory(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties);
+  void freeMemory(VkmAllocation &allocation) { allocator->free(allocation); }
+
+  VkmAllocator::Stats getAllocatorStats() const { return allocator->getStats(); }
+
+  // Frame clock. Frames are numbered from 1 and every frame's submit signals its number on one timeline
+  // semaphore, so "the GPU has finished frame N" is a single value anything can check or wait on.
+  // The renderer submits frame currentFrame() and then calls advanceFrame
+  uint64_t currentFrame();
+  VkSemaphore frameTimelineSemaphore() const { return frameTimeline_; }
+  uint64_t completedFrame();
+  void waitForFrame(uint64_t frame);
+
+  // Deletion queue. A deferred destroy runs when the frame that was being recorded when it was queued
+  // retires, so freeing something a frame in flight might still use never needs vkDeviceWaitIdle.
+  // Any thread can queue. With an upload ticket it also waits for that transfer, for buffers that may never have
+  // been used by a frame (the frame timeline alone doesn't cover the copy into them then)
+  void deferDestruction(std::function<void()> destroy, VkmUploadTicket upload = {});
+  void deferDestroyBuffer(
+      VkBuffer buffer, const VkmAllocation &bufferAllocation, VkmUploadTicket upload = {});
+  void deferDestroyImage(VkImage image, const VkmAllocation &imageAllocation);
+  void advanceFrame();
+  void retireFrames(uint64_t completedFrame);
+  void retireCompletedFrames() { retireFrames(completedFrame()); }
+  // Waits for the device, then runs everything still queued. For shutdown
+  void flushDeletionQueue();
+  size_t pendingDestructionCount();
 
   VkPhysicalDeviceProperties properties;
 
  private:
+  void init();
   void createInstance();
   void setupDebugMessenger();
   void createSurface();
   void pickPhysicalDevice();
   void createLogicalDevice();
-  void createCommandPool();
+  void createAllocator();
+  void createPipelineCache();
+  void savePipelineCache();
+  bool isPipelineCacheCompatible(const std::vector<char> &data);
+  void createStagingRing();
+  void createFrameTimeline();
 
   // helper functions
   bool isDeviceSuitable(VkPhysicalDevice device);
@@ -93,16 +199,48 @@ class VkmDevice {
   VkInstance instance;
   VkDebugUtilsMessengerEXT debugMessenger;
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-  VkmWindow &window;
-  VkCommandPool commandPool;
+  VkmWindow *window = nullptr;
 
   VkDevice device_;
-  VkSurfaceKHR surface_;
+  VkSurfaceKHR surface_ = VK_NULL_HANDLE;
   VkQueue graphicsQueue_;
   VkQueue presentQueue_;
+  VkQueue transferQueue_;
+  QueueFamilyIndices queueFamilyIndices_;
+  std::mutex queueMutex_;
+  bool dynamicRendering_ = false;
+
+  VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+  std::mutex pipelineStatsMutex;
+  PipelineCacheStats pipelineStats;
+
+  struct OneShotCommands {
+    VkCommandPool pool;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+  };
+  std::mutex oneShotMutex;
+  std::vector<OneShotCommands> freeOneShots;
+  std::vector<OneShotCommands> activeOneShots;  // Between beginSingleTimeCommands and endSingleTimeCommands
+
+  std::mutex pendingUploadMutex;
+  uint64_t pendingUploadWait = 0;
+
+  struct PendingDestruction {
+    uint64_t frame;
+    std::function<void()> destroy;
+    VkmUploadTicket upload;
+  };
+  std::mutex deletionMutex;
+  std::deque<PendingDestruction> deletionQueue;  // Frames only go up, so this is sorted
+  uint64_t currentFrame_ = 1;
+  VkSemaphore frameTimeline_ = VK_NULL_HANDLE;
+
+  std::unique_ptr<VkmAllocator> allocator;
+  std::unique_ptr<VkmStagingRing> stagingRing_;
 
   const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
-  const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  std::vector<const char *> deviceExtensions;  // Swapchain extension unless headless
 };
 
 }  // namespace lve
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "vkm_ecs.h"
+
+// Standard Libraries
+#include <algorithm>
+#include <bitset>
+#include <mutex>
+#include <stdexcept>
+
+namespace vkm {
+
+	// Fixed size so registering a new type never moves the infos other threads are reading
+	VkmWorld::ComponentInfo* VkmWorld::componentInfos() {
+		static ComponentInfo infos[MAX_COMPONENT_TYPES];
+		return infos;
+	}
+
+	uint32_t VkmWorld::registerComponent(const ComponentInfo& info) {
+		static std::mutex registryMutex;
+		static uint32_t registeredCount = 0;
+		std::lock_guard<std::mutex> lock{ registryMutex };
+		if (registeredCount >= MAX_COMPONENT_TYPES) {
+			throw std::runtime_error("Too many component types!");
+		}
+		componentInfos()[registeredCount] = info;
+		return registeredCount++;
+	}
+
+	uint32_t VkmWorld::componentCount(ComponentMask mask) {
+		return static_cast<uint32_t>(std::bitset<MAX_COMPONENT_TYPES>(mask).count());
+	}
+
+	VkmWorld::~VkmWorld() {
+		for (auto& archetype : archetypes) {
+			for (auto& chunk : archetype->chunks) {
+				for (uint32_t id : archetype->componentIds) {
+					const ComponentInfo& info = componentInfo(id);
+					std::byte* base = chunk.data.get() + archetype->columnOffsets[id];
+					for (uint32_t row = 0; row < chunk.count; row++) {
+						info.destroy(base + static_cast<size_t>(info.size) * row);
+					}
+				}
+			}
+		}
+	}
+
+	VkmWorld::Location& VkmWorld::prepareLocation(VkmEntity entity) {
+		assert(entityAllocator.isCurrent(entity) && "Entity handle is stale");
+		if (entity.index >= locations.size()) {
+			locations.resize(entityAllocator.getSlotCount());
+		}
+		assert(locations[entity.index].archetype == INVALID_ARCHETYPE && "Entity was already created");
+		aliveCount++;
+		return locations[entity.index];
+	}
+
+	uint32_t VkmWorld::archetypeFor(ComponentMask mask) {
+		auto it = archetypeLookup.find(mask);
+		if (it != archetypeLookup.end()) {
+			return it->second;
+		}
+
+		auto archetype = std::make_unique<Archetype>();
+		archetype->mask = mask;
+		for (uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++) {
+			archetype->columnOffsets[id] = UINT32_MAX;
+			if (mask & (ComponentMask{ 1 } << id)) {
+				archetype->componentIds.push_back(id);
+			}
+		}
+
+		// As many rows as fit in a chunk, but always at least one (a huge component gets a bigger chunk)
+		auto layout = [&archetype](uint32_t capacity) {
+			size_t offset = sizeof(VkmEntity) * static_cast<size_t>(capacity);
+			for (uint32_t id : archetype->componentIds) {
+				const ComponentInfo& info = componentInfo(id);
+				offset = (offset + info.alignment - 1) / info.alignment * info.alignment;
+				archetype->columnOffsets[id] = static_cast<uint32_t>(offset);
+				offset += static_cast<size_t>(info.size) * capacity;
+			}
+			return offset;
+		};
+		size_t rowBytes = sizeof(VkmEntity);
+		for (uint32_t id : archetype->componentIds) {
+			rowBytes += componentInfo(id).size;
+		}
+		uint32_t capacity = std::max<uint32_t>(1, static_cast<uint32_t>(CHUNK_SIZE / rowBytes));
+		size_t bytes = layout(capacity);
+		while (bytes > CHUNK_SIZE && capacity > 1) {
+			bytes = layout(--capacity);
+		}
+		archetype->capacity = capacity;
+		archetype->chunkBytes = static_cast<uint32_t>(bytes);
+
+		uint32_t index = static_cast<uint32_t>(archetypes.size());
+		archetypes.push_back(std::move(archetype));
+		archetypeLookup.emplace(mask, index);
+		return index;
+	}
+
+	VkmWorld::Location VkmWorld::allocateRow(uint32_t archetypeIndex, VkmEntity entity) {
+		Archetype& archetype = *archetypes[archetypeIndex];
+		if (archetype.chunks.empty() || archetype.chunks.back().count == archetype.capacity) {
+			Chunk chunk;
+			chunk.data.reset(new std::byte[archetype.chunkBytes]);
+			archetype.chunks.push_back(std::move(chunk));
+		}
+
+		Chunk& chunk = archetype.chunks.back();
+		Location location{ archetypeIndex, static_cast<uint32_t>(archetype.chunks.size() - 1), chunk.count };
+		entityColumn(chunk)[chunk.count] = entity;
+		chunk.count++;
+		archetype.entityCount++;
+		return location;
+	}
+
+	void VkmWorld::removeRow(const Location& location) {
+		Archetype& archetype = *archetypes[location.archetype];
+		Chunk& chunk = archetype.chunks[location.chunk];
+		Chunk& lastChunk = archetype.chunks.back();
+		const uint32_t lastRow = lastChunk.count - 1;
+		const bool isLast = &chunk == &lastChunk && location.row == lastRow;
+
+		for (uint32_t id : archetype.componentIds) {
+			const ComponentInfo& info = componentInfo(id);
+			std::byte* destination = chunk.data.get() + archetype.columnOffsets[id] + static_cast<size_t>(info.size) * location.row;
+			info.destroy(destination);
+			if (!isLast) {
+				std::byte* source = lastChunk.data.get() + archetype.columnOffsets[id] + static_cast<size_t>(info.size) * lastRow;
+				info.moveConstruct(destination, source);
+				info.destroy(source);
+			}
+		}
+		if (!isLast) {
+			VkmEntity moved = entityColumn(lastChunk)[lastRow];
+			entityColumn(chunk)[location.row] = moved;
+			locations[moved.index].chunk = location.chunk;
+			locations[moved.index].row = location.row;
+		}
+
+		lastChunk.count--;
+		archetype.entityCount--;
+		if (lastChunk.count == 0) {
+			archetype.chunks.pop_back();
+		}
+	}
+
+	void VkmWorld::destroyEntity(VkmEntity entity) {
+		assert(entityAllocator.isCurrent(entity) && "Entity was already destroyed");
+		if (isAlive(entity)) {
+			removeRow(locations[entity.index]);
+			locations[entity.index] = Location{};
+			aliveCount--;
+		}
+		entityAllocator.free(entity);
+	}
+
+	VkmWorld::Location& VkmWorld::changeArchetype(VkmEntity entity, uint32_t from, ComponentMask added, ComponentMask removed) {
+		const Location oldLocation = locations[entity.index];
+		const ComponentMask oldMask = archetypes[from]->mask;
+		const uint32_t to = archetypeFor((oldMask | added) & ~removed);
+		const Location newLocation = allocateRow(to, entity);
+
+		// Everything both archetypes have moves over, removeRow then destroys the moved-from (and removed) components
+		for (uint32_t id : archetypes[from]->componentIds) {
+			if (removed & (ComponentMask{ 1 } << id)) {
+				continue;
+			}
+			componentInfo(id).moveConstruct(componentPointer(newLocation, id), componentPointer(oldLocation, id));
+		}
+		removeRow(oldLocation);
+
+		locations[entity.index] = newLocation;
+		return locations[entity.index];
+	}
+
+} // Namespace vkm
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "vkm_entity_allocator.h"
+#include "vkm_thread_pool.h"
+
+// Standard Library
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace vkm {
+
+	// Archetype ECS. Every distinct set of component types is an archetype, and an archetype stores its entities in
+	// fixed size chunks with one contiguous array per component (plus one of entity ids). Queries walk the chunks of
+	// every archetype that has the requested components, so systems iterate dense arrays and whole chunks can be
+	// handed to different threads. Destroying an entity moves the archetype's last entity into the hole.
+	// Entities are generational handles, lookups are O(1) through a table by slot index and stale handles are
+	// caught by isAlive. Structural changes (create/destroy/add/remove) must not happen while a query is running,
+	// reserveEntity is the one call that's fine from any thread at any time
+	class VkmWorld {
+	public:
+		static constexpr uint32_t CHUNK_SIZE = 16 * 1024;
+		static constexpr uint32_t MAX_COMPONENT_TYPES = 64;
+		using ComponentMask = uint64_t;
+
+		// Ids are handed out the first time a type is used, from any thread
+		template<typename T>
+		static uint32_t componentId() {
+			static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Chunk storage doesn't over-align");
+			static const uint32_t id = registerComponent({ sizeof(T), alignof(T), &moveConstruct<T>, &destroy<T> });
+			return id;
+		}
+		template<typename... Ts>
+		static ComponentMask maskOf() { return (ComponentMask{ 0 } | ... | (ComponentMask{ 1 } << componentId<Ts>())); }
+
+		VkmWorld() = default;
+		~VkmWorld();
+
+		VkmWorld(const VkmWorld &) = delete;
+		VkmWorld &operator=(const VkmWorld &) = delete;
+
+		template<typename... Ts>
+		VkmEntity createEntity(Ts&&... components) {
+			return createReservedEntity(reserveEntity(), std::forward<Ts>(components)...);
+		}
+		// Thread safe. The handle isn't alive until createReservedEntity is called with it on the world's thread,
+		// so a loader thread can hand out ids (and link objects by them) before anything is in the world
+		VkmEntity reserveEntity() { return entityAllocator.allocate(); }
+		template<typename... Ts>
+		VkmEntity createReservedEntity(VkmEntity entity, Ts&&... components) {
+			const ComponentMask mask = maskOf<std::decay_t<Ts>...>();
+			assert(componentCount(mask) == sizeof...(Ts) && "An entity can only have one component of each type");
+			Location& location = prepareLocation(entity);
+			location = allocateRow(archetypeFor(mask), entity);
+			(new (componentPointer(location, componentId<std::decay_t<Ts>>())) std::decay_t<Ts>(std::forward<Ts>(components)), ...);
+			return entity;
+		}
+		// Also releases reserved handles that were never created
+		void destroyEntity(VkmEntity entity);
+		bool isAlive(VkmEntity entity) const {
+			return entityAllocator.isCurrent(entity) && entity.index < locations.size() &&
+				locations[entity.index].archetype != INVALID_ARCHETYPE;
+		}
+
+		// Moves the entity to the archetype with T added (or removed)
+		template<typename T>
+		T& addComponent(VkmEntity entity, T component) {
+			assert(!hasComponent<T>(entity) && "Entity already has this component");
+			Location& location = changeArchetype(entity, locations[entity.index].archetype, maskOf<T>(), 0);
+			return *new (componentPointer(location, componentId<T>())) T(std::move(component));
+		}
+		template<typename T>
+		void removeComponent(VkmEntity entity) {
+			assert(hasComponent<T>(entity) && "Entity doesn't have this component");
+			changeArchetype(entity, locations[entity.index].archetype, 0, maskOf<T>());
+		}
+
+		template<typename T>
+		bool hasComponent(VkmEntity entity) const {
+			assert(isAlive(entity) && "Entity was destroyed");
+			return (archetypes[locations[entity.index].archetype]->mask & maskOf<T>()) != 0;
+		}
+		// nullptr when the entity doesn't have T. Only valid until the next structural change
+		template<typename T>
+		T* getComponent(VkmEntity entity) {
+			assert(isAlive(entity) && "Entity was destroyed");
+			const Location& location = locations[entity.index];
+			if ((archetypes[location.archetype]->mask & maskOf<T>()) == 0) {
+				return nullptr;
+			}
+			return static_cast<T*>(componentPointer(location, componentId<T>()));
+		}
+
+		// fn(uint32_t count, Ts*... columns) for every chunk with all of Ts, in a stable order
+		// (archetype creation order, then chunk order) as long as nothing structural changes in between
+		template<typename... Ts, typename Fn>
+		void forEachChunk(Fn&& fn) {
+			const ComponentMask mask = maskOf<Ts...>();
+			for (auto& archetype : archetypes) {
+				if ((archetype->mask & mask) != mask) {
+					continue;
+				}
+				for (auto& chunk : archetype->chunks) {
+					if (chunk.count > 0) {
+						fn(chunk.count, column<Ts>(*archetype, chunk)...);
+					}
+				}
+			}
+		}
+		// fn(Ts&... components) for every entity with all of Ts
+		template<typename... Ts, typename Fn>
+		void forEach(Fn&& fn) {
+			forEachChunk<Ts...>([&fn](uint32_t count, Ts*... columns) {
+				for (uint32_t i = 0; i < count; i++) {
+					fn(columns[i]...);
+				}
+			});
+		}
+		// Same as forEachChunk with the chunks spread over the pool (and the caller). fn runs concurrently,
+		// it may only touch the chunk it was given
+		template<typename... Ts, typename Fn>
+		void parallelForEachChunk(VkmThreadPool& threadPool, Fn&& fn) {
+			const ComponentMask mask = maskOf<Ts...>();
+			std::vector<std::pair<Archetype*, Chunk*>> chunks;
+			for (auto& archetype : archetypes) {
+				if ((archetype->mask & mask) == mask) {
+					for (auto& chunk : archetype->chunks) {
+						if (chunk.count > 0) {
+							chunks.emplace_back(archetype.get(), &chunk);
+						}
+					}
+				}
+			}
+			threadPool.parallelFor(static_cast<uint32_t>(chunks.size()), [&chunks, &fn](uint32_t begin, uint32_t end) {
+				for (uint32_t i = begin; i < end; i++) {
+					fn(chunks[i].second->count, column<Ts>(*chunks[i].first, *chunks[i].second)...);
+				}
+			});
+		}
+
+		// Entities that have all of Ts
+		template<typename... Ts>
+		uint32_t count() const {
+			const ComponentMask mask = maskOf<Ts...>();
+			uint32_t total = 0;
+			for (const auto& archetype : archetypes) {
+				if ((archetype->mask & mask) == mask) {
+					total += archetype->entityCount;
+				}
+			}
+			return total;
+		}
+		uint32_t entityCount() const { return aliveCount; }
+		uint32_t archetypeCount() const { return static_cast<uint32_t>(archetypes.size()); }
+
+	private:
+		static constexpr uint32_t INVALID_ARCHETYPE = UINT32_MAX;
+
+		struct ComponentInfo {
+			uint32_t size;
+			uint32_t alignment;
+			void (*moveConstruct)(void* destination, void* source);
+			void (*destroy)(void* component);
+		};
+
+		struct Chunk {
+			std::unique_ptr<std::byte[]> data;
+			uint32_t count = 0;
+		};
+
+		struct Archetype {
+			ComponentMask mask = 0;
+			std::vector<uint32_t> componentIds;
+			uint32_t columnOffsets[MAX_COMPONENT_TYPES]; // Byte offset of each component's array in a chunk, by id
+			uint32_t capacity = 0; // Entities per chunk
+			uint32_t chunkBytes = 0;
+			uint32_t entityCount = 0;
+			std::vector<Chunk> chunks; // Every chunk but the last is full
+		};
+
+		struct Location {
+			uint32_t archetype = INVALID_ARCHETYPE;
+			uint32_t chunk = 0;
+			uint32_t row = 0;
+		};
+
+		template<typename T>
+		static void moveConstruct(void* destination, void* source) { new (destination) T(std::move(*static_cast<T*>(source))); }
+		template<typename T>
+		static void destroy(void* component) { static_cast<T*>(component)->~T(); }
+
+		static ComponentInfo* componentInfos();
+		static uint32_t registerComponent(const ComponentInfo& info);
+		static const ComponentInfo& componentInfo(uint32_t id) { return componentInfos()[id]; }
+		static uint32_t componentCount(ComponentMask mask);
+
+		template<typename T>
+		static T* column(Archetype& archetype, Chunk& chunk) {
+			return reinterpret_cast<T*>(chunk.data.get() + archetype.columnOffsets[componentId<T>()]);
+		}
+		static VkmEntity* entityColumn(Chunk& chunk) { return reinterpret_cast<VkmEntity*>(chunk.data.get()); }
+
+		// Grows the table to cover a (reserved, not yet created) handle
+		Location& prepareLocation(VkmEntity entity);
+		uint32_t archetypeFor(ComponentMask mask);
+		Location allocateRow(uint32_t archetypeIndex, VkmEntity entity);
+		// Destroys the row's components and fills the hole with the archetype's last entity
+		void removeRow(const Location& location);
+		Location& changeArchetype(VkmEntity entity, uint32_t from, ComponentMask added, ComponentMask removed);
+		void* componentPointer(const Location& location, uint32_t id) {
+			Archetype& archetype = *archetypes[location.archetype];
+			const ComponentInfo& info = componentInfo(id);
+			return archetype.chunks[location.chunk].data.get() + archetype.columnOffsets[id] + static_cast<size_t>(info.size) * location.row;
+		}
+
+		std::vector<std::unique_ptr<Archetype>> archetypes;
+		std::unordered_map<ComponentMask, uint32_t> archetypeLookup;
+		VkmEntityAllocator entityAllocator;
+		std::vector<Location> locations; // By entity index
+		uint32_t aliveCount = 0;
+	};
+
+} // Namespace vkm
@@ -0,0 +1,40 @@
+#include "vkm_entity_allocator.h"
+
+// Standard Libraries
+#include <stdexcept>
+
+namespace vkm {
+
+	VkmEntity VkmEntityAllocator::allocate() {
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (!freeSlots.empty()) {
+			uint32_t index = freeSlots.back();
+			freeSlots.pop_back();
+			return { index, generation(index).load(std::memory_order_relaxed) };
+		}
+
+		uint32_t index = slotCount.load(std::memory_order_relaxed);
+		if (index / PAGE_SIZE >= MAX_PAGES) {
+			throw std::runtime_error("Out of entity slots!");
+		}
+		if (index % PAGE_SIZE == 0) {
+			pages[index / PAGE_SIZE].reset(new std::atomic<uint32_t>[PAGE_SIZE]);
+			for (uint32_t i = 0; i < PAGE_SIZE; i++) {
+				pages[index / PAGE_SIZE][i].store(0, std::memory_order_relaxed);
+			}
+		}
+		slotCount.store(index + 1, std::memory_order_release);
+		return { index, 0 };
+	}
+
+	void VkmEntityAllocator::free(VkmEntity entity) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		// Not just an assert: freeing twice would put the slot on the free list twice and hand it to two entities
+		if (!isCurrent(entity)) {
+			throw std::runtime_error("Entity handle was already freed!");
+		}
+		generation(entity.index).fetch_add(1, std::memory_order_release);
+		freeSlots.push_back(entity.index);
+	}
+
+} // Namespace vkm
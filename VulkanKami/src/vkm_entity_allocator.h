@@ -0,0 +1,56 @@
+#pragma once
+
+// Standard Library
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vkm {
+
+	// Slot index plus the generation the slot had when the handle was made. Freeing a slot bumps its generation,
+	// so handles to an entity that's gone stay detectably stale even after the slot is reused
+	struct VkmEntity {
+		uint32_t index = UINT32_MAX;
+		uint32_t generation = 0;
+
+		bool operator==(const VkmEntity& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const VkmEntity& other) const { return !(*this == other); }
+	};
+
+	// Hands out entity handles, safe to call from any thread (loader threads reserve ids while the main thread renders).
+	// Freed slots are reused newest first. Generations live in fixed pages that never move once allocated,
+	// so isCurrent doesn't take the lock
+	class VkmEntityAllocator {
+	public:
+		static constexpr uint32_t PAGE_SIZE = 4096;
+		static constexpr uint32_t MAX_PAGES = 4096;
+
+		VkmEntityAllocator() = default;
+
+		VkmEntityAllocator(const VkmEntityAllocator &) = delete;
+		VkmEntityAllocator &operator=(const VkmEntityAllocator &) = delete;
+
+		VkmEntity allocate();
+		// Throws for a handle that isn't current (freed twice)
+		void free(VkmEntity entity);
+		// False once the handle's slot was freed, or for handles this allocator never gave out
+		bool isCurrent(VkmEntity entity) const {
+			return entity.index < slotCount.load(std::memory_order_acquire) &&
+				generation(entity.index).load(std::memory_order_acquire) == entity.generation;
+		}
+
+		// Slots ever handed out, free ones included. Every valid index is below this
+		uint32_t getSlotCount() const { return slotCount.load(std::memory_order_acquire); }
+
+	private:
+		std::atomic<uint32_t>& generation(uint32_t index) const { return pages[index / PAGE_SIZE][index % PAGE_SIZE]; }
+
+		std::unique_ptr<std::atomic<uint32_t>[]> pages[MAX_PAGES];
+		std::atomic<uint32_t> slotCount{ 0 }; // Published after the slot's page exists
+		std::vector<uint32_t> freeSlots;
+		std::mutex mutex;
+	};
+
+} // Namespace vkm
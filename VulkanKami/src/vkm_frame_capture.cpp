@@ -0,0 +1,441 @@
+#include "vkm_frame_capture.h"
+#include "vkm_cpu_profiler.h"
+
+// Standard Libraries
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define VKM_POPEN _popen
+#define VKM_PCLOSE _pclose
+#else
+#define VKM_POPEN popen
+#define VKM_PCLOSE pclose
+#endif
+
+namespace vkm {
+
+	namespace {
+		uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+			static const std::array<uint32_t, 256> table = []() {
+				std::array<uint32_t, 256> entries{};
+				for (uint32_t i = 0; i < 256; i++) {
+					uint32_t c = i;
+					for (int k = 0; k < 8; k++) {
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					}
+					entries[i] = c;
+				}
+				return entries;
+			}();
+			crc = ~crc;
+			for (size_t i = 0; i < size; i++) {
+				crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+
+		void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+			out.push_back(static_cast<uint8_t>(value >> 24));
+			out.push_back(static_cast<uint8_t>(value >> 16));
+			out.push_back(static_cast<uint8_t>(value >> 8));
+			out.push_back(static_cast<uint8_t>(value));
+		}
+
+		void appendChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+			appendBigEndian(out, static_cast<uint32_t>(data.size()));
+			const size_t typeStart = out.size();
+			out.insert(out.end(), type, type + 4);
+			out.insert(out.end(), data.begin(), data.end());
+			appendBigEndian(out, crc32(out.data() + typeStart, out.size() - typeStart));
+		}
+
+		// RGBA8 PNG with stored (uncompressed) deflate blocks. Files are about as big as raw, but writing one is
+		// a memcpy and a checksum, which keeps the encoder thread ahead of the renderer
+		bool writePng(const std::string& path, VkExtent2D extent, const std::vector<uint8_t>& rgba) {
+			const size_t rowBytes = static_cast<size_t>(extent.width) * 4;
+			std::vector<uint8_t> scanlines;
+			scanlines.reserve((rowBytes + 1) * extent.height);
+			for (uint32_t y = 0; y < extent.height; y++) {
+				scanlines.push_back(0); // Filter: none
+				scanlines.insert(scanlines.end(), rgba.begin() + y * rowBytes, rgba.begin() + (y + 1) * rowBytes);
+			}
+
+			std::vector<uint8_t> zlib{ 0x78, 0x01 };
+			constexpr size_t MAX_STORED_BLOCK = 65535;
+			uint32_t adlerA = 1;
+			uint32_t adlerB = 0;
+			for (size_t offset = 0; offset < scanlines.size() || offset == 0; offset += MAX_STORED_BLOCK) {
+				const size_t size = std::min(MAX_STORED_BLOCK, scanlines.size() - offset);
+				const bool last = offset + size >= scanlines.size();
+				zlib.push_back(last ? 1 : 0);
+				zlib.push_back(static_cast<uint8_t>(size));
+				zlib.push_back(static_cast<uint8_t>(size >> 8));
+				zlib.push_back(static_cast<uint8_t>(~size));
+				zlib.push_back(static_cast<uint8_t>(~size >> 8));
+				zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + size);
+				if (last) {
+					break;
+				}
+			}
+			for (uint8_t byte : scanlines) {
+				adlerA = (adlerA + byte) % 65521;
+				adlerB = (adlerB + adlerA) % 65521;
+			}
+			appendBigEndian(zlib, (adlerB << 16) | adlerA);
+
+			std::vector<uint8_t> header;
+			appendBigEndian(header, extent.width);
+			appendBigEndian(header, extent.height);
+			header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8 bit, RGBA, deflate, no filtering methods, no interlace
+
+			std::vector<uint8_t> png{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+			appendChunk(png, "IHDR", header);
+			appendChunk(png, "IDAT", zlib);
+			appendChunk(png, "IEND", {});
+
+			std::ofstream file{ path, std::ios::binary };
+			file.write(reinterpret_cast<const char*>(png.data()), png.size());
+			return file.good();
+		}
+
+		bool isBgra(VkFormat format) {
+			switch (format) {
+			case VK_FORMAT_R8G8B8A8_UNORM:
+			case VK_FORMAT_R8G8B8A8_SRGB:
+				return false;
+			case VK_FORMAT_B8G8R8A8_UNORM:
+			case VK_FORMAT_B8G8R8A8_SRGB:
+				return true;
+			default:
+				throw std::runtime_error("Frame capture only handles 8 bit RGBA/BGRA images!");
+			}
+		}
+	}
+
+	VkmFrameCapture::Encoder VkmFrameCapture::encoderFromName(const std::string& name) {
+		if (name == "png") {
+			return Encoder::Png;
+		}
+		if (name == "raw") {
+			return Encoder::Raw;
+		}
+		if (name == "ffmpeg") {
+			return Encoder::FfmpegPipe;
+		}
+		throw std::runtime_error("Unknown capture encoder " + name + " (png, raw or ffmpeg)");
+	}
+
+	const char* VkmFrameCapture::encoderName(Encoder encoder) {
+		switch (encoder) {
+		case Encoder::Png: return "png";
+		case Encoder::Raw: return "raw";
+		case Encoder::FfmpegPipe: return "ffmpeg";
+		}
+		return "unknown";
+	}
+
+	VkmFrameCapture::VkmFrameCapture(VkmDevice& device, const Settings& settings)
+		: device{ device }, settings{ settings }, slots(std::max(settings.ringSize, 1u)), encoder{ [this]() { encodeLoop(); } } {}
+
+	VkmFrameCapture::~VkmFrameCapture() {
+		flush();
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+		}
+		jobAvailable.notify_one();
+		encoder.join();
+
+		if (ffmpeg) {
+			VKM_PCLOSE(ffmpeg); // Waits for ffmpeg to finish the file
+		}
+		// flush waited for every copy, nothing on the GPU uses the buffers anymore
+		for (Slot& slot : slots) {
+			if (slot.buffer != VK_NULL_HANDLE) {
+				device.destroyBuffer(slot.buffer, slot.allocation);
+			}
+		}
+	}
+
+	uint32_t VkmFrameCapture::findFreeSlot() const {
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			if (slots[i].state == SlotState::Free) {
+				return i;
+			}
+		}
+		return UINT32_MAX;
+	}
+
+	bool VkmFrameCapture::recordCopy(
+		VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, VkImageLayout layout) {
+		VKM_PROFILE_SCOPE("recordCapture");
+		const bool bgra = isBgra(format);
+		const uint64_t frame = device.currentFrame();
+
+		uint32_t slotIndex = UINT32_MAX;
+		while (slotIndex == UINT32_MAX) {
+			poll();
+			std::unique_lock<std::mutex> lock{ mutex };
+			slotIndex = findFreeSlot();
+			if (slotIndex != UINT32_MAX) {
+				break;
+			}
+			// Copies recorded in this very frame can't land before it is submitted, waiting on them would never end
+			auto oldest = std::min_element(slots.begin(), slots.end(), [](const Slot& a, const Slot& b) {
+				return a.captureIndex < b.captureIndex;
+			});
+			if (!settings.waitWhenFull || (oldest->state == SlotState::Pending && oldest->frame >= frame)) {
+				stats.droppedFrames++;
+				return false;
+			}
+			if (oldest->state == SlotState::Pending) {
+				const uint64_t waitFrame = oldest->frame;
+				lock.unlock();
+				device.waitForFrame(waitFrame);
+			} else {
+				slotReleased.wait(lock);
+			}
+		}
+
+		// Free slots belong to this thread, the encoder only touches Encoding ones
+		Slot& slot = slots[slotIndex];
+		const VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+		if (slot.capacity < size) {
+			if (slot.buffer != VK_NULL_HANDLE) {
+				device.destroyBuffer(slot.buffer, slot.allocation); // Its last copy was encoded already
+			}
+			// Cached memory, the encoder reads every byte of it
+			device.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				slot.buffer, slot.allocation, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+			slot.capacity = size;
+		}
+
+		VkImageMemoryBarrier toTransfer{};
+		toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		toTransfer.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		toTransfer.oldLayout = layout;
+		toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toTransfer.image = image;
+		toTransfer.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		const bool restoreLayout = layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		if (restoreLayout) {
+			// Whatever rendered the image, the layout alone doesn't say which stage that was
+			vkCmdPipelineBarrier(commandBuffer,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+		}
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0; // Tightly packed
+		region.bufferImageHeight = 0;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { extent.width, extent.height, 1 };
+		vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+		// The copy has to be visible to the host once the frame's timeline value is signaled,
+		// and the image goes back to what the caller had it in
+		VkBufferMemoryBarrier toHost{};
+		toHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toHost.buffer = slot.buffer;
+		toHost.offset = 0;
+		toHost.size = size;
+
+		VkImageMemoryBarrier toLayout = toTransfer;
+		toLayout.srcAccessMask = 0;
+		toLayout.dstAccessMask = 0;
+		toLayout.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		toLayout.newLayout = layout;
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0, 0, nullptr, 1, &toHost, restoreLayout ? 1 : 0, restoreLayout ? &toLayout : nullptr);
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		slot.state = SlotState::Pending;
+		slot.frame = frame;
+		slot.captureIndex = nextCaptureIndex++;
+		slot.extent = extent;
+		slot.bgra = bgra;
+		stats.capturedFrames++;
+		return true;
+	}
+
+	void VkmFrameCapture::poll() {
+		const uint64_t completedFrame = device.completedFrame();
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			// In capture order, so video frames come out in the order they were rendered
+			std::vector<uint32_t> landed;
+			for (uint32_t i = 0; i < slots.size(); i++) {
+				if (slots[i].state == SlotState::Pending && slots[i].frame <= completedFrame) {
+					landed.push_back(i);
+				}
+			}
+			if (landed.empty()) {
+				return;
+			}
+			std::sort(landed.begin(), landed.end(), [this](uint32_t a, uint32_t b) {
+				return slots[a].captureIndex < slots[b].captureIndex;
+			});
+			const uint64_t currentFrame = device.currentFrame();
+			for (uint32_t i : landed) {
+				slots[i].state = SlotState::Encoding;
+				jobs.push_back({ i, slots[i].captureIndex, currentFrame - slots[i].frame });
+			}
+		}
+		jobAvailable.notify_one();
+	}
+
+	void VkmFrameCapture::flush() {
+		uint64_t lastFrame = 0;
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			for (const Slot& slot : slots) {
+				if (slot.state == SlotState::Pending) {
+					lastFrame = std::max(lastFrame, slot.frame);
+				}
+			}
+		}
+		assert(lastFrame < device.currentFrame() && "Flushing a copy whose frame wasn't submitted");
+		device.waitForFrame(lastFrame);
+		poll();
+
+		std::unique_lock<std::mutex> lock{ mutex };
+		slotReleased.wait(lock, [this]() { return jobs.empty() && encodingCount == 0; });
+	}
+
+	VkmFrameCapture::Stats VkmFrameCapture::getStats() {
+		std::lock_guard<std::mutex> lock{ mutex };
+		Stats result = stats;
+		if (finishedJobs > 0) {
+			result.averageLatencyFrames = totalLatencyFrames / finishedJobs;
+			result.averageEncodeMs = totalEncodeMs / finishedJobs;
+		}
+		return result;
+	}
+
+	void VkmFrameCapture::encodeLoop() {
+		VkmCpuProfiler::get().setThreadName("frame capture");
+		std::vector<uint8_t> rgba; // Reused, only grows
+
+		std::unique_lock<std::mutex> lock{ mutex };
+		while (true) {
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (jobs.empty()) {
+				return; // Stopping, and flush already drained everything
+			}
+			Job job = jobs.front();
+			jobs.pop_front();
+			encodingCount++;
+			const Slot& slot = slots[job.slot];
+			const VkExtent2D extent = slot.extent;
+			const bool bgra = slot.bgra;
+			const auto* pixels = static_cast<const uint8_t*>(slot.allocation.mappedData);
+			lock.unlock();
+
+			const auto start = std::chrono::steady_clock::now();
+			{
+				// Out of the mapped buffer first so it can go back to the ring before the slow part
+				VKM_PROFILE_SCOPE("readback");
+				const size_t size = static_cast<size_t>(extent.width) * extent.height * 4;
+				rgba.resize(size);
+				std::memcpy(rgba.data(), pixels, size);
+				if (bgra) {
+					for (size_t i = 0; i < size; i += 4) {
+						std::swap(rgba[i], rgba[i + 2]);
+					}
+				}
+			}
+			lock.lock();
+			slots[job.slot].state = SlotState::Free;
+			lock.unlock();
+			slotReleased.notify_all();
+
+			encode(job, rgba, extent);
+			const double encodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			lock.lock();
+			encodingCount--;
+			finishedJobs++;
+			totalEncodeMs += encodeMs;
+			totalLatencyFrames += static_cast<double>(job.latencyFrames);
+			stats.maxEncodeMs = std::max(stats.maxEncodeMs, encodeMs);
+			slotReleased.notify_all();
+		}
+	}
+
+	void VkmFrameCapture::encode(const Job& job, const std::vector<uint8_t>& rgba, VkExtent2D extent) {
+		VKM_PROFILE_SCOPE("encode");
+		bool written = false;
+		switch (settings.encoder) {
+		case Encoder::Png:
+			written = writePng(framePath(job.captureIndex, "png"), extent, rgba);
+			break;
+		case Encoder::Raw: {
+			std::ofstream file{ framePath(job.captureIndex, "raw"), std::ios::binary };
+			file.write(reinterpret_cast<const char*>(rgba.data()), rgba.size());
+			written = file.good();
+			break;
+		}
+		case Encoder::FfmpegPipe:
+			if (!ffmpeg) {
+				// The video's size is whatever the first frame had
+				std::ostringstream command;
+				command << "ffmpeg -loglevel error -y -f rawvideo -pix_fmt rgba -s " << extent.width << "x" << extent.height
+					<< " -r " << settings.ffmpegFps << " -i - -c:v libx264 -pix_fmt yuv420p \"" << settings.output << "\"";
+#ifdef _WIN32
+				ffmpeg = VKM_POPEN(command.str().c_str(), "wb");
+#else
+				ffmpeg = VKM_POPEN(command.str().c_str(), "w");
+#endif
+				ffmpegExtent = extent;
+				if (!ffmpeg) {
+					std::cerr << "Frame capture: couldn't start ffmpeg" << std::endl;
+				}
+			}
+			if (ffmpeg && extent.width == ffmpegExtent.width && extent.height == ffmpegExtent.height) {
+				written = std::fwrite(rgba.data(), 1, rgba.size(), ffmpeg) == rgba.size();
+			}
+			break;
+		}
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (written) {
+			stats.encodedFrames++;
+		} else {
+			stats.droppedFrames++;
+		}
+	}
+
+	std::string VkmFrameCapture::framePath(uint64_t captureIndex, const char* extension) const {
+		std::ostringstream path;
+		path << settings.output << "_" << std::setw(6) << std::setfill('0') << captureIndex << "." << extension;
+		return path.str();
+	}
+
+	std::ostream& operator<<(std::ostream& os, const VkmFrameCapture::Stats& stats) {
+		os << stats.capturedFrames << " captured, " << stats.encodedFrames << " written, " << stats.droppedFrames
+			<< " dropped, " << stats.averageLatencyFrames << " frames readback latency, encode average "
+			<< stats.averageEncodeMs << " ms, max " << stats.maxEncodeMs << " ms";
+		return os;
+	}
+
+} // Namespace vkm
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "vkm_device.h"
+
+// Standard Library
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vkm {
+
+	// Gets rendered images back to the CPU without stalling the frame. recordCopy puts a copy into the frame's
+	// command buffer targeting one of a ring of host visible buffers, poll hands buffers whose frame retired on the
+	// device frame timeline (a few frames later) to an encoder thread, which writes them out and frees the buffer.
+	// Nothing ever waits on the queue, when the ring is full a frame is skipped (or waited for, see waitWhenFull)
+	class VkmFrameCapture {
+	public:
+		enum class Encoder {
+			Png, // output_000000.png, uncompressed deflate so no zlib needed. Byte exact, for golden images
+			Raw, // output_000000.raw, tightly packed RGBA8 rows
+			FfmpegPipe // Raw RGBA frames piped into ffmpeg (has to be on PATH), output is the video file
+		};
+
+		struct Settings {
+			Encoder encoder = Encoder::Png;
+			std::string output = "capture";
+			uint32_t ringSize = 4; // Readbacks in flight plus the ones waiting for the encoder
+			uint32_t ffmpegFps = 60;
+			// Wait for a buffer instead of skipping the frame. Headless batch output wants every frame,
+			// interactive capture would rather drop some than slow down rendering
+			bool waitWhenFull = false;
+		};
+
+		struct Stats {
+			uint64_t capturedFrames = 0; // Copies recorded
+			uint64_t encodedFrames = 0;
+			uint64_t droppedFrames = 0; // Ring full, or a frame ffmpeg couldn't take (extent changed)
+			double averageLatencyFrames = 0.0; // Frames between recording a copy and the encoder getting it
+			double averageEncodeMs = 0.0;
+			double maxEncodeMs = 0.0;
+		};
+
+		static Encoder encoderFromName(const std::string& name); // png, raw or ffmpeg
+		static const char* encoderName(Encoder encoder);
+
+		VkmFrameCapture(VkmDevice& device, const Settings& settings);
+		// Flushes, so everything recorded so far is written out
+		~VkmFrameCapture();
+
+		VkmFrameCapture(const VkmFrameCapture &) = delete;
+		VkmFrameCapture &operator=(const VkmFrameCapture &) = delete;
+
+		// Outside a render pass, after the image was rendered. image is in layout and goes back to it afterwards.
+		// TRANSFER_SRC_OPTIMAL means the caller already made the writes visible to transfer reads (the offscreen
+		// render pass' external dependency does). 8 bit RGBA/BGRA formats only. False when the frame was skipped
+		bool recordCopy(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, VkImageLayout layout);
+		// Once per frame, after the submit. Never blocks
+		void poll();
+		// Waits until every copy recorded and submitted so far is written out
+		void flush();
+
+		Stats getStats();
+
+	private:
+		enum class SlotState { Free, Pending, Encoding };
+
+		struct Slot {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkmAllocation allocation;
+			VkDeviceSize capacity = 0;
+			SlotState state = SlotState::Free;
+			uint64_t frame = 0; // Device frame the copy was recorded in
+			uint64_t captureIndex = 0;
+			VkExtent2D extent{};
+			bool bgra = false;
+		};
+
+		struct Job {
+			uint32_t slot;
+			uint64_t captureIndex;
+			uint64_t latencyFrames;
+		};
+
+		// Under the mutex. The first free slot, UINT32_MAX when there is none
+		uint32_t findFreeSlot() const;
+		void encodeLoop();
+		void encode(const Job& job, const std::vector<uint8_t>& rgba, VkExtent2D extent);
+		std::string framePath(uint64_t captureIndex, const char* extension) const;
+
+		VkmDevice& device;
+		Settings settings;
+		uint64_t nextCaptureIndex = 0;
+
+		std::mutex mutex;
+		std::condition_variable jobAvailable;
+		std::condition_variable slotReleased;
+		std::vector<Slot> slots;
+		std::deque<Job> jobs;
+		uint32_t encodingCount = 0; // Jobs taken by the encoder thread and not done yet
+		Stats stats{};
+		uint64_t finishedJobs = 0; // Written or not, what the totals are averaged over
+		double totalLatencyFrames = 0.0;
+		double totalEncodeMs = 0.0;
+		bool stopping = false;
+
+		FILE* ffmpeg = nullptr; // Encoder thread only
+		VkExtent2D ffmpegExtent{};
+
+		std::thread encoder; // Last so everything above exists before it starts
+	};
+
+	std::ostream& operator<<(std::ostream& os, const VkmFrameCapture::Stats& stats);
+
+} // Namespace vkm
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "vkm_gpu_profiler.h"
+
+// Vulkan
+#include <vulkan/vulkan.h>
+
+namespace vkm {
+
+	class VkmSecondaryRecorder;
+
+	// Everything a render system needs to record its part of a frame
+	struct FrameInfo {
+		int frameIndex;
+		float frameTime;
+		VkCommandBuffer commandBuffer;
+		VkmGpuProfiler* gpuProfiler; // Can be null
+		// Set while the pass takes secondary command buffers, draws then have to go through it instead of commandBuffer
+		VkmSecondaryRecorder* secondaryRecorder = nullptr;
+	};
+
+} // Namespace vkm
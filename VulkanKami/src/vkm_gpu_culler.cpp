@@ -0,0 +1,256 @@
+#include "vkm_gpu_culler.h"
+#include "vkm_cpu_profiler.h"
+
+// Standard Libraries
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+namespace vkm {
+
+	static constexpr uint32_t STORAGE_BUFFER_COUNT = 4;
+	static constexpr VkDeviceSize COMMAND_SIZE = sizeof(VkDrawIndexedIndirectCommand);
+
+	VkmGpuCuller::VkmGpuCuller(VkmDevice& device) : vkmDevice{ device } {
+		createDescriptors();
+		createPipeline();
+	}
+
+	VkmGpuCuller::~VkmGpuCuller() {
+		for (auto& frame : frames) {
+			destroyBuffer(frame.objects);
+			destroyBuffer(frame.batches);
+			destroyBuffer(frame.commands);
+			destroyBuffer(frame.instances);
+		}
+		cullPipeline.reset();
+		vkDestroyPipelineLayout(vkmDevice.device(), pipelineLayout, nullptr);
+		vkDestroyDescriptorPool(vkmDevice.device(), descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(vkmDevice.device(), descriptorSetLayout, nullptr);
+	}
+
+	void VkmGpuCuller::createDescriptors() {
+		std::array<VkDescriptorSetLayoutBinding, STORAGE_BUFFER_COUNT> bindings{};
+		for (uint32_t i = 0; i < STORAGE_BUFFER_COUNT; i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+		if (vkCreateDescriptorSetLayout(vkmDevice.device(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create culling descriptor set layout!");
+		}
+
+		VkDescriptorPoolSize poolSize{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, STORAGE_BUFFER_COUNT * MAX_FRAMES };
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = MAX_FRAMES;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		if (vkCreateDescriptorPool(vkmDevice.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create culling descriptor pool!");
+		}
+
+		std::array<VkDescriptorSetLayout, MAX_FRAMES> setLayouts;
+		setLayouts.fill(descriptorSetLayout);
+		std::array<VkDescriptorSet, MAX_FRAMES> sets{};
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = MAX_FRAMES;
+		allocInfo.pSetLayouts = setLayouts.data();
+		if (vkAllocateDescriptorSets(vkmDevice.device(), &allocInfo, sets.data()) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate culling descriptor sets!");
+		}
+		for (uint32_t i = 0; i < MAX_FRAMES; i++) {
+			frames[i].descriptorSet = sets[i];
+		}
+	}
+
+	void VkmGpuCuller::createPipeline() {
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(CullPush);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		if (vkCreatePipelineLayout(vkmDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create culling pipeline layout!");
+		}
+
+		cullPipeline = std::make_unique<VkmComputePipeline>(vkmDevice, "src/shaders/cull.comp.spv", pipelineLayout);
+	}
+
+	bool VkmGpuCuller::ensureSize(
+		FrameBuffer& frameBuffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+		if (frameBuffer.size >= size) {
+			return false;
+		}
+		// Only this frame slot uses the buffer and its last frame has been waited on, nothing in flight reads it
+		destroyBuffer(frameBuffer);
+		frameBuffer.size = std::max<VkDeviceSize>(size, frameBuffer.size * 2);
+		vkmDevice.createBuffer(frameBuffer.size, usage, properties, frameBuffer.buffer, frameBuffer.allocation);
+		return true;
+	}
+
+	void VkmGpuCuller::destroyBuffer(FrameBuffer& frameBuffer) {
+		if (frameBuffer.buffer != VK_NULL_HANDLE) {
+			vkmDevice.destroyBuffer(frameBuffer.buffer, frameBuffer.allocation);
+			frameBuffer.buffer = VK_NULL_HANDLE;
+			frameBuffer.size = 0;
+		}
+	}
+
+	void VkmGpuCuller::writeDescriptorSet(Frame& frame) {
+		const FrameBuffer* buffers[STORAGE_BUFFER_COUNT] = {
+			&frame.objects, &frame.batches, &frame.commands, &frame.instances };
+
+		std::array<VkDescriptorBufferInfo, STORAGE_BUFFER_COUNT> bufferInfos{};
+		std::array<VkWriteDescriptorSet, STORAGE_BUFFER_COUNT> writes{};
+		for (uint32_t i = 0; i < STORAGE_BUFFER_COUNT; i++) {
+			bufferInfos[i].buffer = buffers[i]->buffer;
+			bufferInfos[i].offset = 0;
+			bufferInfos[i].range = VK_WHOLE_SIZE;
+
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = frame.descriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+		vkUpdateDescriptorSets(vkmDevice.device(), STORAGE_BUFFER_COUNT, writes.data(), 0, nullptr);
+	}
+
+	void VkmGpuCuller::cull(FrameInfo& frameInfo, const VkmRenderList& renderList) {
+		VKM_PROFILE_SCOPE("VkmGpuCuller::cull");
+		assert(frameInfo.frameIndex >= 0 && frameInfo.frameIndex < static_cast<int>(MAX_FRAMES) && "Too many frames in flight for the culler");
+		Frame& frame = frames[frameInfo.frameIndex];
+		const uint32_t objectCount = renderList.size();
+
+		// This slot's commands still hold what the GPU counted the last time it ran
+		if (frame.commands.buffer != VK_NULL_HANDLE) {
+			const auto* commands = static_cast<const uint32_t*>(frame.commands.allocation.mappedData);
+			lastVisibleCount = 0;
+			for (size_t batch = 0; batch < frame.models.size(); batch++) {
+				lastVisibleCount += commands[batch * 5 + 1];
+			}
+		}
+
+		// Batches (one per model) get contiguous instance ranges
+		batchLookup.clear();
+		batchSizes.clear();
+		frame.models.clear();
+		VkmModel* lastModel = nullptr;
+		uint32_t lastBatch = 0;
+		for (VkmModel* model : renderList.models) {
+			if (model != lastModel) {
+				auto inserted = batchLookup.emplace(model, static_cast<uint32_t>(frame.models.size()));
+				if (inserted.second) {
+					frame.models.push_back(model);
+					batchSizes.push_back(0);
+				}
+				lastModel = model;
+				lastBatch = inserted.first->second;
+			}
+			batchSizes[lastBatch]++;
+		}
+		const uint32_t batchCount = static_cast<uint32_t>(frame.models.size());
+		frame.firstInstances.resize(batchCount);
+		uint32_t firstInstance = 0;
+		for (uint32_t batch = 0; batch < batchCount; batch++) {
+			frame.firstInstances[batch] = firstInstance;
+			firstInstance += batchSizes[batch];
+		}
+
+		// Never create zero sized buffers, an empty scene still gets valid descriptors
+		const VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		const VkDeviceSize objectsSize = sizeof(ObjectData) * std::max(objectCount, 1u);
+		const VkDeviceSize batchesSize = sizeof(uint32_t) * std::max(batchCount, 1u);
+		bool reallocated = false;
+		reallocated |= ensureSize(frame.objects, objectsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+		reallocated |= ensureSize(frame.batches, batchesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+		reallocated |= ensureSize(
+			frame.commands, COMMAND_SIZE * std::max(batchCount, 1u),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, hostVisible);
+		reallocated |= ensureSize(
+			frame.instances, static_cast<VkDeviceSize>(INSTANCE_STRIDE) * std::max(objectCount, 1u),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		if (reallocated) {
+			writeDescriptorSet(frame);
+		}
+
+		auto* objects = static_cast<ObjectData*>(frame.objects.allocation.mappedData);
+		const VkmTransformBatch& transforms = renderList.transforms;
+		for (uint32_t i = 0; i < objectCount; i++) {
+			VkmModel* model = renderList.models[i];
+			const float scale = std::max(std::abs(transforms.scaleX[i]), std::abs(transforms.scaleY[i]));
+			objects[i].transform = { transforms.col0x[i], transforms.col0y[i], transforms.col1x[i], transforms.col1y[i] };
+			objects[i].offset = { transforms.translationX[i], transforms.translationY[i] };
+			objects[i].radius = model->getBoundingRadius() * scale;
+			objects[i].batch = batchLookup[model];
+			objects[i].color = glm::vec4(renderList.colors[i], 1.f);
+		}
+
+		auto* batches = static_cast<uint32_t*>(frame.batches.allocation.mappedData);
+		auto* commands = static_cast<uint32_t*>(frame.commands.allocation.mappedData);
+		for (uint32_t batch = 0; batch < batchCount; batch++) {
+			batches[batch] = frame.firstInstances[batch];
+			frame.models[batch]->writeIndirectCommand(commands + batch * 5);
+		}
+
+		if (objectCount == 0) {
+			return;
+		}
+
+		VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+		VkmGpuScope gpuScope{ frameInfo.gpuProfiler, commandBuffer, "GPU cull" };
+		cullPipeline->bind(commandBuffer);
+		vkCmdBindDescriptorSets(
+			commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+		CullPush push{ viewRect, objectCount };
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPush), &push);
+		vkCmdDispatch(commandBuffer, (objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+		// Commands are read by the indirect draw, instances by the vertex input
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void VkmGpuCuller::draw(FrameInfo& frameInfo) {
+		VKM_PROFILE_SCOPE("VkmGpuCuller::draw");
+		Frame& frame = frames[frameInfo.frameIndex];
+		VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+
+		lastDrawCount = 0;
+		for (size_t batch = 0; batch < frame.models.size(); batch++) {
+			frame.models[batch]->bind(commandBuffer);
+			// Binding at the batch's offset keeps firstInstance 0, which doesn't need drawIndirectFirstInstance
+			VkDeviceSize instanceOffset = static_cast<VkDeviceSize>(frame.firstInstances[batch]) * INSTANCE_STRIDE;
+			vkCmdBindVertexBuffers(commandBuffer, 1, 1, &frame.instances.buffer, &instanceOffset);
+			// A fully culled model still gets its draw, with instanceCount 0 it does nothing
+			frame.models[batch]->drawIndirect(commandBuffer, frame.commands.buffer, COMMAND_SIZE * batch);
+			lastDrawCount++;
+		}
+	}
+
+} // Namespace vkm
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "vkm_device.h"
+#include "vkm_pipeline.h"
+#include "vkm_frame_info.h"
+#include "vkm_render_list.h"
+
+// Standard Library
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace vkm {
+
+	// GPU driven drawing: object transforms and bounds go into a storage buffer, a compute pass culls them
+	// against the view and compacts the visible ones into per model instance ranges + indirect commands.
+	// The CPU records one indirect draw per model no matter how many objects there are (or how many are visible).
+	// Every model has its own vertex/index buffers so the draws can't be merged into one call
+	class VkmGpuCuller {
+	public:
+		static constexpr uint32_t MAX_FRAMES = 4;
+		static constexpr uint32_t WORKGROUP_SIZE = 64; // Has to match cull.comp
+		// Per instance data written for the instanced pipeline, mat2 (4) + offset (2) + color (3) floats
+		static constexpr uint32_t INSTANCE_STRIDE = 9 * sizeof(float);
+
+		VkmGpuCuller(VkmDevice& device);
+		~VkmGpuCuller();
+
+		VkmGpuCuller(const VkmGpuCuller &) = delete;
+		VkmGpuCuller &operator=(const VkmGpuCuller &) = delete;
+
+		// Outside a render pass. Uploads the objects (matrices already computed) and records the culling dispatch
+		void cull(FrameInfo& frameInfo, const VkmRenderList& renderList);
+		// Inside the render pass with an instanced pipeline bound (instance data on binding 1)
+		void draw(FrameInfo& frameInfo);
+
+		// Objects the view is tested against, in NDC by default
+		void setViewRect(glm::vec4 rect) { viewRect = rect; }
+		// Read back from this frame slot's previous run, so it is a few frames old
+		uint32_t getLastVisibleCount() const { return lastVisibleCount; }
+		uint32_t getLastDrawCount() const { return lastDrawCount; }
+
+	private:
+		// Has to match cull.comp (std430)
+		struct ObjectData {
+			glm::vec4 transform;
+			glm::vec2 offset;
+			float radius;
+			uint32_t batch;
+			glm::vec4 color;
+		};
+
+		struct CullPush {
+			glm::vec4 viewRect;
+			uint32_t objectCount;
+		};
+
+		struct FrameBuffer {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkmAllocation allocation;
+			VkDeviceSize size = 0;
+		};
+
+		struct Frame {
+			FrameBuffer objects; // ObjectData, host visible
+			FrameBuffer batches; // First instance of every model, host visible
+			FrameBuffer commands; // One indirect command per model, host visible so the CPU can reset them
+			FrameBuffer instances; // Written by the compute pass, device local
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			std::vector<VkmModel*> models; // The batches recorded this frame, draw() goes through them
+			std::vector<uint32_t> firstInstances;
+		};
+
+		void createDescriptors();
+		void createPipeline();
+		// True when the buffer had to be (re)created
+		bool ensureSize(FrameBuffer& frameBuffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+		void destroyBuffer(FrameBuffer& frameBuffer);
+		void writeDescriptorSet(Frame& frame);
+
+		VkmDevice& vkmDevice;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		std::unique_ptr<VkmComputePipeline> cullPipeline;
+
+		Frame frames[MAX_FRAMES];
+		std::unordered_map<VkmModel*, uint32_t> batchLookup; // Scratch
+		std::vector<uint32_t> batchSizes; // Scratch
+
+		glm::vec4 viewRect{ -1.f, -1.f, 1.f, 1.f };
+		uint32_t lastVisibleCount = 0;
+		uint32_t lastDrawCount = 0;
+	};
+
+} // Namespace vkm
@@ -0,0 +1,195 @@
+#include "vkm_gpu_profiler.h"
+
+// Standard Libraries
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace vkm {
+
+	VkmGpuProfiler::VkmGpuProfiler(VkmDevice &device, uint32_t framesInFlight) : vkmDevice{ device } {
+		// Timestamps only mean something if the queue we render on actually writes them
+		uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(vkmDevice.getPhysicalDevice(), &familyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> families(familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(vkmDevice.getPhysicalDevice(), &familyCount, families.data());
+
+		uint32_t validBits = families[vkmDevice.findPhysicalQueueFamilies().graphicsFamily].timestampValidBits;
+		supported = validBits > 0;
+		if (!supported) {
+			std::cout << "GPU profiler: graphics queue has no timestamp support, profiling disabled" << std::endl;
+			return;
+		}
+		timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		timestampPeriodNs = vkmDevice.properties.limits.timestampPeriod;
+
+		frames.resize(framesInFlight);
+		for (auto& frame : frames) {
+			VkQueryPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			poolInfo.queryCount = MAX_SCOPES_PER_FRAME * 2;
+			if (vkCreateQueryPool(vkmDevice.device(), &poolInfo, nullptr, &frame.queryPool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create timestamp query pool!");
+			}
+			frame.scopes.reserve(MAX_SCOPES_PER_FRAME);
+		}
+		resultScratch.resize(MAX_SCOPES_PER_FRAME * 2);
+	}
+
+	VkmGpuProfiler::~VkmGpuProfiler() {
+		for (auto& frame : frames) {
+			vkDestroyQueryPool(vkmDevice.device(), frame.queryPool, nullptr);
+		}
+	}
+
+	void VkmGpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+		if (!supported) {
+			return;
+		}
+		FrameQueries& frame = frames[frameIndex % frames.size()];
+		resolve(frame);
+
+		frame.scopes.clear();
+		frame.queryCount = 0;
+		vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, MAX_SCOPES_PER_FRAME * 2);
+		currentFrame = &frame;
+
+		logIfDue();
+	}
+
+	uint32_t VkmGpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char* name) {
+		if (!supported || currentFrame == nullptr || currentFrame->scopes.size() >= MAX_SCOPES_PER_FRAME) {
+			return UINT32_MAX;
+		}
+
+		Scope scope{};
+		scope.nameIndex = nameIndexFor(name);
+		scope.beginQuery = currentFrame->queryCount++;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, currentFrame->queryPool, scope.beginQuery);
+		currentFrame->scopes.push_back(scope);
+		return static_cast<uint32_t>(currentFrame->scopes.size() - 1);
+	}
+
+	void VkmGpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+		if (scope == UINT32_MAX || currentFrame == nullptr) {
+			return;
+		}
+		Scope& entry = currentFrame->scopes[scope];
+		entry.endQuery = currentFrame->queryCount++;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, currentFrame->queryPool, entry.endQuery);
+	}
+
+	void VkmGpuProfiler::resolve(FrameQueries& frame) {
+		if (frame.queryCount == 0) {
+			return;
+		}
+
+		// No WAIT flag, the frame was already waited on. If the results still aren't there
+		// (frame was never submitted) the samples are dropped rather than blocking
+		VkResult result = vkGetQueryPoolResults(
+			vkmDevice.device(),
+			frame.queryPool,
+			0,
+			frame.queryCount,
+			frame.queryCount * sizeof(uint64_t),
+			resultScratch.data(),
+			sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			return;
+		}
+
+		for (const auto& scope : frame.scopes) {
+			if (scope.endQuery == UINT32_MAX) {
+				continue; // Never closed
+			}
+			uint64_t begin = resultScratch[scope.beginQuery] & timestampMask;
+			uint64_t end = resultScratch[scope.endQuery] & timestampMask;
+			double ms = static_cast<double>((end - begin) & timestampMask) * timestampPeriodNs / 1e6;
+
+			History& history = histories[scope.nameIndex];
+			if (history.samples.size() < HISTORY_SIZE) {
+				history.samples.push_back(ms);
+			} else {
+				history.samples[history.next] = ms;
+			}
+			history.next = (history.next + 1) % HISTORY_SIZE;
+		}
+	}
+
+	uint32_t VkmGpuProfiler::nameIndexFor(const char* name) {
+		auto it = nameIndices.find(name);
+		if (it != nameIndices.end()) {
+			return it->second;
+		}
+		uint32_t index = static_cast<uint32_t>(histories.size());
+		histories.push_back(History{ name, {}, 0 });
+		histories.back().samples.reserve(HISTORY_SIZE);
+		nameIndices.emplace(name, index);
+		return index;
+	}
+
+	VkmGpuProfiler::ScopeStats VkmGpuProfiler::getStats(const std::string& name) const {
+		ScopeStats stats{};
+		auto it = nameIndices.find(name);
+		if (it == nameIndices.end() || histories[it->second].samples.empty()) {
+			return stats;
+		}
+
+		std::vector<double> sorted = histories[it->second].samples;
+		std::sort(sorted.begin(), sorted.end());
+		auto percentile = [&sorted](double p) {
+			return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+		};
+
+		double total = 0.0;
+		for (double sample : sorted) {
+			total += sample;
+		}
+		stats.sampleCount = static_cast<uint32_t>(sorted.size());
+		stats.averageMs = total / sorted.size();
+		stats.p50Ms = percentile(0.50);
+		stats.p95Ms = percentile(0.95);
+		stats.p99Ms = percentile(0.99);
+		stats.maxMs = sorted.back();
+		return stats;
+	}
+
+	std::vector<std::pair<std::string, VkmGpuProfiler::ScopeStats>> VkmGpuProfiler::getAllStats() const {
+		std::vector<std::pair<std::string, ScopeStats>> all;
+		all.reserve(histories.size());
+		for (const auto& history : histories) {
+			all.emplace_back(history.name, getStats(history.name));
+		}
+		return all;
+	}
+
+	void VkmGpuProfiler::logIfDue() {
+		if (logInterval <= 0.0 || histories.empty()) {
+			return;
+		}
+		auto now = std::chrono::steady_clock::now();
+		if (std::chrono::duration<double>(now - lastLog).count() < logInterval) {
+			return;
+		}
+		lastLog = now;
+
+		std::cout << "GPU:";
+		for (const auto& entry : getAllStats()) {
+			std::cout << " [" << entry.first << " " << entry.second << "]";
+		}
+		std::cout << std::endl;
+	}
+
+	std::ostream& operator<<(std::ostream& os, const VkmGpuProfiler::ScopeStats& stats) {
+		auto flags = os.flags();
+		os << std::fixed << std::setprecision(3)
+			<< "avg " << stats.averageMs << " ms, p50 " << stats.p50Ms << ", p95 " << stats.p95Ms
+			<< ", p99 " << stats.p99Ms << ", max " << stats.maxMs;
+		os.flags(flags);
+		return os;
+	}
+
+} // Namespace vkm
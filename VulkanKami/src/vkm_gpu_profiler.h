@@ -0,0 +1,117 @@
+#pragma once
+
+#include "vkm_device.h"
+
+// Standard Library
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vkm {
+
+	// GPU timings from timestamp queries. Every frame in flight gets its own query pool, a pool is
+	// read back when its frame index comes around again (the frame has been waited on by then),
+	// so results are a frames in flight's worth of frames old but reading them never stalls
+	class VkmGpuProfiler {
+	public:
+		static constexpr uint32_t MAX_SCOPES_PER_FRAME = 64;
+		static constexpr uint32_t HISTORY_SIZE = 240; // Samples kept per scope for the rolling stats
+
+		struct ScopeStats {
+			double averageMs = 0.0;
+			double p50Ms = 0.0;
+			double p95Ms = 0.0;
+			double p99Ms = 0.0;
+			double maxMs = 0.0;
+			uint32_t sampleCount = 0;
+		};
+
+		VkmGpuProfiler(VkmDevice &device, uint32_t framesInFlight);
+		~VkmGpuProfiler();
+
+		VkmGpuProfiler(const VkmGpuProfiler &) = delete;
+		VkmGpuProfiler &operator=(const VkmGpuProfiler &) = delete;
+
+		// Call right after waiting for the slot's last frame and before any scope, outside a render pass.
+		// Resolves what this frame index recorded last time and resets its queries
+		void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+		// Scopes can nest. beginScope returns a handle for endScope (UINT32_MAX when out of queries)
+		uint32_t beginScope(VkCommandBuffer commandBuffer, const char* name);
+		void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+		bool isSupported() const { return supported; }
+		ScopeStats getStats(const std::string& name) const;
+		std::vector<std::pair<std::string, ScopeStats>> getAllStats() const;
+
+		// A summary line goes to the log every interval seconds (0 turns it off)
+		void setLogInterval(double seconds) { logInterval = seconds; }
+
+	private:
+		struct Scope {
+			uint32_t nameIndex;
+			uint32_t beginQuery;
+			uint32_t endQuery = UINT32_MAX;
+		};
+
+		struct FrameQueries {
+			VkQueryPool queryPool = VK_NULL_HANDLE;
+			std::vector<Scope> scopes;
+			uint32_t queryCount = 0;
+		};
+
+		struct History {
+			std::string name;
+			std::vector<double> samples; // Ring buffer of the last HISTORY_SIZE durations
+			uint32_t next = 0;
+		};
+
+		void resolve(FrameQueries& frame);
+		uint32_t nameIndexFor(const char* name);
+		void logIfDue();
+
+		VkmDevice& vkmDevice;
+		bool supported = false;
+		double timestampPeriodNs = 1.0;
+		uint64_t timestampMask = ~0ull;
+
+		std::vector<FrameQueries> frames;
+		FrameQueries* currentFrame = nullptr;
+
+		std::unordered_map<std::string, uint32_t> nameIndices;
+		std::vector<History> histories;
+		std::vector<uint64_t> resultScratch;
+
+		double logInterval = 5.0;
+		std::chrono::steady_clock::time_point lastLog = std::chrono::steady_clock::now();
+	};
+
+	std::ostream& operator<<(std::ostream& os, const VkmGpuProfiler::ScopeStats& stats);
+
+	// Closes the scope when it goes out of scope
+	class VkmGpuScope {
+	public:
+		VkmGpuScope(VkmGpuProfiler* profiler, VkCommandBuffer commandBuffer, const char* name)
+			: profiler{ profiler }, commandBuffer{ commandBuffer } {
+			if (profiler) {
+				scope = profiler->beginScope(commandBuffer, name);
+			}
+		}
+		~VkmGpuScope() {
+			if (profiler) {
+				profiler->endScope(commandBuffer, scope);
+			}
+		}
+
+		VkmGpuScope(const VkmGpuScope &) = delete;
+		VkmGpuScope &operator=(const VkmGpuScope &) = delete;
+
+	private:
+		VkmGpuProfiler* profiler;
+		VkCommandBuffer commandBuffer;
+		uint32_t scope = UINT32_MAX;
+	};
+
+} // Namespace vkm
@@ -0,0 +1,92 @@
+#include "vkm_latency_tracker.h"
+#include "vkm_cpu_profiler.h"
+
+// Standard Libraries
+#include <algorithm>
+#include <numeric>
+
+namespace vkm {
+
+	VkmLatencyTracker::VkmLatencyTracker(VkmDevice& device) : device{ device }, waiter{ [this]() { waitLoop(); } } {}
+
+	VkmLatencyTracker::~VkmLatencyTracker() {
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+		}
+		frameAvailable.notify_one();
+		waiter.join();
+	}
+
+	void VkmLatencyTracker::frameSubmitted(uint64_t frame, uint64_t inputNs) {
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			pending.push_back({ frame, inputNs, epoch });
+		}
+		frameAvailable.notify_one();
+	}
+
+	VkmLatencyTracker::Stats VkmLatencyTracker::getStats() {
+		std::vector<double> sorted;
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			sorted.assign(samplesMs.begin(), samplesMs.end());
+		}
+
+		Stats stats;
+		if (sorted.empty()) {
+			return stats;
+		}
+		std::sort(sorted.begin(), sorted.end());
+		stats.frameCount = static_cast<uint32_t>(sorted.size());
+		stats.averageMs = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+		stats.p99Ms = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+		stats.maxMs = sorted.back();
+		return stats;
+	}
+
+	void VkmLatencyTracker::reset() {
+		std::lock_guard<std::mutex> lock{ mutex };
+		samplesMs.clear();
+		epoch++;
+	}
+
+	void VkmLatencyTracker::waitLoop() {
+		VkmCpuProfiler::get().setThreadName("latency tracker");
+		VkSemaphore timeline = device.frameTimelineSemaphore();
+		// Short timeout so the destructor doesn't hang on a frame that never gets submitted
+		constexpr uint64_t TIMEOUT_NS = 50'000'000;
+
+		std::unique_lock<std::mutex> lock{ mutex };
+		while (true) {
+			frameAvailable.wait(lock, [this]() { return stopping || !pending.empty(); });
+			if (stopping) {
+				return;
+			}
+			PendingFrame next = pending.front();
+			lock.unlock();
+
+			VkSemaphoreWaitInfo waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &timeline;
+			waitInfo.pValues = &next.frame;
+			VkResult result = vkWaitSemaphores(device.device(), &waitInfo, TIMEOUT_NS);
+			const uint64_t completedNs = VkmCpuProfiler::get().now();
+
+			lock.lock();
+			if (result == VK_TIMEOUT) {
+				continue; // Checks stopping and tries again
+			}
+			pending.pop_front();
+			if (result != VK_SUCCESS || next.epoch != epoch) {
+				continue; // Device lost, or submitted under whatever was measured before the last reset
+			}
+			samplesMs.push_back((completedNs - next.inputNs) / 1e6);
+			if (samplesMs.size() > MAX_SAMPLES) {
+				samplesMs.pop_front();
+			}
+		}
+	}
+
+} // Namespace vkm
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "vkm_device.h"
+
+// Standard Library
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vkm {
+
+	// Input to display latency per frame: the app says when it sampled input for a frame, a thread waits on the
+	// device frame timeline for that frame and takes the time. Without VK_KHR_present_wait the actual flip isn't
+	// observable, so this stops at the GPU finishing the frame (the present itself adds up to one refresh on top
+	// in FIFO modes). Good enough to compare modes against each other, which is what it's for
+	class VkmLatencyTracker {
+	public:
+		struct Stats {
+			uint32_t frameCount = 0;
+			double averageMs = 0.0;
+			double p99Ms = 0.0;
+			double maxMs = 0.0;
+		};
+
+		explicit VkmLatencyTracker(VkmDevice& device);
+		~VkmLatencyTracker();
+
+		VkmLatencyTracker(const VkmLatencyTracker &) = delete;
+		VkmLatencyTracker &operator=(const VkmLatencyTracker &) = delete;
+
+		// frame is the device frame the submit signals, inputNs a VkmCpuProfiler::now() timestamp
+		void frameSubmitted(uint64_t frame, uint64_t inputNs);
+
+		// Frames submitted since the last reset that have completed
+		Stats getStats();
+		// Frames submitted before this still complete later but aren't counted, so a mode switch starts clean
+		void reset();
+
+	private:
+		static constexpr size_t MAX_SAMPLES = 1 << 14; // Oldest samples get dropped after this
+
+		struct PendingFrame {
+			uint64_t frame;
+			uint64_t inputNs;
+			uint32_t epoch; // Resets before it was submitted
+		};
+
+		void waitLoop();
+
+		VkmDevice& device;
+
+		std::mutex mutex;
+		std::condition_variable frameAvailable;
+		std::deque<PendingFrame> pending;
+		std::deque<double> samplesMs;
+		uint32_t epoch = 0;
+		bool stopping = false;
+
+		std::thread waiter; // Last so everything above exists before it starts
+	};
+
+} // Namespace vkm
@@ -1,43 +1,108 @@
 #include "vkm_model.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
 namespace vkm {
 
-	VkmModel::VkmModel(VkmDevice &device, const std::vector<Vertex> &vertices) : vkmDevice{ device } {
+	VkmModel::VkmModel(VkmDevice &device, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices)
+		: vkmDevice{ device } {
 		createVertexBuffers(vertices);
+		createIndexBuffers(indices);
 	}
+	// Frames in flight can still be drawing the model, the buffers go once they retire. A model that was never
+	// bound may still have its copy running on the transfer queue, so that has to be done too
 	VkmModel::~VkmModel() {
-		vkDestroyBuffer(vkmDevice.device(), vertexBuffer, nullptr);
-		vkFreeMemory(vkmDevice.device(), vertexBufferMemory, nullptr);
+		const VkmUploadTicket upload{ uploadTicket.load(std::memory_order_relaxed) };
+		vkmDevice.deferDestroyBuffer(vertexBuffer, vertexBufferAllocation, upload);
+		if (hasIndexBuffer) {
+			vkmDevice.deferDestroyBuffer(indexBuffer, indexBufferAllocation, upload);
+		}
 	}
 
 	void VkmModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
 		vertexCount = static_cast<uint32_t>(vertices.size());
 		assert(vertexCount >= 3 && "Vertex count must be at least 3");
+		for (const auto& vertex : vertices) {
+			boundingRadius = std::max(boundingRadius, glm::length(vertex.position));
+		}
+
 		VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
+		// Geometry lives in DEVICE_LOCAL memory, the data gets there through the device's staging ring
 		vkmDevice.createBuffer(
 			bufferSize,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			vertexBuffer,
-			vertexBufferMemory);
+			vertexBufferAllocation);
+		uploadTicket = vkmDevice.uploadToBuffer(vertexBuffer, vertices.data(), bufferSize).value;
+	}
+
+	void VkmModel::createIndexBuffers(const std::vector<uint32_t> &indices) {
+		indexCount = static_cast<uint32_t>(indices.size());
+		hasIndexBuffer = indexCount > 0;
+		if (!hasIndexBuffer) {
+			return;
+		}
 
-		void *data;
-		vkMapMemory(vkmDevice.device(), vertexBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, vertices.data(), static_cast<size_t>(bufferSize));
-		vkUnmapMemory(vkmDevice.device(), vertexBufferMemory);
+		VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
+		vkmDevice.createBuffer(
+			bufferSize,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			indexBuffer,
+			indexBufferAllocation);
+		uploadTicket = vkmDevice.uploadToBuffer(indexBuffer, indices.data(), bufferSize).value;
 	}
 
-	void VkmModel::draw(VkCommandBuffer commandBuffer) {
-		vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+	void VkmModel::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance) {
+		if (hasIndexBuffer) {
+			vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, firstInstance);
+		} else {
+			vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, firstInstance);
+		}
+	}
+
+	void VkmModel::writeIndirectCommand(uint32_t* command) const {
+		if (hasIndexBuffer) {
+			VkDrawIndexedIndirectCommand indexed{ indexCount, 0, 0, 0, 0 };
+			std::memcpy(command, &indexed, sizeof(indexed));
+		} else {
+			VkDrawIndirectCommand plain{ vertexCount, 0, 0, 0 };
+			std::memcpy(command, &plain, sizeof(plain));
+			command[4] = 0;
+		}
+	}
+
+	void VkmModel::drawIndirect(VkCommandBuffer commandBuffer, VkBuffer indirectBuffer, VkDeviceSize offset) {
+		const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+		if (hasIndexBuffer) {
+			vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, offset, 1, stride);
+		} else {
+			vkCmdDrawIndirect(commandBuffer, indirectBuffer, offset, 1, stride);
+		}
 	}
 
 	void VkmModel::bind(VkCommandBuffer commandBuffer) {
+		const VkmUploadTicket ticket{ uploadTicket.load(std::memory_order_relaxed) };
+		if (ticket.value != 0) {
+			// Until the transfer queue is done with our buffers the frame's submit has to wait for it.
+			// Both device calls are thread safe, and the value only ever goes to 0 so racing clears agree
+			if (vkmDevice.isUploadComplete(ticket)) {
+				uploadTicket.store(0, std::memory_order_relaxed);
+			} else {
+				vkmDevice.waitForUploadOnNextSubmit(ticket);
+			}
+		}
+
 		VkBuffer buffers[] = { vertexBuffer };
 		VkDeviceSize offsets[] = { 0 };
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+
+		if (hasIndexBuffer) {
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		}
 	}
 
 	std::vector<VkVertexInputBindingDescription> VkmModel::Vertex::getBindingDescriptions() {
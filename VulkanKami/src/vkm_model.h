@@ -6,6 +6,9 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+// Standard Library
+#include <atomic>
+
 namespace vkm {
 	class VkmModel {
 	public:
@@ -18,19 +21,42 @@ namespace vkm {
 			static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
 		};
 
-		VkmModel(VkmDevice& device, const std::vector<Vertex> &vertices);
+		// Indices are optional, without them the vertices are drawn as a plain triangle list
+		VkmModel(VkmDevice& device, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices = {});
 		~VkmModel();
 
 		VkmModel(const VkmWindow &) = delete;
 		VkmModel &operator=(const VkmWindow &) = delete;
 
+		// Safe to call from several recording threads at once
 		void bind(VkCommandBuffer commandBuffer);
-		void draw(VkCommandBuffer commandBuffer);
+		// Instance rate attributes (bound by the caller) are read starting at firstInstance
+		void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+		// Indirect commands are VkDrawIndexedIndirectCommand sized (5 uints) for both kinds of model, instanceCount is
+		// always the second member. Writes one with instanceCount 0
+		void writeIndirectCommand(uint32_t* command) const;
+		// Draws the one command at offset
+		void drawIndirect(VkCommandBuffer commandBuffer, VkBuffer indirectBuffer, VkDeviceSize offset);
+
+		// Radius around the model origin that contains every vertex
+		float getBoundingRadius() const { return boundingRadius; }
 	private:
 		void createVertexBuffers(const std::vector<Vertex> &vertices);
+		void createIndexBuffers(const std::vector<uint32_t> &indices);
+
 		VkmDevice& vkmDevice;
+		// Ticket value, cleared once the geometry is known to be on the GPU. Atomic because parallel record jobs bind
+		std::atomic<uint64_t> uploadTicket{ 0 };
+
 		VkBuffer vertexBuffer;
-		VkDeviceMemory vertexBufferMemory;
+		VkmAllocation vertexBufferAllocation;
 		uint32_t vertexCount;
+		float boundingRadius = 0.f;
+
+		bool hasIndexBuffer = false;
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		VkmAllocation indexBufferAllocation;
+		uint32_t indexCount = 0;
 	};
 }
@@ -0,0 +1,133 @@
+#include "vkm_model_registry.h"
+
+// Standard Libraries
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace vkm {
+
+	VkmModelHandle VkmModelRegistry::create(
+		const std::string& name, const std::vector<VkmModel::Vertex>& vertices, const std::vector<uint32_t>& indices) {
+		assert(!name.empty() && "Unnamed models are deduplicated by their geometry");
+		auto it = nameLookup.find(name);
+		if (it != nameLookup.end()) {
+			slots[it->second].references++;
+			return { it->second, slots[it->second].generation };
+		}
+		VkmModelHandle handle = insert(std::make_unique<VkmModel>(vkmDevice, vertices, indices), 0, name);
+		nameLookup.emplace(name, handle.index);
+		return handle;
+	}
+
+	VkmModelHandle VkmModelRegistry::create(const std::vector<VkmModel::Vertex>& vertices, const std::vector<uint32_t>& indices) {
+		const uint64_t hash = hashGeometry(vertices, indices);
+		auto range = hashLookup.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			Slot& slot = slots[it->second];
+			if (sameGeometry(slot, vertices, indices)) {
+				slot.references++;
+				return { it->second, slot.generation };
+			}
+		}
+		VkmModelHandle handle = insert(std::make_unique<VkmModel>(vkmDevice, vertices, indices), hash, {});
+		slots[handle.index].vertices = vertices;
+		slots[handle.index].indices = indices;
+		hashLookup.emplace(hash, handle.index);
+		return handle;
+	}
+
+	VkmModelHandle VkmModelRegistry::find(const std::string& name) const {
+		auto it = nameLookup.find(name);
+		if (it == nameLookup.end()) {
+			return {};
+		}
+		return { it->second, slots[it->second].generation };
+	}
+
+	void VkmModelRegistry::addReference(VkmModelHandle handle) {
+		if (!isAlive(handle)) {
+			throw std::runtime_error("Model handle is stale!");
+		}
+		slots[handle.index].references++;
+	}
+
+	void VkmModelRegistry::release(VkmModelHandle handle) {
+		// A stale handle would otherwise take a reference from whatever model reused the slot
+		if (!isAlive(handle)) {
+			throw std::runtime_error("Model handle is stale!");
+		}
+		Slot& slot = slots[handle.index];
+		assert(slot.references > 0 && "Model released more often than it was referenced");
+		if (--slot.references > 0) {
+			return;
+		}
+
+		if (slot.name.empty()) {
+			auto range = hashLookup.equal_range(slot.hash);
+			for (auto it = range.first; it != range.second; ++it) {
+				if (it->second == handle.index) {
+					hashLookup.erase(it);
+					break;
+				}
+			}
+		} else {
+			nameLookup.erase(slot.name);
+		}
+		// The slot can be reused right away, the bumped generation makes the old handles stale
+		slot.model.reset();
+		slot.generation++;
+		slot.name.clear();
+		slot.vertices = {};
+		slot.indices = {};
+		freeSlots.push_back(handle.index);
+		modelCount--;
+	}
+
+	VkmModelHandle VkmModelRegistry::insert(std::unique_ptr<VkmModel> model, uint64_t hash, const std::string& name) {
+		uint32_t index;
+		if (!freeSlots.empty()) {
+			index = freeSlots.back();
+			freeSlots.pop_back();
+		} else {
+			index = static_cast<uint32_t>(slots.size());
+			slots.emplace_back();
+		}
+
+		Slot& slot = slots[index];
+		slot.model = std::move(model);
+		slot.references = 1;
+		slot.hash = hash;
+		slot.name = name;
+		modelCount++;
+		return { index, slot.generation };
+	}
+
+	// FNV-1a over the raw vertex and index data
+	uint64_t VkmModelRegistry::hashGeometry(const std::vector<VkmModel::Vertex>& vertices, const std::vector<uint32_t>& indices) {
+		uint64_t hash = 14695981039346656037ull;
+		auto mix = [&hash](const void* data, size_t size) {
+			const auto* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; i++) {
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+		};
+		const uint64_t vertexCount = vertices.size();
+		mix(&vertexCount, sizeof(vertexCount));
+		mix(vertices.data(), vertices.size() * sizeof(VkmModel::Vertex));
+		mix(indices.data(), indices.size() * sizeof(uint32_t));
+		return hash;
+	}
+
+	// Byte compare, same as what the hash covers
+	bool VkmModelRegistry::sameGeometry(
+		const Slot& slot, const std::vector<VkmModel::Vertex>& vertices, const std::vector<uint32_t>& indices) {
+		if (slot.vertices.size() != vertices.size() || slot.indices.size() != indices.size()) {
+			return false;
+		}
+		return (vertices.empty() ||
+				memcmp(slot.vertices.data(), vertices.data(), vertices.size() * sizeof(VkmModel::Vertex)) == 0) &&
+			(indices.empty() || memcmp(slot.indices.data(), indices.data(), indices.size() * sizeof(uint32_t)) == 0);
+	}
+
+} // Namespace vkm
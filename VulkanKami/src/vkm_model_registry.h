@@ -0,0 +1,83 @@
+#pragma once
+
+#include "vkm_model.h"
+
+// Standard Library
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vkm {
+
+	// 8 bytes, trivially copyable, no refcount. Stale once the model was destroyed (the generation won't match)
+	struct VkmModelHandle {
+		uint32_t index = UINT32_MAX;
+		uint32_t generation = 0;
+
+		bool isValid() const { return index != UINT32_MAX; }
+		bool operator==(const VkmModelHandle& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const VkmModelHandle& other) const { return !(*this == other); }
+	};
+
+	// Owns every model. Components hold handles into one slot table instead of a shared_ptr each, and loading the
+	// same name or the same geometry twice hands back the first model with one more reference.
+	// When the last reference is released the model is destroyed and its slot reused, the buffers themselves
+	// go through the device's deletion queue so frames in flight can still draw it. Main thread only
+	class VkmModelRegistry {
+	public:
+		explicit VkmModelRegistry(VkmDevice& device) : vkmDevice{ device } {}
+
+		VkmModelRegistry(const VkmModelRegistry &) = delete;
+		VkmModelRegistry &operator=(const VkmModelRegistry &) = delete;
+
+		// Deduplicated by name (there are no model files yet, a path is just a name)
+		VkmModelHandle create(const std::string& name, const std::vector<VkmModel::Vertex>& vertices, const std::vector<uint32_t>& indices = {});
+		// Deduplicated by a hash of the geometry, a hash match is only reused when the data is the same too
+		VkmModelHandle create(const std::vector<VkmModel::Vertex>& vertices, const std::vector<uint32_t>& indices = {});
+		// Invalid handle when nothing by that name is loaded. Doesn't add a reference
+		VkmModelHandle find(const std::string& name) const;
+
+		// Both throw for stale handles
+		void addReference(VkmModelHandle handle);
+		void release(VkmModelHandle handle);
+
+		bool isAlive(VkmModelHandle handle) const {
+			return handle.index < slots.size() && slots[handle.index].generation == handle.generation &&
+				slots[handle.index].model != nullptr;
+		}
+		VkmModel* get(VkmModelHandle handle) const {
+			assert(isAlive(handle) && "Model handle is stale");
+			return slots[handle.index].model.get();
+		}
+
+		uint32_t getModelCount() const { return modelCount; }
+
+	private:
+		struct Slot {
+			std::unique_ptr<VkmModel> model; // VkmModel owns GPU buffers and isn't movable, so only the pointer is inline
+			uint32_t generation = 0;
+			uint32_t references = 0;
+			uint64_t hash = 0; // Of the geometry, 0 for named models
+			std::string name;
+			// Copy of the geometry of unnamed models, what a hash match gets compared against
+			std::vector<VkmModel::Vertex> vertices;
+			std::vector<uint32_t> indices;
+		};
+
+		VkmModelHandle insert(std::unique_ptr<VkmModel> model, uint64_t hash, const std::string& name);
+		static uint64_t hashGeometry(const std::vector<VkmModel::Vertex>& vertices, const std::vector<uint32_t>& indices);
+		static bool sameGeometry(const Slot& slot, const std::vector<VkmModel::Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+		VkmDevice& vkmDevice;
+		uint32_t modelCount = 0;
+
+		std::vector<Slot> slots;
+		std::vector<uint32_t> freeSlots;
+		std::unordered_map<std::string, uint32_t> nameLookup;
+		std::unordered_multimap<uint64_t, uint32_t> hashLookup; // Multi so colliding geometry still dedups
+	};
+
+} // Namespace vkm
@@ -0,0 +1,320 @@
+#include "vkm_offscreen_renderer.h"
+#include "vkm_cpu_profiler.h"
+
+// Standard Libraries
+#include <array>
+#include <stdexcept>
+
+namespace vkm {
+
+	VkmOffscreenRenderer::VkmOffscreenRenderer(VkmDevice &device, VkExtent2D extent) : vkmDevice{ device }, extent{ extent } {
+		depthFormat = vkmDevice.findSupportedFormat(
+			{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+		createRenderPass();
+		createFrames();
+	}
+
+	VkmOffscreenRenderer::~VkmOffscreenRenderer() {
+		waitIdle();
+
+		for (auto& frame : frames) {
+			vkDestroyCommandPool(vkmDevice.device(), frame.commandPool, nullptr);
+			vkDestroyFramebuffer(vkmDevice.device(), frame.framebuffer, nullptr);
+			vkDestroyImageView(vkmDevice.device(), frame.depthView, nullptr);
+			vkmDevice.destroyImage(frame.depthImage, frame.depthAllocation);
+			vkDestroyImageView(vkmDevice.device(), frame.colorView, nullptr);
+			vkmDevice.destroyImage(frame.colorImage, frame.colorAllocation);
+		}
+		vkDestroyRenderPass(vkmDevice.device(), renderPass, nullptr);
+	}
+
+	void VkmOffscreenRenderer::createRenderPass() {
+		VkAttachmentDescription colorAttachment{};
+		colorAttachment.format = COLOR_FORMAT;
+		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// Nobody presents the image, leave it ready to be copied out instead
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+		VkAttachmentDescription depthAttachment{};
+		depthAttachment.format = depthFormat;
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference colorAttachmentRef{};
+		colorAttachmentRef.attachment = 0;
+		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference depthAttachmentRef{};
+		depthAttachmentRef.attachment = 1;
+		depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorAttachmentRef;
+		subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+		std::array<VkSubpassDependency, 2> dependencies{};
+		// Previous use of the image (a readback copy) has to finish before we clear it again
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstStageMask =
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstAccessMask =
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		// And rendering has to finish before anyone copies the result out
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassInfo.pDependencies = dependencies.data();
+
+		if (vkCreateRenderPass(vkmDevice.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create offscreen render pass!");
+		}
+	}
+
+	void VkmOffscreenRenderer::createImage(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+		VkImage &image, VkmAllocation &allocation, VkImageView &view) {
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = extent.width;
+		imageInfo.extent.height = extent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = format;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = usage;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		const VkMemoryPropertyFlags preferred = (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0;
+		vkmDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, allocation, preferred);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = format;
+		viewInfo.subresourceRange.aspectMask = aspect;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(vkmDevice.device(), &viewInfo, nullptr, &view) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create offscreen image view!");
+		}
+	}
+
+	void VkmOffscreenRenderer::createFrames() {
+		frames.resize(MAX_FRAMES_IN_FLIGHT);
+
+		for (size_t i = 0; i < frames.size(); i++) {
+			Frame& frame = frames[i];
+			frame.commandPool = vkmDevice.createCommandPool();
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandPool = frame.commandPool;
+			allocInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(vkmDevice.device(), &allocInfo, &frame.commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to allocate command buffers!");
+			}
+
+			createImage(COLOR_FORMAT,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				frame.colorImage, frame.colorAllocation, frame.colorView);
+			// Depth is never stored, transient lets tiled GPUs keep it on chip
+			createImage(depthFormat,
+				VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+				VK_IMAGE_ASPECT_DEPTH_BIT,
+				frame.depthImage, frame.depthAllocation, frame.depthView);
+
+			std::array<VkImageView, 2> attachments = { frame.colorView, frame.depthView };
+			VkFramebufferCreateInfo framebufferInfo{};
+			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass = renderPass;
+			framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+			framebufferInfo.pAttachments = attachments.data();
+			framebufferInfo.width = extent.width;
+			framebufferInfo.height = extent.height;
+			framebufferInfo.layers = 1;
+			if (vkCreateFramebuffer(vkmDevice.device(), &framebufferInfo, nullptr, &frame.framebuffer) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create offscreen framebuffer!");
+			}
+		}
+	}
+
+	VkCommandBuffer VkmOffscreenRenderer::beginFrame() {
+		VKM_PROFILE_SCOPE("beginFrame");
+		assert(!isFrameStarted && "Can't call beginFrame while already in progress");
+
+		Frame& frame = frames[currentFrameIndex];
+		// The frame that used this slot last
+		const uint64_t frameNumber = vkmDevice.currentFrame();
+		if (frameNumber > static_cast<uint64_t>(MAX_FRAMES_IN_FLIGHT)) {
+			vkmDevice.waitForFrame(frameNumber - MAX_FRAMES_IN_FLIGHT);
+		}
+		vkmDevice.retireCompletedFrames();
+		isFrameStarted = true;
+
+		// Everything recorded from the pool last time around goes back in one call
+		vkResetCommandPool(vkmDevice.device(), frame.commandPool, 0);
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		if (vkBeginCommandBuffer(frame.commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to begin recording command buffer!");
+		}
+
+		gpuProfiler.beginFrame(frame.commandBuffer, currentFrameIndex);
+		frameScope = gpuProfiler.beginScope(frame.commandBuffer, "frame");
+		return frame.commandBuffer;
+	}
+
+	void VkmOffscreenRenderer::endFrame() {
+		VKM_PROFILE_SCOPE("endFrame");
+		assert(isFrameStarted && "Can't call endFrame while frame is not in progress");
+		Frame& frame = frames[currentFrameIndex];
+		gpuProfiler.endScope(frame.commandBuffer, frameScope);
+		if (vkEndCommandBuffer(frame.commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record command buffer!");
+		}
+
+		// Same as VkmRenderer: uploads recorded this frame go first and the submit waits on any that
+		// a model used for the first time
+		vkmDevice.flushUploads();
+		VkmUploadTicket uploadWait = vkmDevice.takePendingUploadWait();
+		VkSemaphore waitSemaphore = vkmDevice.uploadTimelineSemaphore();
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+
+		// Signals the frame's number on the device's frame timeline
+		VkSemaphore signalSemaphore = vkmDevice.frameTimelineSemaphore();
+		uint64_t signalValue = vkmDevice.currentFrame();
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = uploadWait.value > 0 ? 1 : 0;
+		timelineInfo.pWaitSemaphoreValues = &uploadWait.value;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		if (uploadWait.value > 0) {
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores = &waitSemaphore;
+			submitInfo.pWaitDstStageMask = &waitStage;
+		}
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &frame.commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &signalSemaphore;
+
+		{
+			std::lock_guard<std::mutex> queueLock{ vkmDevice.queueMutex() };
+			if (vkQueueSubmit(vkmDevice.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to submit offscreen command buffer!");
+			}
+		}
+		vkmDevice.advanceFrame();
+
+		isFrameStarted = false;
+		currentFrameIndex = (currentFrameIndex + 1) % MAX_FRAMES_IN_FLIGHT;
+	}
+
+	void VkmOffscreenRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+		assert(isFrameStarted && "Can't call beginSwapChainRenderPass if frame is not in progress");
+		assert(
+			commandBuffer == getCurrentCommandBuffer() &&
+			"Can't begin render pass on command buffer from a different frame");
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = renderPass;
+		renderPassInfo.framebuffer = frames[currentFrameIndex].framebuffer;
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = extent;
+
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = { 0.01f, 0.01f, 0.01f, 1.0f };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+		passScope = gpuProfiler.beginScope(commandBuffer, "main pass");
+		passRecordsSecondaries = getSecondaryRecorder() != nullptr;
+		if (passRecordsSecondaries) {
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			secondaryRecorder->beginPass(currentFrameIndex, getRenderTarget(), renderPassInfo.framebuffer, extent);
+			return;
+		}
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(extent.width);
+		viewport.height = static_cast<float>(extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		VkRect2D scissor{ {0, 0}, extent };
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	}
+
+	void VkmOffscreenRenderer::endSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+		assert(isFrameStarted && "Can't call endSwapChainRenderPass if frame is not in progress");
+		assert(
+			commandBuffer == getCurrentCommandBuffer() &&
+			"Can't end render pass on command buffer from a different frame");
+		if (passRecordsSecondaries) {
+			secondaryRecorder->execute(commandBuffer);
+		}
+		vkCmdEndRenderPass(commandBuffer);
+		gpuProfiler.endScope(commandBuffer, passScope);
+	}
+
+	void VkmOffscreenRenderer::setParallelRecording(VkmThreadPool* threadPool) {
+		assert(!isFrameStarted && "Can't switch recording mode in the middle of a frame");
+		parallelRecording = threadPool != nullptr;
+		if (threadPool != nullptr && secondaryRecorder == nullptr) {
+			secondaryRecorder = std::make_unique<VkmSecondaryRecorder>(vkmDevice, *threadPool, MAX_FRAMES_IN_FLIGHT);
+		}
+	}
+
+	void VkmOffscreenRenderer::waitIdle() {
+		vkmDevice.waitForFrame(vkmDevice.currentFrame() - 1);
+		vkmDevice.retireCompletedFrames();
+	}
+
+} // Namespace vkm
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "vkm_device.h"
+#include "vkm_gpu_profiler.h"
+#include "vkm_secondary_recorder.h"
+
+// Standard Library
+#include <cassert>
+#include <memory>
+#include <vector>
+
+namespace vkm {
+
+	// Renders into images the engine owns instead of a swapchain, so it works on a headless VkmDevice.
+	// Has the same frame contract as VkmRenderer (beginFrame -> beginSwapChainRenderPass -> endSwapChainRenderPass
+	// -> endFrame) so render systems don't know the difference
+	class VkmOffscreenRenderer {
+
+	public:
+		static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+		static constexpr VkFormat COLOR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+		VkmOffscreenRenderer(VkmDevice &device, VkExtent2D extent);
+		~VkmOffscreenRenderer();
+
+		VkmOffscreenRenderer(const VkmOffscreenRenderer &) = delete;
+		VkmOffscreenRenderer &operator=(const VkmOffscreenRenderer &) = delete;
+
+		VkRenderPass getSwapChainRenderPass() const { return renderPass; }
+		VkmRenderTarget getRenderTarget() const { return { renderPass, COLOR_FORMAT, depthFormat }; }
+		VkExtent2D getExtent() const { return extent; }
+		float getAspectRatio() const { return static_cast<float>(extent.width) / static_cast<float>(extent.height); }
+		bool isFrameInProgress() const { return isFrameStarted; }
+		VkmGpuProfiler& getGpuProfiler() { return gpuProfiler; }
+
+		VkCommandBuffer getCurrentCommandBuffer() const {
+			assert(isFrameStarted && "Cannot get command buffer when frame not in progress");
+			return frames[currentFrameIndex].commandBuffer;
+		}
+
+		int getFrameIndex() const {
+			assert(isFrameStarted && "Cannot get frame index when frame not in progress");
+			return currentFrameIndex;
+		}
+
+		// The color target a frame rendered into, left in TRANSFER_SRC_OPTIMAL once the frame is done
+		VkImage getColorImage(int frameIndex) const { return frames[frameIndex].colorImage; }
+
+		// Never returns nullptr, there is no swapchain that can go out of date
+		VkCommandBuffer beginFrame();
+		void endFrame();
+		void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+		void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
+
+		// Blocks until every submitted frame has finished on the GPU
+		void waitIdle();
+
+		// Same as VkmRenderer::setParallelRecording
+		void setParallelRecording(VkmThreadPool* threadPool);
+		VkmSecondaryRecorder* getSecondaryRecorder() const { return parallelRecording ? secondaryRecorder.get() : nullptr; }
+
+	private:
+		struct Frame {
+			VkImage colorImage = VK_NULL_HANDLE;
+			VkmAllocation colorAllocation;
+			VkImageView colorView = VK_NULL_HANDLE;
+			VkImage depthImage = VK_NULL_HANDLE;
+			VkmAllocation depthAllocation;
+			VkImageView depthView = VK_NULL_HANDLE;
+			VkFramebuffer framebuffer = VK_NULL_HANDLE;
+			VkCommandPool commandPool = VK_NULL_HANDLE; // Reset as a whole when the slot comes around again
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		};
+
+		void createRenderPass();
+		void createFrames();
+		void createImage(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+			VkImage &image, VkmAllocation &allocation, VkImageView &view);
+
+		VkmDevice& vkmDevice;
+		VkExtent2D extent;
+		VkFormat depthFormat;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		std::vector<Frame> frames;
+		VkmGpuProfiler gpuProfiler{ vkmDevice, MAX_FRAMES_IN_FLIGHT };
+		uint32_t frameScope = UINT32_MAX;
+		uint32_t passScope = UINT32_MAX;
+		std::unique_ptr<VkmSecondaryRecorder> secondaryRecorder;
+		bool parallelRecording = false;
+		bool passRecordsSecondaries = false;
+
+		int currentFrameIndex{ 0 };
+		bool isFrameStarted{ false };
+	};
+} // Namespace vkm
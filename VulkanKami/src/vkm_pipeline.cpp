@@ -1,7 +1,9 @@
 #include "vkm_pipeline.h"
 #include "vkm_model.h"
+#include "vkm_cpu_profiler.h"
 
 // Standard Libraries
+#include <chrono>
 #include <fstream>
 #include <stdexcept>
 #include <iostream>
@@ -20,7 +22,10 @@ namespace vkm {
 	VkmPipeline::~VkmPipeline() {
 		vkDestroyShaderModule(vkmDevice.device(), vertShaderModule, nullptr);
 		vkDestroyShaderModule(vkmDevice.device(), fragShaderModule, nullptr);
-		vkDestroyPipeline(vkmDevice.device(), graphicsPipeline, nullptr);
+		// Can still be bound in a frame in flight
+		vkmDevice.deferDestruction([device = vkmDevice.device(), pipeline = graphicsPipeline]() {
+			vkDestroyPipeline(device, pipeline, nullptr);
+		});
 	}
 
 	std::vector<char> VkmPipeline::readFile(const std::string& filepath) {
@@ -46,13 +51,15 @@ namespace vkm {
 		const std::string& vertFilepath,
 		const std::string& fragFilepath,
 		const PipelineConfigInfo& configInfo) {
+		VKM_PROFILE_SCOPE("createGraphicsPipeline");
 
 		assert(
 			configInfo.pipelineLayout != VK_NULL_HANDLE &&
 			"Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
 		assert(
-			configInfo.renderPass != VK_NULL_HANDLE &&
-			"Cannot create graphics pipeline: no renderPass provided in configInfo");
+			(configInfo.renderPass != VK_NULL_HANDLE || !configInfo.colorAttachmentFormats.empty() ||
+				configInfo.depthAttachmentFormat != VK_FORMAT_UNDEFINED) &&
+			"Cannot create graphics pipeline: no renderPass or attachment formats provided in configInfo");
 
 		auto vertCode = readFile(vertFilepath);
 		auto fragCode = readFile(fragFilepath);
@@ -77,8 +84,8 @@ namespace vkm {
 		shaderStages[1].pNext = nullptr;
 		shaderStages[1].pSpecializationInfo = nullptr;
 
-		auto bindingDescriptions = VkmModel::Vertex::getBindingDescriptions();
-		auto attributeDescriptions = VkmModel::Vertex::getAttributeDescriptions();
+		auto& bindingDescriptions = configInfo.bindingDescriptions;
+		auto& attributeDescriptions = configInfo.attributeDescriptions;
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());;
@@ -96,6 +103,7 @@ namespace vkm {
 
 		VkGraphicsPipelineCreateInfo pipelineInfo{};
 		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.flags = configInfo.createFlags;
 		pipelineInfo.stageCount = 2;
 		pipelineInfo.pStages = shaderStages;
 		pipelineInfo.pVertexInputState = &vertexInputInfo;
@@ -111,15 +119,31 @@ namespace vkm {
 		pipelineInfo.renderPass = configInfo.renderPass;
 		pipelineInfo.subpass = configInfo.subpass;
 
+		// Dynamic rendering: compatible with any pass that uses the same formats, no render pass object needed
+		VkPipelineRenderingCreateInfo renderingInfo{};
+		renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+		renderingInfo.colorAttachmentCount = static_cast<uint32_t>(configInfo.colorAttachmentFormats.size());
+		renderingInfo.pColorAttachmentFormats = configInfo.colorAttachmentFormats.data();
+		renderingInfo.depthAttachmentFormat = configInfo.depthAttachmentFormat;
+		renderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+		if (configInfo.renderPass == VK_NULL_HANDLE) {
+			pipelineInfo.pNext = &renderingInfo;
+		}
+
 		// Performance
 		pipelineInfo.basePipelineIndex = -1;
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
+		// Going through the device's pipeline cache means a warm start skips the driver's shader compile
+		auto createStart = std::chrono::high_resolution_clock::now();
 		if (vkCreateGraphicsPipelines(
-			vkmDevice.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline)
+			vkmDevice.device(), vkmDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &graphicsPipeline)
 			!= VK_SUCCESS) {
 		throw std::runtime_error("Failed to create graphics pipeline");
 		}
+		auto createEnd = std::chrono::high_resolution_clock::now();
+		vkmDevice.recordPipelineCreation(
+			std::chrono::duration<double, std::milli>(createEnd - createStart).count());
 	}
 
 	void VkmPipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule) {
@@ -216,7 +240,68 @@ namespace vkm {
 		configInfo.dynamicStateInfo.dynamicStateCount =
 			static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
 		configInfo.dynamicStateInfo.flags = 0;
+
+		configInfo.bindingDescriptions = VkmModel::Vertex::getBindingDescriptions();
+		configInfo.attributeDescriptions = VkmModel::Vertex::getAttributeDescriptions();
+	}
+
+	void VkmPipeline::setRenderTarget(PipelineConfigInfo& configInfo, const VkmRenderTarget& target) {
+		configInfo.renderPass = target.renderPass;
+		configInfo.colorAttachmentFormats.clear();
+		configInfo.depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+		if (target.renderPass == VK_NULL_HANDLE) {
+			if (target.colorAttachmentCount > 0) {
+				configInfo.colorAttachmentFormats.push_back(target.colorFormat);
+			}
+			configInfo.colorBlendInfo.attachmentCount = static_cast<uint32_t>(configInfo.colorAttachmentFormats.size());
+			configInfo.depthAttachmentFormat = target.depthFormat;
+		}
 	}
 
+	VkmComputePipeline::VkmComputePipeline(VkmDevice& device, const std::string& compFilepath, VkPipelineLayout pipelineLayout)
+		: vkmDevice{ device } {
+		VKM_PROFILE_SCOPE("createComputePipeline");
+		assert(pipelineLayout != VK_NULL_HANDLE && "Cannot create compute pipeline: no pipelineLayout provided");
+
+		auto compCode = VkmPipeline::readFile(compFilepath);
+		VkShaderModuleCreateInfo moduleInfo{};
+		moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		moduleInfo.codeSize = compCode.size();
+		moduleInfo.pCode = reinterpret_cast<const uint32_t*>(compCode.data());
+		if (vkCreateShaderModule(vkmDevice.device(), &moduleInfo, nullptr, &compShaderModule) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create shader module");
+		}
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = compShaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = pipelineLayout;
+		pipelineInfo.basePipelineIndex = -1;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+		auto createStart = std::chrono::high_resolution_clock::now();
+		if (vkCreateComputePipelines(
+			vkmDevice.device(), vkmDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &computePipeline)
+			!= VK_SUCCESS) {
+			throw std::runtime_error("Failed to create compute pipeline");
+		}
+		auto createEnd = std::chrono::high_resolution_clock::now();
+		vkmDevice.recordPipelineCreation(
+			std::chrono::duration<double, std::milli>(createEnd - createStart).count());
+	}
+
+	VkmComputePipeline::~VkmComputePipeline() {
+		vkDestroyShaderModule(vkmDevice.device(), compShaderModule, nullptr);
+		vkmDevice.deferDestruction([device = vkmDevice.device(), pipeline = computePipeline]() {
+			vkDestroyPipeline(device, pipeline, nullptr);
+		});
+	}
+
+	void VkmComputePipeline::bind(VkCommandBuffer commandBuffer) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+	}
 
-} // Namespace vkm
\ No newline at end of file
+} // Namespace vkm
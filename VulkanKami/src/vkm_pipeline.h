@@ -6,11 +6,22 @@
 
 namespace vkm {
 
+	// What a graphics pipeline draws into. Either a render pass, or with dynamic rendering (renderPass null) just
+	// the attachment formats, which stay the same when the swap chain is recreated
+	struct VkmRenderTarget {
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+		VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+		uint32_t colorAttachmentCount = 1; // Dynamic rendering only, 0 for depth only passes (colorFormat unused)
+	};
+
 	struct PipelineConfigInfo {
 		PipelineConfigInfo() = default;
 		PipelineConfigInfo(const PipelineConfigInfo&) = delete;
 		PipelineConfigInfo& operator=(const PipelineConfigInfo&) = delete;
 
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
 		VkPipelineViewportStateCreateInfo viewportInfo;
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
 		VkPipelineRasterizationStateCreateInfo rasterizationInfo;
@@ -23,6 +34,10 @@ namespace vkm {
 		VkPipelineLayout pipelineLayout = nullptr;
 		VkRenderPass renderPass = nullptr;
 		uint32_t subpass = 0;
+		// Only used without a renderPass (dynamic rendering)
+		std::vector<VkFormat> colorAttachmentFormats{};
+		VkFormat depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+		VkPipelineCreateFlags createFlags = 0;
 	};
 
 	class VkmPipeline {
@@ -41,10 +56,11 @@ namespace vkm {
 		void bind(VkCommandBuffer commandBuffer);
 
 		static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
+		static void setRenderTarget(PipelineConfigInfo& configInfo, const VkmRenderTarget& target);
 
+		static std::vector<char> readFile(const std::string& filepath);
 
 	private:
-		static std::vector<char> readFile(const std::string& filepath);
 
 		void createGraphicsPipeline(
 			const std::string& vertFilepath, 
@@ -61,4 +77,20 @@ namespace vkm {
 		VkShaderModule fragShaderModule;
 	};
 
+	class VkmComputePipeline {
+	public:
+		VkmComputePipeline(VkmDevice& device, const std::string& compFilepath, VkPipelineLayout pipelineLayout);
+		~VkmComputePipeline();
+
+		VkmComputePipeline(const VkmComputePipeline&) = delete;
+		VkmComputePipeline& operator=(const VkmComputePipeline&) = delete;
+
+		void bind(VkCommandBuffer commandBuffer);
+
+	private:
+		VkmDevice& vkmDevice;
+		VkPipeline computePipeline;
+		VkShaderModule compShaderModule;
+	};
+
 } // Namespace vkm
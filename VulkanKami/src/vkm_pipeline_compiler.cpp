@@ -0,0 +1,67 @@
+#include "vkm_pipeline_compiler.h"
+
+// Standard Libraries
+#include <chrono>
+#include <stdexcept>
+
+namespace vkm {
+
+	VkmPendingPipeline::~VkmPendingPipeline() {
+		reset();
+	}
+
+	VkmPendingPipeline& VkmPendingPipeline::operator=(VkmPendingPipeline&& other) {
+		if (this != &other) {
+			reset();
+			future = std::move(other.future);
+			pipeline = std::move(other.pipeline);
+		}
+		return *this;
+	}
+
+	void VkmPendingPipeline::reset() {
+		// The worker still references the device and the layout, so a build can't be abandoned half way
+		if (future.valid()) {
+			future.wait();
+			future = {};
+		}
+		pipeline.reset();
+	}
+
+	VkmPipeline* VkmPendingPipeline::get() {
+		if (!pipeline && future.valid() &&
+			future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			pipeline = future.get();
+		}
+		return pipeline.get();
+	}
+
+	VkmPipeline& VkmPendingPipeline::wait() {
+		if (!pipeline) {
+			if (!future.valid()) {
+				throw std::runtime_error("Waiting on a pipeline that was never enqueued!");
+			}
+			pipeline = future.get();
+		}
+		return *pipeline;
+	}
+
+	VkmPendingPipeline VkmPipelineCompiler::enqueue(
+		const std::string& vertFilepath,
+		const std::string& fragFilepath,
+		std::unique_ptr<PipelineConfigInfo> configInfo) {
+		pending++;
+
+		// unique_ptr can't go into a copyable lambda, the shared_ptr only lives as long as the job
+		std::shared_ptr<PipelineConfigInfo> config = std::move(configInfo);
+		return VkmPendingPipeline{ threadPool.submit([this, vertFilepath, fragFilepath, config]() {
+			struct PendingGuard {
+				std::atomic<uint32_t>& count;
+				~PendingGuard() { count--; }
+			} guard{ pending };
+
+			return std::make_unique<VkmPipeline>(vkmDevice, vertFilepath, fragFilepath, *config);
+		}) };
+	}
+
+} // Namespace vkm
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "vkm_pipeline.h"
+#include "vkm_thread_pool.h"
+
+// Standard Library
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+
+namespace vkm {
+
+	// A pipeline being built on a worker thread. Owned by whoever asked for it,
+	// get() returns nullptr until the build is done so callers can keep drawing with a fallback
+	class VkmPendingPipeline {
+	public:
+		VkmPendingPipeline() = default;
+		explicit VkmPendingPipeline(std::future<std::unique_ptr<VkmPipeline>> future) : future{ std::move(future) } {}
+		~VkmPendingPipeline();
+
+		VkmPendingPipeline(VkmPendingPipeline &&) = default;
+		// Waits for the build being replaced, same as the destructor
+		VkmPendingPipeline &operator=(VkmPendingPipeline &&other);
+		VkmPendingPipeline(const VkmPendingPipeline &) = delete;
+		VkmPendingPipeline &operator=(const VkmPendingPipeline &) = delete;
+
+		// Non blocking, rethrows if the build failed (missing shader etc)
+		VkmPipeline* get();
+		bool isReady() { return get() != nullptr; }
+		// Blocks until the build is finished
+		VkmPipeline& wait();
+		// Waits for a build still running and destroys the pipeline. Has to happen before anything the build
+		// uses (the pipeline layout) is destroyed
+		void reset();
+
+	private:
+		std::future<std::unique_ptr<VkmPipeline>> future;
+		std::unique_ptr<VkmPipeline> pipeline;
+	};
+
+	// Hands VkmPipeline builds (shader reads, module creation, vkCreateGraphicsPipelines) to the thread pool.
+	// All builds go through the device's pipeline cache, which the driver synchronizes internally.
+	// Has to outlive every VkmPendingPipeline it hands out
+	class VkmPipelineCompiler {
+	public:
+		VkmPipelineCompiler(VkmDevice& device, VkmThreadPool& threadPool) : vkmDevice{ device }, threadPool{ threadPool } {}
+
+		VkmPipelineCompiler(const VkmPipelineCompiler &) = delete;
+		VkmPipelineCompiler &operator=(const VkmPipelineCompiler &) = delete;
+
+		// configInfo is owned by the job because it points into itself (blend attachment, dynamic states)
+		// and has to stay put until the worker is done with it
+		VkmPendingPipeline enqueue(
+			const std::string& vertFilepath,
+			const std::string& fragFilepath,
+			std::unique_ptr<PipelineConfigInfo> configInfo);
+
+		uint32_t pendingCount() const { return pending.load(); }
+
+	private:
+		VkmDevice& vkmDevice;
+		VkmThreadPool& threadPool;
+		std::atomic<uint32_t> pending{ 0 };
+	};
+
+} // Namespace vkm
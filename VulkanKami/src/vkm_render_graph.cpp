@@ -0,0 +1,775 @@
+#include "vkm_render_graph.h"
+
+// Standard Library
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace vkm {
+
+	namespace {
+		const char* layoutName(VkImageLayout layout) {
+			switch (layout) {
+			case VK_IMAGE_LAYOUT_UNDEFINED: return "UNDEFINED";
+			case VK_IMAGE_LAYOUT_GENERAL: return "GENERAL";
+			case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "COLOR_ATTACHMENT";
+			case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: return "DEPTH_STENCIL_ATTACHMENT";
+			case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL: return "DEPTH_STENCIL_READ_ONLY";
+			case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "SHADER_READ_ONLY";
+			case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "TRANSFER_SRC";
+			case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "TRANSFER_DST";
+			case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "PRESENT_SRC";
+			default: return "other";
+			}
+		}
+
+		bool overlaps(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB) {
+			return !(lastA < firstB || lastB < firstA);
+		}
+	}
+
+	VkImage VkmRenderGraph::PassContext::image(Resource resource) const {
+		const ResourceNode& node = graph.resources[resource];
+		return node.images[node.imported ? 0 : frameSlot];
+	}
+
+	VkImageView VkmRenderGraph::PassContext::imageView(Resource resource) const {
+		const ResourceNode& node = graph.resources[resource];
+		return node.views[node.imported ? 0 : frameSlot];
+	}
+
+	void VkmRenderGraph::PassBuilder::writeColor(Resource resource, std::optional<VkClearColorValue> clear) {
+		std::optional<VkClearValue> clearValue;
+		if (clear) {
+			clearValue.emplace();
+			clearValue->color = *clear;
+		}
+		use(resource, Usage::ColorAttachment, true, clearValue);
+	}
+
+	void VkmRenderGraph::PassBuilder::writeDepth(Resource resource, std::optional<VkClearDepthStencilValue> clear) {
+		std::optional<VkClearValue> clearValue;
+		if (clear) {
+			clearValue.emplace();
+			clearValue->depthStencil = *clear;
+		}
+		use(resource, Usage::DepthAttachment, true, clearValue);
+	}
+
+	void VkmRenderGraph::PassBuilder::read(Resource resource, Usage usage) {
+		if (usage == Usage::ColorAttachment || usage == Usage::TransferDst) {
+			throw std::runtime_error(std::string("Render graph: can't read an image as ") + usageName(usage));
+		}
+		use(resource, usage, false, std::nullopt);
+	}
+
+	void VkmRenderGraph::PassBuilder::write(Resource resource, Usage usage) {
+		if (usage == Usage::SampledFragment || usage == Usage::SampledCompute || usage == Usage::TransferSrc) {
+			throw std::runtime_error(std::string("Render graph: can't write an image as ") + usageName(usage));
+		}
+		use(resource, usage, true, std::nullopt);
+	}
+
+	void VkmRenderGraph::PassBuilder::allowSecondaries() {
+		graph.passes[pass].secondaries = true;
+	}
+
+	void VkmRenderGraph::PassBuilder::sideEffects() {
+		graph.passes[pass].sideEffects = true;
+	}
+
+	void VkmRenderGraph::PassBuilder::use(Resource resource, Usage usage, bool write, std::optional<VkClearValue> clear) {
+		assert(resource < graph.resources.size() && "Unknown render graph resource");
+		PassNode& node = graph.passes[pass];
+		ResourceNode& target = graph.resources[resource];
+
+		for (const Access& access : node.accesses) {
+			if (access.resource == resource) {
+				throw std::runtime_error("Render graph: pass " + node.name + " uses " + target.name + " more than once");
+			}
+			if (usage == Usage::DepthAttachment && access.usage == Usage::DepthAttachment) {
+				throw std::runtime_error("Render graph: pass " + node.name + " has more than one depth attachment");
+			}
+			// VkmRenderTarget, which the pass' pipelines and secondaries are built against, has one color format
+			if (usage == Usage::ColorAttachment && access.usage == Usage::ColorAttachment) {
+				throw std::runtime_error("Render graph: pass " + node.name + " has more than one color attachment");
+			}
+		}
+		// Anything that isn't a clear sees the old contents, and a transient only has contents once a pass wrote them
+		if (!clear && !target.imported && !target.written) {
+			throw std::runtime_error("Render graph: pass " + node.name + " reads " + target.name + " before any pass wrote it");
+		}
+
+		node.accesses.push_back({ resource, usage, write, clear });
+		target.written = target.written || write;
+	}
+
+	VkmRenderGraph::VkmRenderGraph(VkmDevice& device, VkExtent2D extent, uint32_t frameSlotCount)
+		: device{ device }, extent{ extent }, frameSlotCount{ frameSlotCount } {
+		assert(frameSlotCount > 0 && "Render graph needs at least one frame slot");
+	}
+
+	VkmRenderGraph::~VkmRenderGraph() {
+		releaseTransients();
+	}
+
+	VkmRenderGraph::Resource VkmRenderGraph::createImage(const std::string& name, const ImageDesc& desc) {
+		ResourceNode node{};
+		node.name = name;
+		node.format = desc.format;
+		node.desc = desc;
+		resources.push_back(std::move(node));
+		compiled = false;
+		return static_cast<Resource>(resources.size() - 1);
+	}
+
+	VkmRenderGraph::Resource VkmRenderGraph::importImage(const std::string& name, const ImportDesc& desc) {
+		ResourceNode node{};
+		node.name = name;
+		node.imported = true;
+		node.format = desc.format;
+		node.importDesc = desc;
+		node.images.resize(1, VK_NULL_HANDLE);
+		node.views.resize(1, VK_NULL_HANDLE);
+		resources.push_back(std::move(node));
+		compiled = false;
+		return static_cast<Resource>(resources.size() - 1);
+	}
+
+	void VkmRenderGraph::setImportedImage(Resource resource, VkImage image, VkImageView view) {
+		assert(resources[resource].imported && "Only imported images can be set");
+		resources[resource].images[0] = image;
+		resources[resource].views[0] = view;
+	}
+
+	void VkmRenderGraph::addPass(
+		const std::string& name,
+		const std::function<void(PassBuilder&)>& setup,
+		std::function<void(const PassContext&)> execute) {
+		passes.emplace_back();
+		passes.back().name = name;
+		passes.back().execute = std::move(execute);
+
+		PassBuilder builder{ *this, static_cast<uint32_t>(passes.size() - 1) };
+		setup(builder);
+		compiled = false;
+	}
+
+	void VkmRenderGraph::setExtent(VkExtent2D newExtent) {
+		if (newExtent.width != extent.width || newExtent.height != extent.height) {
+			extent = newExtent;
+			compiled = false;
+		}
+	}
+
+	void VkmRenderGraph::setFrameSlotCount(uint32_t count) {
+		assert(count > 0 && "Render graph needs at least one frame slot");
+		if (count != frameSlotCount) {
+			frameSlotCount = count;
+			compiled = false;
+		}
+	}
+
+	VkmRenderGraph::State VkmRenderGraph::stateFor(Usage usage, bool write) {
+		switch (usage) {
+		case Usage::ColorAttachment:
+			return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT };
+		case Usage::DepthAttachment:
+			if (write) {
+				return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+					VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+			}
+			return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, 0 };
+		case Usage::SampledFragment:
+			return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0 };
+		case Usage::SampledCompute:
+			return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0 };
+		case Usage::Storage:
+			// Storage images are a compute thing here
+			if (write) {
+				return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT };
+			}
+			return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0 };
+		case Usage::TransferSrc:
+			return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0 };
+		case Usage::TransferDst:
+			return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT };
+		}
+		return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0 };
+	}
+
+	VkImageUsageFlags VkmRenderGraph::imageUsageFor(Usage usage) {
+		switch (usage) {
+		case Usage::ColorAttachment: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		case Usage::DepthAttachment: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		case Usage::SampledFragment:
+		case Usage::SampledCompute: return VK_IMAGE_USAGE_SAMPLED_BIT;
+		case Usage::Storage: return VK_IMAGE_USAGE_STORAGE_BIT;
+		case Usage::TransferSrc: return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		case Usage::TransferDst: return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		}
+		return 0;
+	}
+
+	const char* VkmRenderGraph::usageName(Usage usage) {
+		switch (usage) {
+		case Usage::ColorAttachment: return "color attachment";
+		case Usage::DepthAttachment: return "depth attachment";
+		case Usage::SampledFragment: return "sampled (fragment)";
+		case Usage::SampledCompute: return "sampled (compute)";
+		case Usage::Storage: return "storage";
+		case Usage::TransferSrc: return "transfer source";
+		case Usage::TransferDst: return "transfer destination";
+		}
+		return "unknown";
+	}
+
+	VkImageAspectFlags VkmRenderGraph::aspectFor(VkFormat format, bool view) {
+		switch (format) {
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT;
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			// Views only ever get used as depth, but barriers have to cover both aspects
+			return view ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		default:
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+		}
+	}
+
+	VkExtent2D VkmRenderGraph::extentOf(const ResourceNode& resource) const {
+		if (resource.imported || resource.desc.extent.width == 0 || resource.desc.extent.height == 0) {
+			return extent;
+		}
+		return resource.desc.extent;
+	}
+
+	void VkmRenderGraph::compile() {
+		releaseTransients();
+		cull();
+		createTransients();
+		aliasTransients();
+		buildBarriers();
+		compiled = true;
+	}
+
+	void VkmRenderGraph::releaseTransients() {
+		std::vector<VkImage> images;
+		std::vector<VkImageView> views;
+		std::vector<VkmAllocation> allocations;
+		for (ResourceNode& resource : resources) {
+			if (resource.imported) {
+				continue;
+			}
+			images.insert(images.end(), resource.images.begin(), resource.images.end());
+			views.insert(views.end(), resource.views.begin(), resource.views.end());
+			resource.images.clear();
+			resource.views.clear();
+		}
+		for (Memory& memory : memories) {
+			allocations.insert(allocations.end(), memory.allocations.begin(), memory.allocations.end());
+		}
+		memories.clear();
+
+		if (images.empty() && allocations.empty()) {
+			return;
+		}
+		// Frames recorded with the old images might still be in flight
+		VkmDevice* vkmDevice = &device;
+		device.deferDestruction([vkmDevice, images, views, allocations]() mutable {
+			for (VkImageView view : views) {
+				vkDestroyImageView(vkmDevice->device(), view, nullptr);
+			}
+			for (VkImage image : images) {
+				vkDestroyImage(vkmDevice->device(), image, nullptr);
+			}
+			for (VkmAllocation& allocation : allocations) {
+				vkmDevice->freeMemory(allocation);
+			}
+		});
+	}
+
+	void VkmRenderGraph::cull() {
+		// Walk back from the outputs: a pass is kept when something kept later needs what it writes.
+		// A clear overwrites everything, passes before it writing the same image only matter if something in between read it
+		std::vector<bool> needed(resources.size(), false);
+		for (size_t i = 0; i < resources.size(); i++) {
+			needed[i] = resources[i].imported && resources[i].importDesc.output;
+		}
+		for (size_t i = passes.size(); i-- > 0;) {
+			PassNode& pass = passes[i];
+			bool live = pass.sideEffects;
+			for (const Access& access : pass.accesses) {
+				live = live || (access.write && needed[access.resource]);
+			}
+			pass.culled = !live;
+			if (!live) {
+				continue;
+			}
+			for (const Access& access : pass.accesses) {
+				if (access.write && access.clear) {
+					needed[access.resource] = false;
+				}
+			}
+			for (const Access& access : pass.accesses) {
+				if (!access.write || !access.clear) {
+					needed[access.resource] = true;
+				}
+			}
+		}
+
+		order.clear();
+		stats = {};
+		for (uint32_t i = 0; i < passes.size(); i++) {
+			if (!passes[i].culled) {
+				order.push_back(i);
+			}
+		}
+		stats.passCount = static_cast<uint32_t>(passes.size());
+		stats.culledPassCount = static_cast<uint32_t>(passes.size() - order.size());
+
+		// Attachments nothing looks at again don't have to be written back to memory
+		for (size_t k = 0; k < order.size(); k++) {
+			for (Access& access : passes[order[k]].accesses) {
+				if (resources[access.resource].imported) {
+					access.store = true;
+					continue;
+				}
+				access.store = false;
+				for (size_t later = k + 1; later < order.size(); later++) {
+					auto next = std::find_if(passes[order[later]].accesses.begin(), passes[order[later]].accesses.end(),
+						[&](const Access& other) { return other.resource == access.resource; });
+					if (next != passes[order[later]].accesses.end()) {
+						access.store = !(next->write && next->clear);
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	void VkmRenderGraph::createTransients() {
+		for (ResourceNode& resource : resources) {
+			resource.usage = 0;
+			resource.firstPass = UINT32_MAX;
+			resource.lastPass = 0;
+			resource.memory = UINT32_MAX;
+			resource.requirements = {};
+		}
+		for (uint32_t k = 0; k < order.size(); k++) {
+			for (const Access& access : passes[order[k]].accesses) {
+				ResourceNode& resource = resources[access.resource];
+				resource.usage |= imageUsageFor(access.usage);
+				resource.firstPass = std::min(resource.firstPass, k);
+				resource.lastPass = std::max(resource.lastPass, k);
+			}
+		}
+
+		for (ResourceNode& resource : resources) {
+			if (resource.imported || resource.firstPass == UINT32_MAX) {
+				continue; // Only used by culled passes
+			}
+			const VkExtent2D imageExtent = extentOf(resource);
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.extent.width = imageExtent.width;
+			imageInfo.extent.height = imageExtent.height;
+			imageInfo.extent.depth = 1;
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.format = resource.format;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageInfo.usage = resource.usage;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			resource.images.resize(frameSlotCount, VK_NULL_HANDLE);
+			for (VkImage& image : resource.images) {
+				if (vkCreateImage(device.device(), &imageInfo, nullptr, &image) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to create render graph image " + resource.name + "!");
+				}
+			}
+			vkGetImageMemoryRequirements(device.device(), resource.images[0], &resource.requirements);
+			stats.transientImageCount++;
+			stats.transientBytes += resource.requirements.size;
+		}
+	}
+
+	void VkmRenderGraph::aliasTransients() {
+		// Biggest first, each goes into the first memory whose images are all dead before it starts or born after it ends
+		std::vector<Resource> transients;
+		for (Resource i = 0; i < resources.size(); i++) {
+			if (!resources[i].images.empty() && !resources[i].imported) {
+				transients.push_back(i);
+			}
+		}
+		std::stable_sort(transients.begin(), transients.end(), [&](Resource a, Resource b) {
+			return resources[a].requirements.size > resources[b].requirements.size;
+		});
+
+		for (Resource index : transients) {
+			ResourceNode& resource = resources[index];
+			for (uint32_t m = 0; m < memories.size() && resource.memory == UINT32_MAX; m++) {
+				Memory& memory = memories[m];
+				if ((memory.requirements.memoryTypeBits & resource.requirements.memoryTypeBits) == 0) {
+					continue;
+				}
+				bool fits = std::none_of(memory.resources.begin(), memory.resources.end(), [&](Resource other) {
+					return overlaps(resource.firstPass, resource.lastPass, resources[other].firstPass, resources[other].lastPass);
+				});
+				if (fits) {
+					memory.requirements.size = std::max(memory.requirements.size, resource.requirements.size);
+					memory.requirements.alignment = std::max(memory.requirements.alignment, resource.requirements.alignment);
+					memory.requirements.memoryTypeBits &= resource.requirements.memoryTypeBits;
+					memory.resources.push_back(index);
+					resource.memory = m;
+				}
+			}
+			if (resource.memory == UINT32_MAX) {
+				resource.memory = static_cast<uint32_t>(memories.size());
+				memories.push_back({ resource.requirements, { index }, {} });
+			}
+		}
+
+		for (Memory& memory : memories) {
+			std::sort(memory.resources.begin(), memory.resources.end(), [&](Resource a, Resource b) {
+				return resources[a].firstPass < resources[b].firstPass;
+			});
+			memory.allocations.resize(frameSlotCount);
+			for (uint32_t slot = 0; slot < frameSlotCount; slot++) {
+				memory.allocations[slot] = device.allocateImageMemory(memory.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+				for (Resource index : memory.resources) {
+					if (vkBindImageMemory(device.device(), resources[index].images[slot],
+						memory.allocations[slot].memory, memory.allocations[slot].offset) != VK_SUCCESS) {
+						throw std::runtime_error("Failed to bind render graph image memory!");
+					}
+				}
+			}
+			stats.aliasedBytes += memory.requirements.size;
+		}
+
+		for (Resource index : transients) {
+			ResourceNode& resource = resources[index];
+			resource.views.resize(frameSlotCount, VK_NULL_HANDLE);
+			for (uint32_t slot = 0; slot < frameSlotCount; slot++) {
+				VkImageViewCreateInfo viewInfo{};
+				viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+				viewInfo.image = resource.images[slot];
+				viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+				viewInfo.format = resource.format;
+				viewInfo.subresourceRange = { aspectFor(resource.format, true), 0, 1, 0, 1 };
+				if (vkCreateImageView(device.device(), &viewInfo, nullptr, &resource.views[slot]) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to create render graph image view " + resource.name + "!");
+				}
+			}
+		}
+	}
+
+	void VkmRenderGraph::buildBarriers() {
+		std::vector<Sync> syncs(resources.size());
+		std::vector<bool> used(resources.size(), false);
+		for (size_t i = 0; i < resources.size(); i++) {
+			const ResourceNode& resource = resources[i];
+			if (resource.imported) {
+				const ImportDesc& desc = resource.importDesc;
+				syncs[i] = { desc.initialLayout, desc.initialStages, desc.initialAccess, 0, 0, 0 };
+			} else {
+				syncs[i] = { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, 0, 0 };
+			}
+		}
+
+		for (uint32_t k = 0; k < order.size(); k++) {
+			PassNode& pass = passes[order[k]];
+			pass.barriers.clear();
+			pass.barrierResources.clear();
+			pass.srcStages = 0;
+			pass.dstStages = 0;
+
+			for (const Access& access : pass.accesses) {
+				const ResourceNode& resource = resources[access.resource];
+				Sync& sync = syncs[access.resource];
+				const State next = stateFor(access.usage, access.write);
+
+				// Only the very first access, PassBuilder already rejects a pass using one resource twice
+				const bool firstUse = !resource.imported && !used[access.resource];
+				used[access.resource] = true;
+				if (firstUse) {
+					// Aliased memory: whatever had it last has to be done with it
+					const Memory& memory = memories[resource.memory];
+					auto it = std::find(memory.resources.begin(), memory.resources.end(), access.resource);
+					if (it != memory.resources.begin()) {
+						const Sync& previous = syncs[*(it - 1)];
+						sync.writeStages = previous.writeStages | previous.readStages;
+						sync.writeAccess = previous.writeAccess;
+					}
+				}
+
+				// A read only needs nothing when an earlier barrier already made the last write visible to its stages
+				const bool sameLayoutRead = sync.layout == next.layout && !access.write && !firstUse;
+				if (sameLayoutRead &&
+					(next.stages & ~sync.visibleStages) == 0 && (next.access & ~sync.visibleAccess) == 0) {
+					sync.readStages |= next.stages;
+					continue;
+				}
+
+				VkImageMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.srcAccessMask = sync.writeAccess;
+				barrier.dstAccessMask = next.access;
+				// Cleared or never written this frame, the old contents can go
+				barrier.oldLayout = (firstUse || access.clear) ? VK_IMAGE_LAYOUT_UNDEFINED : sync.layout;
+				barrier.newLayout = next.layout;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.subresourceRange = { aspectFor(resource.format, false), 0, 1, 0, 1 };
+				pass.barriers.push_back(barrier);
+				pass.barrierResources.push_back(access.resource);
+				// The reads too: a write or layout change has to wait for them, and another read chains after
+				// the barriers they waited on
+				pass.srcStages |= sync.writeStages | sync.readStages;
+				pass.dstStages |= next.stages;
+
+				if (access.write) {
+					sync = { next.layout, next.stages, next.writeAccess, 0, 0, 0 };
+				} else if (sameLayoutRead) {
+					sync.readStages |= next.stages;
+					sync.visibleStages |= next.stages;
+					sync.visibleAccess |= next.access;
+				} else {
+					sync.layout = next.layout;
+					sync.readStages = next.stages;
+					sync.visibleStages = next.stages;
+					sync.visibleAccess = next.access;
+				}
+			}
+			stats.barrierCount += static_cast<uint32_t>(pass.barriers.size());
+		}
+
+		finalBarriers.clear();
+		finalBarrierResources.clear();
+		finalSrcStages = 0;
+		for (Resource i = 0; i < resources.size(); i++) {
+			const ResourceNode& resource = resources[i];
+			if (!resource.imported || resource.firstPass == UINT32_MAX ||
+				resource.importDesc.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED ||
+				resource.importDesc.finalLayout == syncs[i].layout) {
+				continue;
+			}
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = syncs[i].writeAccess;
+			barrier.dstAccessMask = 0;
+			barrier.oldLayout = syncs[i].layout;
+			barrier.newLayout = resource.importDesc.finalLayout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.subresourceRange = { aspectFor(resource.format, false), 0, 1, 0, 1 };
+			finalBarriers.push_back(barrier);
+			finalBarrierResources.push_back(i);
+			finalSrcStages |= syncs[i].writeStages | syncs[i].readStages;
+		}
+		stats.barrierCount += static_cast<uint32_t>(finalBarriers.size());
+	}
+
+	void VkmRenderGraph::recordBarriers(VkCommandBuffer commandBuffer, std::vector<VkImageMemoryBarrier>& barriers,
+		const std::vector<Resource>& barrierResources, VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages,
+		uint32_t frameSlot) {
+		if (barriers.empty()) {
+			return;
+		}
+		for (size_t i = 0; i < barriers.size(); i++) {
+			const ResourceNode& resource = resources[barrierResources[i]];
+			barriers[i].image = resource.images[resource.imported ? 0 : frameSlot];
+			assert(barriers[i].image != VK_NULL_HANDLE && "Imported render graph image wasn't set this frame");
+		}
+		vkCmdPipelineBarrier(commandBuffer,
+			srcStages ? srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT), dstStages,
+			0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+	}
+
+	void VkmRenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t frameSlot) {
+		if (!compiled) {
+			compile();
+		}
+		assert(frameSlot < frameSlotCount && "Frame slot out of range for the render graph");
+
+		std::vector<VkRenderingAttachmentInfo> colorAttachments;
+		for (uint32_t k = 0; k < order.size(); k++) {
+			PassNode& pass = passes[order[k]];
+			const uint32_t scope = gpuProfiler ? gpuProfiler->beginScope(commandBuffer, pass.name.c_str()) : UINT32_MAX;
+			recordBarriers(commandBuffer, pass.barriers, pass.barrierResources, pass.srcStages, pass.dstStages, frameSlot);
+
+			PassContext context{ *this };
+			context.commandBuffer = commandBuffer;
+			context.frameSlot = frameSlot;
+			context.extent = extent;
+			context.renderTarget = {};
+			context.secondaryRecorder = nullptr;
+
+			colorAttachments.clear();
+			VkRenderingAttachmentInfo depthAttachment{};
+			bool hasDepth = false;
+			for (const Access& access : pass.accesses) {
+				if (access.usage != Usage::ColorAttachment && access.usage != Usage::DepthAttachment) {
+					continue;
+				}
+				const ResourceNode& resource = resources[access.resource];
+				VkRenderingAttachmentInfo attachment{};
+				attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+				attachment.imageView = context.imageView(access.resource);
+				attachment.imageLayout = stateFor(access.usage, access.write).layout;
+				attachment.loadOp = access.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+				if (!access.write) {
+					attachment.storeOp = VK_ATTACHMENT_STORE_OP_NONE;
+				} else {
+					attachment.storeOp = access.store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				}
+				if (access.clear) {
+					attachment.clearValue = *access.clear;
+				}
+				context.extent = extentOf(resource);
+
+				if (access.usage == Usage::ColorAttachment) {
+					context.renderTarget.colorFormat = resource.format;
+					colorAttachments.push_back(attachment);
+				} else {
+					context.renderTarget.depthFormat = resource.format;
+					depthAttachment = attachment;
+					hasDepth = true;
+				}
+			}
+
+			context.renderTarget.colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size());
+			const bool rendering = !colorAttachments.empty() || hasDepth;
+			if (rendering) {
+				const bool secondaries = pass.secondaries && secondaryRecorder != nullptr;
+
+				VkRenderingInfo renderingInfo{};
+				renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+				renderingInfo.flags = secondaries ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+				renderingInfo.renderArea = { { 0, 0 }, context.extent };
+				renderingInfo.layerCount = 1;
+				renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size());
+				renderingInfo.pColorAttachments = colorAttachments.data();
+				renderingInfo.pDepthAttachment = hasDepth ? &depthAttachment : nullptr;
+				vkCmdBeginRendering(commandBuffer, &renderingInfo);
+
+				if (secondaries) {
+					// Nothing but vkCmdExecuteCommands goes into the primary, the recorder sets viewport/scissor
+					secondaryRecorder->beginPass(frameSlot, context.renderTarget, VK_NULL_HANDLE, context.extent);
+					context.secondaryRecorder = secondaryRecorder;
+				} else {
+					VkViewport viewport{};
+					viewport.x = 0.0f;
+					viewport.y = 0.0f;
+					viewport.width = static_cast<float>(context.extent.width);
+					viewport.height = static_cast<float>(context.extent.height);
+					viewport.minDepth = 0.0f;
+					viewport.maxDepth = 1.0f;
+					VkRect2D scissor{ {0, 0}, context.extent };
+					vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+					vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+				}
+			}
+
+			pass.execute(context);
+
+			if (rendering) {
+				if (context.secondaryRecorder) {
+					secondaryRecorder->execute(commandBuffer);
+				}
+				vkCmdEndRendering(commandBuffer);
+			}
+			if (gpuProfiler) {
+				gpuProfiler->endScope(commandBuffer, scope);
+			}
+		}
+
+		recordBarriers(commandBuffer, finalBarriers, finalBarrierResources, finalSrcStages,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameSlot);
+	}
+
+	void VkmRenderGraph::dump(std::ostream& os) const {
+		auto megabytes = [](VkDeviceSize bytes) { return bytes / (1024.0 * 1024.0); };
+
+		os << "Render graph " << extent.width << "x" << extent.height << ", " << frameSlotCount << " frame slots";
+		if (!compiled) {
+			os << " (not compiled)" << std::endl;
+			return;
+		}
+		os << std::endl;
+
+		os << "  passes:" << std::endl;
+		for (uint32_t k = 0; k < order.size(); k++) {
+			const PassNode& pass = passes[order[k]];
+			os << "    " << k << " " << pass.name << (pass.secondaries ? " (secondaries allowed)" : "")
+				<< (pass.sideEffects ? " (side effects)" : "") << std::endl;
+			for (size_t i = 0; i < pass.barriers.size(); i++) {
+				os << "      barrier " << resources[pass.barrierResources[i]].name << " "
+					<< layoutName(pass.barriers[i].oldLayout) << " -> " << layoutName(pass.barriers[i].newLayout) << std::endl;
+			}
+			for (const Access& access : pass.accesses) {
+				os << "      " << (access.write ? "writes " : "reads ") << resources[access.resource].name << " as "
+					<< usageName(access.usage) << (access.clear ? ", cleared" : "")
+					<< (access.write && !access.store ? ", not stored" : "") << std::endl;
+			}
+		}
+		for (size_t i = 0; i < finalBarriers.size(); i++) {
+			os << "    final barrier " << resources[finalBarrierResources[i]].name << " "
+				<< layoutName(finalBarriers[i].oldLayout) << " -> " << layoutName(finalBarriers[i].newLayout) << std::endl;
+		}
+
+		os << "  culled:";
+		for (const PassNode& pass : passes) {
+			if (pass.culled) {
+				os << " " << pass.name;
+			}
+		}
+		os << (stats.culledPassCount == 0 ? " none" : "") << std::endl;
+
+		os << "  resources:" << std::endl;
+		for (const ResourceNode& resource : resources) {
+			os << "    " << resource.name << (resource.imported ? " (imported)" : "") << ", format "
+				<< static_cast<int>(resource.format);
+			if (resource.firstPass == UINT32_MAX) {
+				os << ", unused" << std::endl;
+				continue;
+			}
+			os << ", passes " << resource.firstPass << "-" << resource.lastPass;
+			if (!resource.imported) {
+				os << ", " << megabytes(resource.requirements.size) << " MB in memory " << resource.memory;
+			}
+			os << std::endl;
+		}
+
+		os << "  memory (per frame slot):" << std::endl;
+		for (size_t m = 0; m < memories.size(); m++) {
+			os << "    " << m << ": " << megabytes(memories[m].requirements.size) << " MB,";
+			for (Resource resource : memories[m].resources) {
+				os << " " << resources[resource].name;
+			}
+			os << std::endl;
+		}
+		os << "  " << stats.barrierCount << " barriers, " << stats.transientImageCount << " transient images, "
+			<< megabytes(stats.transientBytes) << " MB without aliasing, " << megabytes(stats.aliasedBytes) << " MB with"
+			<< std::endl;
+	}
+
+	std::ostream& operator<<(std::ostream& os, const VkmRenderGraph& graph) {
+		graph.dump(os);
+		return os;
+	}
+
+} // Namespace vkm
@@ -0,0 +1,244 @@
+#pragma once
+
+#include "vkm_device.h"
+#include "vkm_gpu_profiler.h"
+#include "vkm_pipeline.h"
+#include "vkm_secondary_recorder.h"
+
+// Vulkan
+#include <vulkan/vulkan.h>
+
+// Standard Library
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace vkm {
+
+	// A frame described as passes that declare which images they read and write. compile() culls passes nothing
+	// depends on, works out the layout transitions and pipeline barriers between the rest and puts transient images
+	// whose lifetimes don't overlap into the same memory. Passes run in the order they were added (a pass can only
+	// read what an earlier one wrote). Passes with attachments are begun with dynamic rendering by the graph.
+	// Built once and executed every frame, imported images (the swap chain's) are rebound with setImportedImage
+	// and it only compiles again when the extent or frame slot count changes
+	class VkmRenderGraph {
+	public:
+		using Resource = uint32_t;
+		static constexpr Resource INVALID_RESOURCE = UINT32_MAX;
+
+		enum class Usage {
+			ColorAttachment,
+			DepthAttachment, // Read only when read (depth test against an earlier pass' depth)
+			SampledFragment,
+			SampledCompute,
+			Storage,
+			TransferSrc,
+			TransferDst
+		};
+
+		struct ImageDesc {
+			VkFormat format;
+			VkExtent2D extent{ 0, 0 }; // 0x0 follows the graph's extent
+		};
+
+		// State an imported image is in before the frame and what it has to be left in
+		struct ImportDesc {
+			VkFormat format;
+			VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags initialStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT; // Waited on before the first use
+			VkAccessFlags initialAccess = 0;
+			VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED; // UNDEFINED leaves it in whatever the last pass used
+			bool output = false; // What the frame is for, passes contributing to it are kept
+		};
+
+		class PassContext {
+		public:
+			VkCommandBuffer commandBuffer;
+			uint32_t frameSlot;
+			VkExtent2D extent; // Render area of a pass with attachments, the graph's extent otherwise
+			VkmRenderTarget renderTarget; // Color and depth attachment, what the pass' pipelines were built for
+			// Set when the pass was begun with secondary contents, draws then go through it instead of commandBuffer
+			VkmSecondaryRecorder* secondaryRecorder;
+
+			VkImage image(Resource resource) const;
+			VkImageView imageView(Resource resource) const;
+
+		private:
+			friend class VkmRenderGraph;
+			PassContext(const VkmRenderGraph& graph) : graph{ graph } {}
+			const VkmRenderGraph& graph;
+		};
+
+		class PassBuilder {
+		public:
+			// Without a clear value the previous contents are loaded. One color and one depth attachment per pass
+			void writeColor(Resource resource, std::optional<VkClearColorValue> clear = std::nullopt);
+			void writeDepth(Resource resource, std::optional<VkClearDepthStencilValue> clear = std::nullopt);
+			void read(Resource resource, Usage usage);
+			void write(Resource resource, Usage usage);
+			// Begun with secondary contents and handed the graph's recorder when it has one (setSecondaryRecorder)
+			void allowSecondaries();
+			// Never culled, for passes whose results leave the graph some other way (readbacks, queries)
+			void sideEffects();
+
+		private:
+			friend class VkmRenderGraph;
+			PassBuilder(VkmRenderGraph& graph, uint32_t pass) : graph{ graph }, pass{ pass } {}
+			void use(Resource resource, Usage usage, bool write, std::optional<VkClearValue> clear);
+			VkmRenderGraph& graph;
+			uint32_t pass;
+		};
+
+		VkmRenderGraph(VkmDevice& device, VkExtent2D extent, uint32_t frameSlotCount);
+		~VkmRenderGraph();
+
+		VkmRenderGraph(const VkmRenderGraph &) = delete;
+		VkmRenderGraph &operator=(const VkmRenderGraph &) = delete;
+
+		// Created by the graph, contents only live for the frame. One copy per frame slot
+		Resource createImage(const std::string& name, const ImageDesc& desc);
+		Resource importImage(const std::string& name, const ImportDesc& desc);
+		// Every frame before execute, the image has to be graph extent sized
+		void setImportedImage(Resource resource, VkImage image, VkImageView view);
+
+		// setup runs right away and declares what the pass uses, execute runs every frame the pass isn't culled
+		void addPass(
+			const std::string& name,
+			const std::function<void(PassBuilder&)>& setup,
+			std::function<void(const PassContext&)> execute);
+
+		// Both recompile on the next execute when they change. Old transient images are destroyed once the
+		// frames that might still use them retire
+		void setExtent(VkExtent2D newExtent);
+		void setFrameSlotCount(uint32_t count);
+		// Null records every pass inline
+		void setSecondaryRecorder(VkmSecondaryRecorder* recorder) { secondaryRecorder = recorder; }
+		// Every pass gets a scope named after it, null turns that off
+		void setGpuProfiler(VkmGpuProfiler* profiler) { gpuProfiler = profiler; }
+
+		void compile();
+		// Records every pass that survived culling into commandBuffer, compiles first if needed
+		void execute(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+		struct Stats {
+			uint32_t passCount = 0;
+			uint32_t culledPassCount = 0;
+			uint32_t barrierCount = 0; // Image barriers per frame
+			uint32_t transientImageCount = 0;
+			VkDeviceSize transientBytes = 0; // Per frame slot, what the transients would take without aliasing
+			VkDeviceSize aliasedBytes = 0; // Per frame slot, what they actually take
+		};
+		Stats getStats() const { return stats; }
+
+		// The compiled graph: passes in execution order with their barriers, culled passes, resources with their
+		// lifetimes and which memory they share
+		void dump(std::ostream& os) const;
+
+	private:
+		struct ResourceNode {
+			std::string name;
+			bool imported = false;
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			ImageDesc desc{};
+			ImportDesc importDesc{};
+			bool written = false; // A pass added so far writes it
+
+			// Compiled
+			VkImageUsageFlags usage = 0;
+			uint32_t firstPass = UINT32_MAX; // Execution order
+			uint32_t lastPass = 0;
+			uint32_t memory = UINT32_MAX; // Index into memories, transients only
+			VkMemoryRequirements requirements{};
+			std::vector<VkImage> images; // Per frame slot, imported ones only use [0]
+			std::vector<VkImageView> views;
+		};
+
+		struct Access {
+			Resource resource;
+			Usage usage;
+			bool write;
+			std::optional<VkClearValue> clear;
+			bool store = true; // Compiled, something after this pass needs the contents
+		};
+
+		struct PassNode {
+			std::string name;
+			std::vector<Access> accesses;
+			std::function<void(const PassContext&)> execute;
+			bool secondaries = false;
+			bool sideEffects = false;
+
+			// Compiled
+			bool culled = false;
+			std::vector<VkImageMemoryBarrier> barriers; // image is filled in at execute
+			std::vector<Resource> barrierResources;
+			VkPipelineStageFlags srcStages = 0;
+			VkPipelineStageFlags dstStages = 0;
+		};
+
+		// Aliased transients share one of these per frame slot
+		struct Memory {
+			VkMemoryRequirements requirements{};
+			std::vector<Resource> resources; // In order of first use
+			std::vector<VkmAllocation> allocations; // Per frame slot
+		};
+
+		// What one use of an image needs
+		struct State {
+			VkImageLayout layout;
+			VkPipelineStageFlags stages;
+			VkAccessFlags access;
+			VkAccessFlags writeAccess; // The part of access that writes, what later uses have to see
+		};
+
+		// Where an image is at while barriers are built
+		struct Sync {
+			VkImageLayout layout;
+			VkPipelineStageFlags writeStages; // Last write (or the import's initial stages)
+			VkAccessFlags writeAccess;
+			VkPipelineStageFlags readStages; // Reads since the last write, in the current layout
+			// What barriers since the last write already made the write visible to. A read outside of it needs another
+			VkPipelineStageFlags visibleStages;
+			VkAccessFlags visibleAccess;
+		};
+
+		static State stateFor(Usage usage, bool write);
+		static VkImageUsageFlags imageUsageFor(Usage usage);
+		static const char* usageName(Usage usage);
+		static VkImageAspectFlags aspectFor(VkFormat format, bool view);
+
+		VkExtent2D extentOf(const ResourceNode& resource) const;
+		void releaseTransients();
+		void cull();
+		void createTransients();
+		void aliasTransients();
+		void buildBarriers();
+		// Fills in this frame slot's images, then one vkCmdPipelineBarrier for all of them
+		void recordBarriers(VkCommandBuffer commandBuffer, std::vector<VkImageMemoryBarrier>& barriers,
+			const std::vector<Resource>& barrierResources, VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages,
+			uint32_t frameSlot);
+
+		VkmDevice& device;
+		VkExtent2D extent;
+		uint32_t frameSlotCount;
+		VkmSecondaryRecorder* secondaryRecorder = nullptr;
+		VkmGpuProfiler* gpuProfiler = nullptr;
+
+		std::vector<ResourceNode> resources;
+		std::vector<PassNode> passes;
+		std::vector<uint32_t> order; // Passes that survived culling
+		std::vector<Memory> memories;
+		// Transitions into imported images' final layouts after the last pass
+		std::vector<VkImageMemoryBarrier> finalBarriers;
+		std::vector<Resource> finalBarrierResources;
+		VkPipelineStageFlags finalSrcStages = 0;
+		bool compiled = false;
+		Stats stats{};
+	};
+
+	std::ostream& operator<<(std::ostream& os, const VkmRenderGraph& graph);
+
+} // Namespace vkm
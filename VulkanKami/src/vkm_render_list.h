@@ -0,0 +1,21 @@
+#pragma once
+
+#include "vkm_model.h"
+#include "vkm_transform_batch.h"
+
+// Standard Library
+#include <vector>
+
+namespace vkm {
+
+	// What the draw paths need per object as flat arrays, all indexed the same way.
+	// Rebuilt from the world every frame by SimpleRenderSystem::prepareFrame
+	struct VkmRenderList {
+		VkmTransformBatch transforms;
+		std::vector<VkmModel*> models;
+		std::vector<glm::vec3> colors;
+
+		uint32_t size() const { return transforms.size(); }
+	};
+
+} // Namespace vkm
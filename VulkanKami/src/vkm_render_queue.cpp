@@ -0,0 +1,130 @@
+#include "vkm_render_queue.h"
+#include "vkm_cpu_profiler.h"
+
+// Standard Libraries
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace vkm {
+
+	void VkmRenderQueue::begin() {
+		draws.clear();
+		pushData.clear();
+		keys.clear();
+		// Ids only have to agree within one sort. Keeping them across frames would let a new object at a freed
+		// object's address inherit its id
+		pipelineIds.clear();
+		modelIds.clear();
+	}
+
+	uint32_t VkmRenderQueue::idFor(std::unordered_map<const void*, uint32_t>& ids, const void* object, uint32_t bits) {
+		auto it = ids.find(object);
+		if (it != ids.end()) {
+			return it->second;
+		}
+		// Out of ids (that many different objects in one frame), start over. Draws already pushed keep their old ids
+		// which only costs some extra binds
+		if (ids.size() >= (1ull << bits)) {
+			ids.clear();
+		}
+		uint32_t id = static_cast<uint32_t>(ids.size());
+		ids.emplace(object, id);
+		return id;
+	}
+
+	void VkmRenderQueue::push(VkmPipeline* pipeline, VkmModel* model, uint32_t material, float depth, const void* pushConstants) {
+		assert(pipeline != nullptr && model != nullptr && "Render queue draws need a pipeline and a model");
+		assert(material < (1u << MATERIAL_BITS) && "Material id doesn't fit in the draw key");
+
+		uint64_t pipelineId = idFor(pipelineIds, pipeline, PIPELINE_BITS);
+		uint64_t modelId = idFor(modelIds, model, MODEL_BITS);
+		uint64_t depthBits = static_cast<uint64_t>(std::clamp(depth, 0.f, 1.f) * ((1u << DEPTH_BITS) - 1));
+		keys.push_back(
+			(pipelineId << (MODEL_BITS + MATERIAL_BITS + DEPTH_BITS)) |
+			(modelId << (MATERIAL_BITS + DEPTH_BITS)) |
+			(static_cast<uint64_t>(material) << DEPTH_BITS) |
+			depthBits);
+
+		uint32_t pushOffset = static_cast<uint32_t>(pushData.size());
+		if (pushConstantSize > 0) {
+			pushData.resize(pushData.size() + pushConstantSize);
+			std::memcpy(pushData.data() + pushOffset, pushConstants, pushConstantSize);
+		}
+		draws.push_back({ pipeline, model, pushOffset });
+	}
+
+	void VkmRenderQueue::sortKeys() {
+		const size_t count = keys.size();
+		order.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			order[i] = i;
+		}
+		keyScratch.resize(count);
+		orderScratch.resize(count);
+
+		// LSD radix sort, one byte per pass. Stable, and a pass where every key has the same byte is skipped
+		// (the high bytes are mostly zero with only a few pipelines and models)
+		for (uint32_t shift = 0; shift < 64; shift += 8) {
+			uint32_t histogram[256] = {};
+			for (uint64_t key : keys) {
+				histogram[(key >> shift) & 0xff]++;
+			}
+			if (histogram[(keys[0] >> shift) & 0xff] == count) {
+				continue;
+			}
+
+			uint32_t offsets[256];
+			uint32_t total = 0;
+			for (uint32_t bucket = 0; bucket < 256; bucket++) {
+				offsets[bucket] = total;
+				total += histogram[bucket];
+			}
+			for (size_t i = 0; i < count; i++) {
+				uint32_t destination = offsets[(keys[i] >> shift) & 0xff]++;
+				keyScratch[destination] = keys[i];
+				orderScratch[destination] = order[i];
+			}
+			keys.swap(keyScratch);
+			order.swap(orderScratch);
+		}
+	}
+
+	void VkmRenderQueue::submit(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VkShaderStageFlags stageFlags) {
+		VKM_PROFILE_SCOPE("VkmRenderQueue::submit");
+		stats = {};
+		if (draws.empty()) {
+			return;
+		}
+
+		sortKeys();
+
+		// Compare the real pointers, not the ids, an id reset can make two different objects share one
+		VkmPipeline* boundPipeline = nullptr;
+		VkmModel* boundModel = nullptr;
+		for (uint32_t index : order) {
+			const Draw& draw = draws[index];
+			if (draw.pipeline != boundPipeline) {
+				draw.pipeline->bind(commandBuffer);
+				boundPipeline = draw.pipeline;
+				stats.pipelineBinds++;
+			} else {
+				stats.pipelineBindsSkipped++;
+			}
+			if (draw.model != boundModel) {
+				draw.model->bind(commandBuffer);
+				boundModel = draw.model;
+				stats.modelBinds++;
+			} else {
+				stats.modelBindsSkipped++;
+			}
+
+			if (pushConstantSize > 0) {
+				vkCmdPushConstants(commandBuffer, pipelineLayout, stageFlags, 0, pushConstantSize, pushData.data() + draw.pushOffset);
+			}
+			draw.model->draw(commandBuffer);
+			stats.drawCount++;
+		}
+	}
+
+} // Namespace vkm
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "vkm_pipeline.h"
+#include "vkm_model.h"
+
+// Standard Library
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace vkm {
+
+	// Collects a frame's draws, sorts them by a 64 bit key and records them with as few state changes as possible.
+	// Key layout, most significant first: pipeline (12 bits) | model (16) | material (12) | depth (24).
+	// So draws are grouped by pipeline, then by vertex buffers, and the sort is stable for equal keys
+	class VkmRenderQueue {
+	public:
+		static constexpr uint32_t PIPELINE_BITS = 12;
+		static constexpr uint32_t MODEL_BITS = 16;
+		static constexpr uint32_t MATERIAL_BITS = 12;
+		static constexpr uint32_t DEPTH_BITS = 24;
+
+		struct Stats {
+			uint32_t drawCount = 0;
+			uint32_t pipelineBinds = 0;
+			uint32_t pipelineBindsSkipped = 0;
+			uint32_t modelBinds = 0;
+			uint32_t modelBindsSkipped = 0;
+		};
+
+		VkmRenderQueue() = default;
+
+		VkmRenderQueue(const VkmRenderQueue &) = delete;
+		VkmRenderQueue &operator=(const VkmRenderQueue &) = delete;
+
+		// Drops last frame's draws, call before the first push of a frame
+		void begin();
+		// depth is 0..1 (front to back), pushConstants is copied and pushed with pushConstantSize before the draw
+		void push(VkmPipeline* pipeline, VkmModel* model, uint32_t material, float depth, const void* pushConstants);
+		// Sorts and records everything pushed since begin. pipelineLayout/stageFlags describe the push constant range
+		void submit(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VkShaderStageFlags stageFlags);
+
+		// Every draw in a queue pushes the same amount of constants
+		void setPushConstantSize(uint32_t size) { pushConstantSize = size; }
+		uint32_t size() const { return static_cast<uint32_t>(draws.size()); }
+		// Counters of the last submit
+		const Stats& getStats() const { return stats; }
+
+	private:
+		struct Draw {
+			VkmPipeline* pipeline;
+			VkmModel* model;
+			uint32_t pushOffset; // Into pushData
+		};
+
+		uint32_t idFor(std::unordered_map<const void*, uint32_t>& ids, const void* object, uint32_t bits);
+		void sortKeys();
+
+		uint32_t pushConstantSize = 0;
+		std::vector<Draw> draws;
+		std::vector<uint8_t> pushData;
+		std::vector<uint64_t> keys; // One per draw, sorted together with order
+		std::vector<uint32_t> order; // Draw indices
+		std::vector<uint64_t> keyScratch;
+		std::vector<uint32_t> orderScratch;
+
+		// Small ids so pointers fit in the key. Reset every begin, and when they run out of bits
+		std::unordered_map<const void*, uint32_t> pipelineIds;
+		std::unordered_map<const void*, uint32_t> modelIds;
+
+		Stats stats{};
+	};
+
+} // Namespace vkm
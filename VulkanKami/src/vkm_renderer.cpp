@@ -1,13 +1,21 @@
 #include "vkm_renderer.h"
+#include "vkm_cpu_profiler.h"
 
 // Standard Libraries
 #include <stdexcept>
 #include <cassert>
+#include <algorithm>
 #include <array>
 
 namespace vkm {
 
-	VkmRenderer::VkmRenderer(VkmWindow &window, VkmDevice& device) : vkmWindow{ window }, vkmDevice{ device } {
+	VkmRenderer::VkmRenderer(VkmWindow &window, VkmDevice& device, bool preferDynamicRendering)
+		: vkmWindow{ window }, vkmDevice{ device },
+		dynamicRendering{ preferDynamicRendering && device.supportsDynamicRendering() } {
+		// The first swap chain has nothing to fall back on, so starting minimized still waits here
+		while (vkmWindow.isMinimized()) {
+			glfwWaitEvents();
+		}
 		recreateSwapChain();
 		createCommandBuffers();
 	}
@@ -16,61 +24,103 @@ namespace vkm {
 
 
 	void VkmRenderer::recreateSwapChain() {
+		VKM_PROFILE_SCOPE("recreateSwapChain");
+		const uint64_t recreateStart = VkmCpuProfiler::get().now();
 		auto extent = vkmWindow.getExtent();
-		while (extent.width == 0 || extent.height == 0) { // This occurs when minimizing the window
-			extent = vkmWindow.getExtent();
-			glfwWaitEvents();
-		}
-		vkDeviceWaitIdle(vkmDevice.device());
 		if (vkmSwapChain == nullptr) {
-			vkmSwapChain = std::make_unique<VkmSwapChain>(vkmDevice, extent);
+			vkmSwapChain = std::make_unique<VkmSwapChain>(vkmDevice, extent, VkmPresentPolicy::forMode(latencyMode), dynamicRendering);
 		} else {
 			std::shared_ptr<VkmSwapChain> oldSwapChain = std::move(vkmSwapChain);
-			vkmSwapChain = std::make_unique<VkmSwapChain>(vkmDevice, extent, oldSwapChain);
+			vkmSwapChain = std::make_unique<VkmSwapChain>(vkmDevice, extent, VkmPresentPolicy::forMode(latencyMode), dynamicRendering, oldSwapChain);
 
 			if (!oldSwapChain->compareSwapFormat(*vkmSwapChain.get())) {
 				throw std::runtime_error("Swap chain image(or depth) format has changed!");
 			}
+			// Frames already submitted still render into the old images, no need to idle the whole device for that.
+			// Their fences don't cover the presentation engine though (no VK_EXT_swapchain_maintenance1), so the old
+			// chain is kept until the new one has presented, see endFrame
+			retiredSwapChains.push_back(std::move(oldSwapChain));
+		}
+		swapChainOutOfDate = false;
+		pendingRecreateMs = (VkmCpuProfiler::get().now() - recreateStart) / 1e6;
+	}
+
+	void VkmRenderer::markSwapChainOutOfDate() {
+		swapChainOutOfDate = true;
+		if (resizeStartNs == UINT64_MAX) {
+			resizeStartNs = VkmCpuProfiler::get().now();
 		}
+	}
 
+	void VkmRenderer::setLatencyMode(VkmLatencyMode mode) {
+		assert(!isFrameStarted && "Can't change the latency mode in the middle of a frame");
+		if (mode == latencyMode) {
+			return;
+		}
+		latencyMode = mode;
+		swapChainOutOfDate = true; // Not a resize, so no resize latency for this one
+		latencyTracker.reset();
+	}
+
+	void VkmRenderer::setParallelRecording(VkmThreadPool* threadPool) {
+		assert(!isFrameStarted && "Can't switch recording mode in the middle of a frame");
+		parallelRecording = threadPool != nullptr;
+		if (threadPool != nullptr && secondaryRecorder == nullptr) {
+			secondaryRecorder = std::make_unique<VkmSecondaryRecorder>(vkmDevice, *threadPool, VkmSwapChain::MAX_FRAMES_IN_FLIGHT);
+		}
 	}
 
 	void VkmRenderer::createCommandBuffers() {
 
-		commandBuffers.resize(VkmSwapChain::MAX_FRAMES_IN_FLIGHT);
+		// One per possible frame slot, the policy can change how many are used at any time.
+		// Each has its own pool so a frame's commands are freed with one vkResetCommandPool instead of per buffer
+		frameCommands.resize(VkmSwapChain::MAX_FRAMES_IN_FLIGHT);
+		for (FrameCommands& frame : frameCommands) {
+			frame.pool = vkmDevice.createCommandPool();
 
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		// Creating and destroying command buffers is a freqeunt operation
-		// Therefore we use a command pool and can free memory once
-		allocInfo.commandPool = vkmDevice.getCommandPool();
-		allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandPool = frame.pool;
+			allocInfo.commandBufferCount = 1;
 
-		if (vkAllocateCommandBuffers(vkmDevice.device(), &allocInfo, commandBuffers.data()) !=
-			VK_SUCCESS) {
-			throw std::runtime_error("Failed to allocate command buffers!");
+			if (vkAllocateCommandBuffers(vkmDevice.device(), &allocInfo, &frame.commandBuffer) !=
+				VK_SUCCESS) {
+				throw std::runtime_error("Failed to allocate command buffers!");
+			}
 		}
 
 	}
 
 	void VkmRenderer::freeCommandBuffers() {
-		vkFreeCommandBuffers(vkmDevice.device(),
-			vkmDevice.getCommandPool(),
-			static_cast<uint32_t>(commandBuffers.size()),
-			commandBuffers.data()
-		);
-		commandBuffers.clear();
+		// Destroying the pool frees its buffers
+		for (FrameCommands& frame : frameCommands) {
+			vkDestroyCommandPool(vkmDevice.device(), frame.pool, nullptr);
+		}
+		frameCommands.clear();
 	}
 
 
 	VkCommandBuffer VkmRenderer::beginFrame() {
+		VKM_PROFILE_SCOPE("beginFrame");
 		assert(!isFrameStarted && "Can't call beginFrame while already in progress");
+		frameInputNs = VkmCpuProfiler::get().now(); // Apps poll events right before this
+
+		// Minimized: skip the frame instead of blocking in here, the app decides how to wait for events
+		if (swapChainOutOfDate) {
+			if (vkmWindow.isMinimized()) {
+				resizeStartNs = VkmCpuProfiler::get().now(); // Time spent minimized isn't latency
+				return nullptr;
+			}
+			recreateSwapChain();
+		}
 	
 		auto result = vkmSwapChain->acquireNextImage(&currentImageIndex);
+		// Whatever the GPU has finished by now (at least the frame that used this slot last)
+		vkmDevice.retireCompletedFrames();
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-			recreateSwapChain();
+			markSwapChainOutOfDate();
 			return nullptr;
 		}
 
@@ -80,7 +130,10 @@ namespace vkm {
 		}
 
 		isFrameStarted = true;
+		currentFrameIndex = static_cast<int>(vkmSwapChain->getCurrentFrame());
 
+		// acquireNextImage waited for the slot's last frame, nothing recorded from this pool is in flight anymore
+		vkResetCommandPool(vkmDevice.device(), frameCommands[currentFrameIndex].pool, 0);
 		auto commandBuffer = getCurrentCommandBuffer();
 
 		VkCommandBufferBeginInfo beginInfo{};
@@ -89,25 +142,56 @@ namespace vkm {
 		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to begin recording command buffer!");
 		}
+
+		// The frame that used this slot last was waited on in acquireNextImage, so its queries can be read
+		gpuProfiler.beginFrame(commandBuffer, currentFrameIndex);
+		frameScope = gpuProfiler.beginScope(commandBuffer, "frame");
 		return commandBuffer;
 	}
 	void VkmRenderer::endFrame() {
+		VKM_PROFILE_SCOPE("endFrame");
 		assert(isFrameStarted && "Can't call endFrame while frame is not in progress");
 		auto commandBuffer = getCurrentCommandBuffer();
+		gpuProfiler.endScope(commandBuffer, frameScope);
 		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to record command buffer!");
 		}
 
+		// Uploads recorded while building this frame have to be submitted ahead of it
+		{
+			VKM_PROFILE_SCOPE("flushUploads");
+			vkmDevice.flushUploads();
+		}
+
 		auto result = vkmSwapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
+		latencyTracker.frameSubmitted(vkmDevice.currentFrame(), frameInputNs);
+		if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+			// The new chain presented, so the presentation engine let go of the old chains' images. Tagged with this
+			// frame, they go once it retires
+			for (auto& oldSwapChain : retiredSwapChains) {
+				vkmDevice.deferDestruction([oldSwapChain]() mutable { oldSwapChain.reset(); });
+			}
+			retiredSwapChains.clear();
+		}
+		vkmDevice.advanceFrame();
+		if (resizeStartNs != UINT64_MAX && !swapChainOutOfDate) {
+			// First frame on the new swap chain, shows up in the CPU trace as one span covering the whole resize
+			const uint64_t now = VkmCpuProfiler::get().now();
+			VkmCpuProfiler::get().record("resize latency", resizeStartNs, now);
+			resizeStats.count++;
+			resizeStats.lastMs = (now - resizeStartNs) / 1e6;
+			resizeStats.maxMs = std::max(resizeStats.maxMs, resizeStats.lastMs);
+			resizeStats.lastRecreateMs = pendingRecreateMs;
+			resizeStartNs = UINT64_MAX;
+		}
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || vkmWindow.wasWindowResized()) {
 			vkmWindow.resetWindowResizedFlag();
-			recreateSwapChain();
+			markSwapChainOutOfDate();
 		} else if (result != VK_SUCCESS) {
 			throw std::runtime_error("Failed to present swap chain image!");
 		}
 
 		isFrameStarted = false;
-		currentFrameIndex = (currentFrameIndex + 1) % VkmSwapChain::MAX_FRAMES_IN_FLIGHT;
 	}
 	void VkmRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
 	
@@ -116,31 +200,46 @@ namespace vkm {
 			commandBuffer == getCurrentCommandBuffer() &&
 			"Can't begin render pass on command buffer from a different frame");
 
-		VkRenderPassBeginInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = vkmSwapChain->getRenderPass();
-		renderPassInfo.framebuffer = vkmSwapChain->getFrameBuffer(currentImageIndex);
-
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = vkmSwapChain->getSwapChainExtent();
-
+		const VkExtent2D extent = vkmSwapChain->getSwapChainExtent();
 		std::array<VkClearValue, 2> clearValues{};
 		// Index 0 is color, Index 1 is depth
 		clearValues[0].color = { 0.01f, 0.01f, 0.01f, 1.0f }; // Background color
 		clearValues[1].depthStencil = { 1.0f, 0 };
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
-		// VK_SUBPASS_CONTENTS_INLINE (Render pass commands only in primary not secondary)
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		passScope = gpuProfiler.beginScope(commandBuffer, "main pass");
+		passRecordsSecondaries = getSecondaryRecorder() != nullptr;
+
+		if (dynamicRendering) {
+			beginDynamicRendering(commandBuffer, clearValues[0], clearValues[1]);
+		} else {
+			VkRenderPassBeginInfo renderPassInfo{};
+			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			renderPassInfo.renderPass = vkmSwapChain->getRenderPass();
+			renderPassInfo.framebuffer = vkmSwapChain->getFrameBuffer(currentImageIndex, currentFrameIndex);
+
+			renderPassInfo.renderArea.offset = { 0, 0 };
+			renderPassInfo.renderArea.extent = extent;
+			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+			renderPassInfo.pClearValues = clearValues.data();
+			// VK_SUBPASS_CONTENTS_INLINE (Render pass commands only in primary not secondary)
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+				passRecordsSecondaries ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+		}
+
+		if (passRecordsSecondaries) {
+			// Nothing but vkCmdExecuteCommands goes into the primary from here on, the recorder sets viewport/scissor
+			secondaryRecorder->beginPass(currentFrameIndex, getRenderTarget(),
+				dynamicRendering ? VK_NULL_HANDLE : vkmSwapChain->getFrameBuffer(currentImageIndex, currentFrameIndex), extent);
+			return;
+		}
 
 		VkViewport viewport{};
 		viewport.x = 0.0f;
 		viewport.y = 0.0f;
-		viewport.width = static_cast<float>(vkmSwapChain->getSwapChainExtent().width);
-		viewport.height = static_cast<float>(vkmSwapChain->getSwapChainExtent().height);
+		viewport.width = static_cast<float>(extent.width);
+		viewport.height = static_cast<float>(extent.height);
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
-		VkRect2D scissor{ {0, 0}, vkmSwapChain->getSwapChainExtent() };
+		VkRect2D scissor{ {0, 0}, extent };
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 	}
@@ -150,7 +249,121 @@ namespace vkm {
 		assert(
 			commandBuffer == getCurrentCommandBuffer() &&
 			"Can't end render pass on command buffer from a different frame");
-		vkCmdEndRenderPass(commandBuffer);
+		if (passRecordsSecondaries) {
+			secondaryRecorder->execute(commandBuffer);
+		}
+		if (dynamicRendering) {
+			vkCmdEndRendering(commandBuffer);
+
+			// What the render pass' final layout used to do
+			VkImageMemoryBarrier toPresent{};
+			toPresent.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			toPresent.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			toPresent.dstAccessMask = 0;
+			toPresent.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			toPresent.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+			toPresent.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			toPresent.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			toPresent.image = vkmSwapChain->getImage(currentImageIndex);
+			toPresent.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			vkCmdPipelineBarrier(commandBuffer,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				0, 0, nullptr, 0, nullptr, 1, &toPresent);
+		} else {
+			vkCmdEndRenderPass(commandBuffer);
+		}
+		gpuProfiler.endScope(commandBuffer, passScope);
+	}
+
+	VkmRenderer::SwapChainTargets VkmRenderer::importSwapChain(VkmRenderGraph& graph) const {
+		VkmRenderGraph::ImportDesc color{};
+		color.format = vkmSwapChain->getSwapChainImageFormat();
+		color.initialStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // Where the acquire semaphore is waited on
+		color.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		color.output = true;
+
+		// Last used by the frame before in the same slot
+		VkmRenderGraph::ImportDesc depth{};
+		depth.format = vkmSwapChain->getSwapChainDepthFormat();
+		depth.initialStages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		depth.initialAccess = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		return { graph.importImage("swap chain", color), graph.importImage("depth", depth) };
+	}
+
+	void VkmRenderer::executeGraph(VkCommandBuffer commandBuffer, VkmRenderGraph& graph, const SwapChainTargets& targets) {
+		assert(isFrameStarted && "Can't call executeGraph if frame is not in progress");
+		assert(
+			commandBuffer == getCurrentCommandBuffer() &&
+			"Can't execute the render graph on command buffer from a different frame");
+		assert(dynamicRendering && "The render graph needs dynamic rendering");
+
+		graph.setExtent(vkmSwapChain->getSwapChainExtent());
+		graph.setFrameSlotCount(vkmSwapChain->getFramesInFlight());
+		graph.setImportedImage(targets.color,
+			vkmSwapChain->getImage(currentImageIndex), vkmSwapChain->getImageView(currentImageIndex));
+		graph.setImportedImage(targets.depth,
+			vkmSwapChain->getDepthImage(currentFrameIndex), vkmSwapChain->getDepthImageView(currentFrameIndex));
+		graph.setSecondaryRecorder(getSecondaryRecorder());
+		graph.setGpuProfiler(&gpuProfiler);
+		graph.execute(commandBuffer, static_cast<uint32_t>(currentFrameIndex));
+	}
+
+	void VkmRenderer::beginDynamicRendering(
+		VkCommandBuffer commandBuffer, const VkClearValue& colorClear, const VkClearValue& depthClear) {
+		// Both attachments start out UNDEFINED (cleared anyway). The color transition waits on the acquire semaphore's
+		// stage, the depth one on the last frame that used the same depth image
+		std::array<VkImageMemoryBarrier, 2> barriers{};
+		barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barriers[0].srcAccessMask = 0;
+		barriers[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].image = vkmSwapChain->getImage(currentImageIndex);
+		barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+		barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barriers[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[1].image = vkmSwapChain->getDepthImage(currentFrameIndex);
+		barriers[1].subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+		VkRenderingAttachmentInfo colorAttachment{};
+		colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		colorAttachment.imageView = vkmSwapChain->getImageView(currentImageIndex);
+		colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.clearValue = colorClear;
+
+		VkRenderingAttachmentInfo depthAttachment{};
+		depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		depthAttachment.imageView = vkmSwapChain->getDepthImageView(currentFrameIndex);
+		depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.clearValue = depthClear;
+
+		VkRenderingInfo renderingInfo{};
+		renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+		renderingInfo.flags = passRecordsSecondaries ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+		renderingInfo.renderArea = { { 0, 0 }, vkmSwapChain->getSwapChainExtent() };
+		renderingInfo.layerCount = 1;
+		renderingInfo.colorAttachmentCount = 1;
+		renderingInfo.pColorAttachments = &colorAttachment;
+		renderingInfo.pDepthAttachment = &depthAttachment;
+		vkCmdBeginRendering(commandBuffer, &renderingInfo);
 	}
 
-} // Namespace vkm
\ No newline at end of file
+} // Namespace vkm
@@ -3,6 +3,10 @@
 #include "vkm_window.h"
 #include "vkm_device.h"
 #include "vkm_swap_chain.h"
+#include "vkm_gpu_profiler.h"
+#include "vkm_latency_tracker.h"
+#include "vkm_render_graph.h"
+#include "vkm_secondary_recorder.h"
 // #include "vkm_model.h"
 
 // Standard Library
@@ -15,19 +19,60 @@ namespace vkm {
 	class VkmRenderer {
 
 	public:
+		// Time from noticing the swap chain is out of date (resize, minimize/restore) to the first frame
+		// submitted on the new one. recreateMs is the part spent creating it
+		struct ResizeStats {
+			uint32_t count = 0;
+			double lastMs = 0.0;
+			double maxMs = 0.0;
+			double lastRecreateMs = 0.0;
+		};
 
-		VkmRenderer(VkmWindow &window, VkmDevice &device);
+		// preferDynamicRendering: begin the swap chain pass with vkCmdBeginRendering when the device supports it,
+		// no VkRenderPass/VkFramebuffers to rebuild on resize and pipelines only depend on the formats
+		VkmRenderer(VkmWindow &window, VkmDevice &device, bool preferDynamicRendering = true);
 		~VkmRenderer();
 
 		VkmRenderer(const VkmWindow &) = delete;
 		VkmRenderer &operator=(const VkmWindow &) = delete;
 
+		// VK_NULL_HANDLE with dynamic rendering, pipelines should be created against getRenderTarget()
 		VkRenderPass getSwapChainRenderPass() const { return vkmSwapChain->getRenderPass(); }
+		VkmRenderTarget getRenderTarget() const {
+			return { vkmSwapChain->getRenderPass(), vkmSwapChain->getSwapChainImageFormat(), vkmSwapChain->getSwapChainDepthFormat() };
+		}
+		bool usesDynamicRendering() const { return dynamicRendering; }
 		bool isFrameInProgress() const { return isFrameStarted; }
+		VkmGpuProfiler& getGpuProfiler() { return gpuProfiler; }
+		const ResizeStats& getResizeStats() const { return resizeStats; }
+
+		// Takes effect on the next beginFrame (the swap chain gets recreated with the mode's policy).
+		// Latency stats start over so they only ever cover one mode
+		void setLatencyMode(VkmLatencyMode mode);
+		VkmLatencyMode getLatencyMode() const { return latencyMode; }
+		// Frame start (right after the app polled input) to the GPU finishing the frame, see VkmLatencyTracker
+		VkmLatencyTracker::Stats getLatencyStats() { return latencyTracker.getStats(); }
+		VkPresentModeKHR getPresentMode() const { return vkmSwapChain->getPresentMode(); }
+		uint32_t getFramesInFlight() const { return vkmSwapChain->getFramesInFlight(); }
+		// The image the frame in progress renders into, in PRESENT_SRC once the swap chain pass ended
+		VkImage getCurrentImage() const {
+			assert(isFrameStarted && "Cannot get the swap chain image when frame not in progress");
+			return vkmSwapChain->getImage(currentImageIndex);
+		}
+		VkFormat getSwapChainImageFormat() const { return vkmSwapChain->getSwapChainImageFormat(); }
+		VkExtent2D getSwapChainExtent() const { return vkmSwapChain->getSwapChainExtent(); }
+		bool canCapture() const { return vkmSwapChain->canCapture(); }
+		VkmSwapChain::DepthMemoryReport getDepthMemoryReport(VkExtent2D extent) const { return vkmSwapChain->depthMemoryReport(extent); }
+
+		// Non null: the swap chain pass takes secondary command buffers recorded on threadPool (render systems
+		// go through getSecondaryRecorder), null records inline into the primary again. Takes effect on the next pass
+		void setParallelRecording(VkmThreadPool* threadPool);
+		// nullptr while recording inline
+		VkmSecondaryRecorder* getSecondaryRecorder() const { return parallelRecording ? secondaryRecorder.get() : nullptr; }
 
 		VkCommandBuffer getCurrentCommandBuffer() const {
 			assert(isFrameStarted && "Cannot get command buffer when frame not in progress");
-			return commandBuffers[currentFrameIndex];
+			return frameCommands[currentFrameIndex].commandBuffer;
 		}
 
 		int getFrameIndex() const {
@@ -35,23 +80,60 @@ namespace vkm {
 			return currentFrameIndex;
 		}
 
+		// nullptr when there is nothing to render into (minimized, or the swap chain was just recreated)
 		VkCommandBuffer beginFrame();
 		void endFrame();
 		void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
 		void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
+
+		// The swap chain image and depth as render graph imports. The image ends up in PRESENT_SRC and is the graph's
+		// output, depth is whatever the current frame slot's is
+		struct SwapChainTargets {
+			VkmRenderGraph::Resource color;
+			VkmRenderGraph::Resource depth;
+		};
+		SwapChainTargets importSwapChain(VkmRenderGraph& graph) const;
+		// Instead of begin/endSwapChainRenderPass, dynamic rendering only. Binds this frame's swap chain image and
+		// depth to targets and keeps the graph's extent, frame slots, recorder and profiler in step with the renderer
+		void executeGraph(VkCommandBuffer commandBuffer, VkmRenderGraph& graph, const SwapChainTargets& targets);
 	private:
+		struct FrameCommands {
+			VkCommandPool pool = VK_NULL_HANDLE; // Transient, reset as a whole once the slot's last frame retired
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		};
+
 		void createCommandBuffers();
 		void freeCommandBuffers();
 		void recreateSwapChain();
+		void markSwapChainOutOfDate();
+		void beginDynamicRendering(VkCommandBuffer commandBuffer, const VkClearValue& colorClear, const VkClearValue& depthClear);
 
 		// ORDER HERE MATTERS
 		VkmWindow& vkmWindow;
 		VkmDevice& vkmDevice;
+		bool dynamicRendering;
 		std::unique_ptr<VkmSwapChain> vkmSwapChain;
-		std::vector<VkCommandBuffer> commandBuffers;
+		// Replaced chains waiting for the current one to present before they're handed to deferDestruction
+		std::vector<std::shared_ptr<VkmSwapChain>> retiredSwapChains;
+		std::vector<FrameCommands> frameCommands; // One per possible frame slot
+		VkmGpuProfiler gpuProfiler{ vkmDevice, VkmSwapChain::MAX_FRAMES_IN_FLIGHT };
+		VkmLatencyTracker latencyTracker{ vkmDevice };
+		VkmLatencyMode latencyMode = VkmLatencyMode::Throughput;
+		uint64_t frameInputNs = 0;
+		// Kept once created, frames still in flight can be using its pools
+		std::unique_ptr<VkmSecondaryRecorder> secondaryRecorder;
+		bool parallelRecording = false;
+		bool passRecordsSecondaries = false; // What the pass in progress was begun with
+		uint32_t frameScope = UINT32_MAX;
+		uint32_t passScope = UINT32_MAX;
+
+		bool swapChainOutOfDate = false; // Recreated by the next beginFrame the window isn't minimized for
+		uint64_t resizeStartNs = UINT64_MAX; // Set until the first frame on the new swap chain is submitted
+		double pendingRecreateMs = 0.0;
+		ResizeStats resizeStats;
 
 		uint32_t currentImageIndex;
-		int currentFrameIndex{ 0 };
+		int currentFrameIndex{ 0 }; // The swap chain's frame slot, there can be fewer than MAX_FRAMES_IN_FLIGHT
 		bool isFrameStarted{ false }; // Should be initially false?
 	};
 } // Namespace vkm
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "vkm_secondary_recorder.h"
+#include "vkm_cpu_profiler.h"
+
+// Standard Libraries
+#include <cassert>
+#include <stdexcept>
+
+namespace vkm {
+
+	VkmSecondaryRecorder::VkmSecondaryRecorder(VkmDevice& device, VkmThreadPool& threadPool, uint32_t frameSlotCount)
+		: device{ device }, threadPool{ threadPool }, framePools(frameSlotCount), resetFrames(frameSlotCount, 0) {}
+
+	VkmSecondaryRecorder::~VkmSecondaryRecorder() {
+		// Freeing the pool frees its buffers
+		for (auto& jobPools : framePools) {
+			for (auto& jobPool : jobPools) {
+				vkDestroyCommandPool(device.device(), jobPool.pool, nullptr);
+			}
+		}
+	}
+
+	void VkmSecondaryRecorder::beginPass(int frameIndex, const VkmRenderTarget& target, VkFramebuffer framebuffer, VkExtent2D extent) {
+		assert(frameIndex >= 0 && frameIndex < static_cast<int>(framePools.size()) && "Frame slot out of range");
+		assert(recorded.empty() && "execute wasn't called for the last pass");
+		this->frameIndex = frameIndex;
+		this->extent = extent;
+
+		inheritance = {};
+		inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance.renderPass = target.renderPass;
+		inheritance.subpass = 0;
+		inheritance.framebuffer = framebuffer;
+		if (target.renderPass == VK_NULL_HANDLE) {
+			colorFormat = target.colorFormat;
+			renderingInheritance = {};
+			renderingInheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+			renderingInheritance.colorAttachmentCount = target.colorAttachmentCount;
+			renderingInheritance.pColorAttachmentFormats = &colorFormat;
+			renderingInheritance.depthAttachmentFormat = target.depthFormat;
+			renderingInheritance.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+			inheritance.pNext = &renderingInheritance;
+		}
+
+		// Only the frame's first pass resets, later passes (render graph) keep allocating after it so the buffers
+		// an earlier pass recorded into stay valid until the frame is submitted
+		const uint64_t frame = device.currentFrame();
+		if (resetFrames[frameIndex] != frame) {
+			resetFrames[frameIndex] = frame;
+			frameBufferCount = 0;
+			// One reset per pool instead of one per buffer, everything allocated from it goes back to initial
+			for (auto& jobPool : framePools[frameIndex]) {
+				vkResetCommandPool(device.device(), jobPool.pool, 0);
+				jobPool.used = 0;
+			}
+		}
+	}
+
+	void VkmSecondaryRecorder::record(uint32_t jobCount, const std::function<void(uint32_t, VkCommandBuffer)>& fn) {
+		VKM_PROFILE_SCOPE("VkmSecondaryRecorder::record");
+		assert(frameIndex >= 0 && "beginPass wasn't called");
+		if (jobCount == 0) {
+			return;
+		}
+
+		// Allocating touches the pool too, so it's done up front on this thread
+		const size_t first = recorded.size();
+		for (uint32_t job = 0; job < jobCount; job++) {
+			recorded.push_back(nextBuffer(jobPool(job)));
+		}
+
+		VkViewport viewport{ 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
+		VkRect2D scissor{ { 0, 0 }, extent };
+		threadPool.parallelFor(jobCount, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t job = begin; job < end; job++) {
+				VKM_PROFILE_SCOPE("record secondary");
+				VkCommandBuffer commandBuffer = recorded[first + job];
+
+				VkCommandBufferBeginInfo beginInfo{};
+				beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+				beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+				beginInfo.pInheritanceInfo = &inheritance;
+				if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to begin recording secondary command buffer!");
+				}
+				// Dynamic state isn't inherited from the primary
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+				fn(job, commandBuffer);
+
+				if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to record secondary command buffer!");
+				}
+			}
+		});
+	}
+
+	void VkmSecondaryRecorder::execute(VkCommandBuffer primary) {
+		if (!recorded.empty()) {
+			vkCmdExecuteCommands(primary, static_cast<uint32_t>(recorded.size()), recorded.data());
+		}
+		frameBufferCount += static_cast<uint32_t>(recorded.size());
+		lastBufferCount = frameBufferCount;
+		recorded.clear();
+		frameIndex = -1;
+	}
+
+	VkmSecondaryRecorder::JobPool& VkmSecondaryRecorder::jobPool(uint32_t job) {
+		std::vector<JobPool>& jobPools = framePools[frameIndex];
+		while (jobPools.size() <= job) {
+			JobPool jobPool;
+			jobPool.pool = device.createCommandPool(); // Transient, reset as a whole, never per buffer
+			jobPools.push_back(std::move(jobPool));
+		}
+		return jobPools[job];
+	}
+
+	VkCommandBuffer VkmSecondaryRecorder::nextBuffer(JobPool& jobPool) {
+		if (jobPool.used == jobPool.buffers.size()) {
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandPool = jobPool.pool;
+			allocInfo.commandBufferCount = 1;
+
+			VkCommandBuffer commandBuffer;
+			if (vkAllocateCommandBuffers(device.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to allocate secondary command buffer!");
+			}
+			jobPool.buffers.push_back(commandBuffer);
+		}
+		return jobPool.buffers[jobPool.used++];
+	}
+
+} // Namespace vkm
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "vkm_device.h"
+#include "vkm_pipeline.h"
+#include "vkm_thread_pool.h"
+
+// Vulkan
+#include <vulkan/vulkan.h>
+
+// Standard Library
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace vkm {
+
+	// Records a render pass' contents as secondary command buffers on the thread pool. Every job index has its own
+	// command pool per frame slot (pools can only be used by one thread at a time), all of a slot's pools are reset
+	// in one go when the slot comes around again. execute replays whatever was recorded in job order,
+	// so the result doesn't depend on which thread got which job
+	class VkmSecondaryRecorder {
+	public:
+		VkmSecondaryRecorder(VkmDevice& device, VkmThreadPool& threadPool, uint32_t frameSlotCount);
+		~VkmSecondaryRecorder();
+
+		VkmSecondaryRecorder(const VkmSecondaryRecorder &) = delete;
+		VkmSecondaryRecorder &operator=(const VkmSecondaryRecorder &) = delete;
+
+		// Right after vkCmdBeginRenderPass with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS (or vkCmdBeginRendering
+		// with the secondary contents flag, then target has no render pass and framebuffer is null). The slot's last
+		// frame has to be done on the GPU, its command buffers get reset by the first pass of a device frame
+		void beginPass(int frameIndex, const VkmRenderTarget& target, VkFramebuffer framebuffer, VkExtent2D extent);
+		// Runs fn(job, commandBuffer) for every job in [0, jobCount) on the pool, each into its own secondary
+		// command buffer that already has the pass' viewport and scissor set. Can be called more than once per pass
+		void record(uint32_t jobCount, const std::function<void(uint32_t, VkCommandBuffer)>& fn);
+		// Every buffer recorded since beginPass, in record/job order. Right before vkCmdEndRenderPass
+		void execute(VkCommandBuffer primary);
+
+		// Enough jobs to keep every thread busy, more than this only adds command buffers
+		uint32_t maxJobCount() const { return threadPool.threadCount() + 1; }
+		// Summed over the passes of the frame so far
+		uint32_t getLastBufferCount() const { return lastBufferCount; }
+
+	private:
+		struct JobPool {
+			VkCommandPool pool = VK_NULL_HANDLE;
+			std::vector<VkCommandBuffer> buffers; // Allocated once, reused after every reset
+			uint32_t used = 0;
+		};
+
+		JobPool& jobPool(uint32_t job);
+		VkCommandBuffer nextBuffer(JobPool& jobPool);
+
+		VkmDevice& device;
+		VkmThreadPool& threadPool;
+		std::vector<std::vector<JobPool>> framePools; // [frame slot][job]
+		std::vector<uint64_t> resetFrames; // Device frame each slot's pools were last reset in
+
+		int frameIndex = -1;
+		VkCommandBufferInheritanceInfo inheritance{};
+		VkCommandBufferInheritanceRenderingInfo renderingInheritance{}; // Chained for dynamic rendering
+		VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent{};
+		std::vector<VkCommandBuffer> recorded;
+		uint32_t frameBufferCount = 0;
+		uint32_t lastBufferCount = 0;
+	};
+
+} // Namespace vkm
@@ -0,0 +1,320 @@
+#include "vkm_staging_ring.h"
+#include "vkm_device.h"
+
+// Standard Libraries
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace vkm {
+
+	// Plenty for vkCmdCopyBuffer and keeps every copy source 16 byte aligned for memcpy
+	static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	VkmStagingRing::VkmStagingRing(VkmDevice& device, VkDeviceSize capacity) : vkmDevice{ device }, ringCapacity{ capacity } {
+		createResources();
+	}
+
+	VkmStagingRing::~VkmStagingRing() {
+		waitIdle();
+
+		// Destroying the pool frees every command buffer allocated from it
+		vkDestroyCommandPool(vkmDevice.device(), commandPool, nullptr);
+		vkDestroySemaphore(vkmDevice.device(), timeline, nullptr);
+		vkmDevice.destroyBuffer(ringBuffer, ringAllocation);
+	}
+
+	void VkmStagingRing::createResources() {
+		vkmDevice.createBuffer(
+			ringCapacity,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			ringBuffer,
+			ringAllocation);
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = vkmDevice.findPhysicalQueueFamilies().transferFamily;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+		if (vkCreateCommandPool(vkmDevice.device(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create staging command pool!");
+		}
+
+		VkSemaphoreTypeCreateInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		timelineInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &timelineInfo;
+
+		if (vkCreateSemaphore(vkmDevice.device(), &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create staging timeline semaphore!");
+		}
+	}
+
+	VkmUploadTicket VkmStagingRing::uploadToBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset) {
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		const char* src = static_cast<const char*>(data);
+		while (size > 0) {
+			// Anything bigger than the ring goes through in ring sized pieces
+			VkDeviceSize chunk = std::min(size, ringCapacity);
+
+			VkDeviceSize offset;
+			VkDeviceSize consumed;
+			while (!reserve(chunk, offset, consumed)) {
+				// Ring is full: push out what we have so far and wait for the oldest batch to free its space
+				if (batchOpen) {
+					submitBatch();
+				}
+				retireCompleted(true);
+			}
+			ensureBatchOpen();
+			currentBatch.ringBytes += consumed;
+
+			memcpy(static_cast<char*>(ringAllocation.mappedData) + offset, src, static_cast<size_t>(chunk));
+
+			VkBufferCopy copyRegion{};
+			copyRegion.srcOffset = offset;
+			copyRegion.dstOffset = dstOffset;
+			copyRegion.size = chunk;
+			vkCmdCopyBuffer(currentBatch.commandBuffer, ringBuffer, dstBuffer, 1, &copyRegion);
+			currentBatch.copyCount++;
+
+			src += chunk;
+			dstOffset += chunk;
+			size -= chunk;
+		}
+		return VkmUploadTicket{ batchOpen ? currentBatch.signalValue : lastSubmittedValue };
+	}
+
+	VkmUploadTicket VkmStagingRing::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		ensureBatchOpen();
+
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = 0;
+		copyRegion.dstOffset = 0;
+		copyRegion.size = size;
+		vkCmdCopyBuffer(currentBatch.commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+		currentBatch.copyCount++;
+		return VkmUploadTicket{ currentBatch.signalValue };
+	}
+
+	VkmUploadTicket VkmStagingRing::copyBufferToImage(
+		VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		ensureBatchOpen();
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = layerCount;
+
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { width, height, 1 };
+
+		vkCmdCopyBufferToImage(
+			currentBatch.commandBuffer,
+			buffer,
+			image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1,
+			&region);
+		currentBatch.copyCount++;
+		return VkmUploadTicket{ currentBatch.signalValue };
+	}
+
+	VkmUploadTicket VkmStagingRing::flush() {
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (batchOpen) {
+			submitBatch();
+		}
+		retireCompleted(false);
+		return VkmUploadTicket{ lastSubmittedValue };
+	}
+
+	void VkmStagingRing::waitIdle() {
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (batchOpen) {
+			submitBatch();
+		}
+		while (!inFlight.empty()) {
+			retireCompleted(true);
+		}
+	}
+
+	bool VkmStagingRing::isComplete(VkmUploadTicket ticket) const {
+		return completedValue() >= ticket.value;
+	}
+
+	void VkmStagingRing::wait(VkmUploadTicket ticket) const {
+		if (isComplete(ticket)) {
+			return;
+		}
+
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &timeline;
+		waitInfo.pValues = &ticket.value;
+		vkWaitSemaphores(vkmDevice.device(), &waitInfo, std::numeric_limits<uint64_t>::max());
+	}
+
+	uint32_t VkmStagingRing::batchesInFlight() const {
+		std::lock_guard<std::mutex> lock{ mutex };
+		return static_cast<uint32_t>(inFlight.size());
+	}
+
+	uint64_t VkmStagingRing::completedValue() const {
+		uint64_t value = 0;
+		vkGetSemaphoreCounterValue(vkmDevice.device(), timeline, &value);
+		return value;
+	}
+
+	bool VkmStagingRing::reserve(VkDeviceSize size, VkDeviceSize& offset, VkDeviceSize& consumed) {
+		if (used == 0) {
+			// Nothing in flight, start over at the front so big uploads don't have to wrap
+			head = tail = 0;
+		} else if (head == tail) {
+			return false; // Completely full
+		}
+
+		VkDeviceSize aligned = alignUp(head, STAGING_ALIGNMENT);
+		if (head >= tail) {
+			// Free space is [head, capacity) plus [0, tail) after wrapping
+			if (aligned + size <= ringCapacity) {
+				offset = aligned;
+			} else if (size <= tail) {
+				aligned = ringCapacity; // The tail end of the ring is skipped and counted as used
+				offset = 0;
+			} else {
+				return false;
+			}
+		} else {
+			if (aligned + size > tail) {
+				return false;
+			}
+			offset = aligned;
+		}
+
+		consumed = (aligned - head) + size;
+		used += consumed;
+		head = offset + size;
+		if (head == ringCapacity) {
+			head = 0;
+		}
+		return true;
+	}
+
+	void VkmStagingRing::ensureBatchOpen() {
+		if (batchOpen) {
+			return;
+		}
+		retireCompleted(false);
+
+		currentBatch = Batch{};
+		currentBatch.commandBuffer = acquireCommandBuffer();
+		// Batches are submitted in the order they are opened, so values stay monotonic
+		currentBatch.signalValue = lastSubmittedValue + 1;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(currentBatch.commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to begin staging command buffer!");
+		}
+		batchOpen = true;
+	}
+
+	void VkmStagingRing::submitBatch() {
+		if (vkEndCommandBuffer(currentBatch.commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record staging command buffer!");
+		}
+
+		// No barrier needed here: whoever consumes the data waits on the timeline semaphore,
+		// and the semaphore signal/wait pair carries the memory dependency across queues
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &currentBatch.signalValue;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &currentBatch.commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &timeline;
+
+		{
+			// The transfer queue can be the graphics queue, which the renderer submits to as well
+			std::lock_guard<std::mutex> queueLock{ vkmDevice.queueMutex() };
+			if (vkQueueSubmit(vkmDevice.transferQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to submit staging batch!");
+			}
+		}
+
+		lastSubmittedValue = currentBatch.signalValue;
+		currentBatch.ringEnd = head;
+		inFlight.push_back(currentBatch);
+		currentBatch = Batch{};
+		batchOpen = false;
+	}
+
+	void VkmStagingRing::retireCompleted(bool waitForOldest) {
+		if (inFlight.empty()) {
+			return;
+		}
+		if (waitForOldest) {
+			wait(VkmUploadTicket{ inFlight.front().signalValue });
+		}
+
+		const uint64_t completed = completedValue();
+		while (!inFlight.empty() && inFlight.front().signalValue <= completed) {
+			Batch& batch = inFlight.front();
+			if (batch.ringBytes > 0) {
+				tail = batch.ringEnd;
+				used -= batch.ringBytes;
+			}
+
+			vkResetCommandBuffer(batch.commandBuffer, 0);
+			freeCommandBuffers.push_back(batch.commandBuffer);
+			inFlight.pop_front();
+		}
+	}
+
+	VkCommandBuffer VkmStagingRing::acquireCommandBuffer() {
+		if (!freeCommandBuffers.empty()) {
+			VkCommandBuffer commandBuffer = freeCommandBuffers.back();
+			freeCommandBuffers.pop_back();
+			return commandBuffer;
+		}
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = commandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(vkmDevice.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate staging command buffer!");
+		}
+		return commandBuffer;
+	}
+
+} // Namespace vkm
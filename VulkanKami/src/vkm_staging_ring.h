@@ -0,0 +1,92 @@
+#pragma once
+
+#include "vkm_allocator.h"
+
+// Standard Library
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace vkm {
+
+	class VkmDevice;
+
+	// Completion token for work that went through the staging ring.
+	// The copies are done once the ring's timeline semaphore reaches value (0 means nothing to wait for)
+	struct VkmUploadTicket {
+		uint64_t value = 0;
+	};
+
+	// Persistently mapped HOST_VISIBLE ring used to get data into DEVICE_LOCAL buffers and images.
+	// Copies are recorded into an open batch and go to the transfer queue as one submission on flush().
+	// Every batch signals the next value of a timeline semaphore, which is also what hands its ring space back
+	class VkmStagingRing {
+	public:
+		static constexpr VkDeviceSize DEFAULT_CAPACITY = 32ull * 1024 * 1024;
+
+		VkmStagingRing(VkmDevice& device, VkDeviceSize capacity = DEFAULT_CAPACITY);
+		~VkmStagingRing();
+
+		VkmStagingRing(const VkmStagingRing &) = delete;
+		VkmStagingRing &operator=(const VkmStagingRing &) = delete;
+
+		// Copies data into the ring and records a copy into dstBuffer. Nothing is submitted until flush()
+		VkmUploadTicket uploadToBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+		// Record GPU side copies into the open batch (dstImage must already be in TRANSFER_DST_OPTIMAL)
+		VkmUploadTicket copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+		// The image has to be CONCURRENT with the transfer family (VkmDevice::createImageWithInfo does that for
+		// TRANSFER_DST images), nothing here transfers ownership
+		VkmUploadTicket copyBufferToImage(
+			VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
+
+		// Submits everything recorded since the last flush as a single batch,
+		// the returned ticket covers every ticket handed out before the call
+		VkmUploadTicket flush();
+		// Blocks until every submitted batch is done (shutdown, tests)
+		void waitIdle();
+
+		bool isComplete(VkmUploadTicket ticket) const;
+		void wait(VkmUploadTicket ticket) const;
+
+		VkSemaphore timelineSemaphore() const { return timeline; }
+		VkDeviceSize capacity() const { return ringCapacity; }
+		uint32_t batchesInFlight() const;
+
+	private:
+		struct Batch {
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			uint64_t signalValue = 0;
+			VkDeviceSize ringEnd = 0; // Where the ring head was when the batch closed
+			VkDeviceSize ringBytes = 0; // Ring space the batch holds (alignment and wrap waste included)
+			uint32_t copyCount = 0;
+		};
+
+		void createResources();
+		bool reserve(VkDeviceSize size, VkDeviceSize& offset, VkDeviceSize& consumed);
+		void ensureBatchOpen();
+		void submitBatch();
+		void retireCompleted(bool waitForOldest);
+		VkCommandBuffer acquireCommandBuffer();
+		uint64_t completedValue() const;
+
+		VkmDevice& vkmDevice;
+		VkDeviceSize ringCapacity;
+
+		VkBuffer ringBuffer = VK_NULL_HANDLE;
+		VkmAllocation ringAllocation;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkSemaphore timeline = VK_NULL_HANDLE;
+
+		mutable std::mutex mutex;
+		VkDeviceSize head = 0;
+		VkDeviceSize tail = 0;
+		VkDeviceSize used = 0;
+
+		bool batchOpen = false;
+		Batch currentBatch;
+		uint64_t lastSubmittedValue = 0;
+		std::deque<Batch> inFlight;
+		std::vector<VkCommandBuffer> freeCommandBuffers; // Retired command buffers ready for reuse
+	};
+
+} // Namespace vkm
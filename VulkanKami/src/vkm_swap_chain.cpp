@@ -1,5 +1,7 @@
 #include "vkm_swap_chain.h"
+#include "vkm_cpu_profiler.h"
 // std
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <cstring>
@@ -10,25 +12,78 @@
 
 namespace vkm {
 
-VkmSwapChain::VkmSwapChain(VkmDevice &deviceRef, VkExtent2D extent)
-    : device{deviceRef}, windowExtent{extent} {
+VkmPresentPolicy VkmPresentPolicy::forMode(VkmLatencyMode mode) {
+  switch (mode) {
+    case VkmLatencyMode::LowLatency:
+      // Nothing queued up: the CPU waits for the GPU every frame and frames go out the moment they're done
+      return {1, {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR}, 0};
+    case VkmLatencyMode::PowerSave:
+      // Capped at the refresh rate, relaxed so a late frame tears instead of waiting a whole extra vblank
+      return {2, {VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR}, 1};
+    case VkmLatencyMode::Throughput:
+    default:
+      return {3, {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR}, 2};
+  }
+}
+
+const char *VkmPresentPolicy::modeName(VkmLatencyMode mode) {
+  switch (mode) {
+    case VkmLatencyMode::LowLatency:
+      return "low latency";
+    case VkmLatencyMode::PowerSave:
+      return "power save";
+    case VkmLatencyMode::Throughput:
+    default:
+      return "throughput";
+  }
+}
+
+VkmSwapChain::VkmSwapChain(
+    VkmDevice &deviceRef, VkExtent2D extent, const VkmPresentPolicy &policy, bool dynamicRendering)
+    : device{deviceRef}, windowExtent{extent}, policy{policy}, framesInFlight{policy.framesInFlight},
+      dynamicRendering{dynamicRendering} {
 	init();
 }
-VkmSwapChain::VkmSwapChain(VkmDevice &deviceRef, VkExtent2D extent, std::shared_ptr<VkmSwapChain> previous)
-	: device{ deviceRef }, windowExtent{ extent }, oldSwapChain{ previous } {
+VkmSwapChain::VkmSwapChain(
+	VkmDevice &deviceRef,
+	VkExtent2D extent,
+	const VkmPresentPolicy &policy,
+	bool dynamicRendering,
+	std::shared_ptr<VkmSwapChain> previous)
+	: device{ deviceRef }, windowExtent{ extent }, policy{ policy }, framesInFlight{ policy.framesInFlight },
+	dynamicRendering{ dynamicRendering }, oldSwapChain{ previous } {
 	init();
+	adoptSyncObjects(*previous);
 
 	// old swap chain isnt needed after init()
 	oldSwapChain = nullptr;
 }
 
 void VkmSwapChain::init() {
+	if (framesInFlight < 1 || framesInFlight > MAX_FRAMES_IN_FLIGHT) {
+		throw std::runtime_error("Frames in flight must be between 1 and MAX_FRAMES_IN_FLIGHT!");
+	}
 	createSwapChain();
 	createImageViews();
-	createRenderPass();
+	// Same formats means a compatible render pass, keeping the old one means pipelines and anything else
+	// holding getRenderPass() stay valid across resizes
+	if (dynamicRendering) {
+		swapChainDepthFormat = findDepthFormat(); // Pipelines only need the formats
+	} else if (oldSwapChain != nullptr && oldSwapChain->renderPass != VK_NULL_HANDLE &&
+		oldSwapChain->swapChainImageFormat == swapChainImageFormat &&
+		oldSwapChain->swapChainDepthFormat == findDepthFormat()) {
+		renderPass = oldSwapChain->renderPass;
+		oldSwapChain->renderPass = VK_NULL_HANDLE;
+	} else {
+		createRenderPass();
+	}
 	createDepthResources();
-	createFramebuffers();
-	createSyncObjects();
+	if (!dynamicRendering) {
+		createFramebuffers();
+	}
+	if (oldSwapChain == nullptr) {
+		createSyncObjects();
+	}
 }
 
 VkmSwapChain::~VkmSwapChain() {
@@ -44,31 +99,34 @@ VkmSwapChain::~VkmSwapChain() {
 
   for (int i = 0; i < depthImages.size(); i++) {
     vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
-    vkDestroyImage(device.device(), depthImages[i], nullptr);
-    vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
+    device.destroyImage(depthImages[i], depthImageAllocations[i]);
   }
 
   for (auto framebuffer : swapChainFramebuffers) {
     vkDestroyFramebuffer(device.device(), framebuffer, nullptr);
   }
 
-  vkDestroyRenderPass(device.device(), renderPass, nullptr);
+  if (renderPass != VK_NULL_HANDLE) {
+    vkDestroyRenderPass(device.device(), renderPass, nullptr);
+  }
 
-  // cleanup synchronization objects
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  // cleanup synchronization objects (empty when a newer swap chain took them over)
+  for (size_t i = 0; i < imageAvailableSemaphores.size(); i++) {
     vkDestroySemaphore(device.device(), renderFinishedSemaphores[i], nullptr);
     vkDestroySemaphore(device.device(), imageAvailableSemaphores[i], nullptr);
-    vkDestroyFence(device.device(), inFlightFences[i], nullptr);
   }
 }
 
 VkResult VkmSwapChain::acquireNextImage(uint32_t *imageIndex) {
-  vkWaitForFences(
-      device.device(),
-      1,
-      &inFlightFences[currentFrame],
-      VK_TRUE,
-      std::numeric_limits<uint64_t>::max());
+  VKM_PROFILE_SCOPE("acquireNextImage");
+  {
+    // The frame that used this slot (semaphores, the renderer's command buffer) last
+    VKM_PROFILE_SCOPE("wait for frame slot");
+    const uint64_t frame = device.currentFrame();
+    if (frame > framesInFlight) {
+      device.waitForFrame(frame - framesInFlight);
+    }
+  }
 
   VkResult result = vkAcquireNextImageKHR(
       device.device(),
@@ -83,31 +141,58 @@ VkResult VkmSwapChain::acquireNextImage(uint32_t *imageIndex) {
 
 VkResult VkmSwapChain::submitCommandBuffers(
     const VkCommandBuffer *buffers, uint32_t *imageIndex) {
-  if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
-    vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
+  VKM_PROFILE_SCOPE("submitCommandBuffers");
+  // Images can come back out of order (more images than frames in flight)
+  const uint64_t frame = device.currentFrame();
+  {
+    VKM_PROFILE_SCOPE("wait for image frame");
+    device.waitForFrame(imageFrames[*imageIndex]);
   }
-  imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
+  imageFrames[*imageIndex] = frame;
 
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-  VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
+  // Uploads used for the first time this frame are waited on by the GPU, vertex input is the
+  // earliest stage that reads them. The value for the binary acquire semaphore is ignored
+  VkmUploadTicket uploadWait = device.takePendingUploadWait();
+  VkSemaphore waitSemaphores[] = {
+      imageAvailableSemaphores[currentFrame],
+      device.uploadTimelineSemaphore()};
+  VkPipelineStageFlags waitStages[] = {
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
+  uint64_t waitValues[] = {0, uploadWait.value};
+  submitInfo.waitSemaphoreCount = uploadWait.value > 0 ? 2 : 1;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
 
+  // Binary semaphore for present, the frame's number on the device's frame timeline for everything else
+  VkSemaphore signalSemaphores[] = {
+      renderFinishedSemaphores[currentFrame],
+      device.frameTimelineSemaphore()};
+  uint64_t signalValues[] = {0, frame};
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+  timelineInfo.pWaitSemaphoreValues = waitValues;
+  timelineInfo.signalSemaphoreValueCount = 2;
+  timelineInfo.pSignalSemaphoreValues = signalValues;
+  submitInfo.pNext = &timelineInfo;
+
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = buffers;
 
-  VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.signalSemaphoreCount = 2;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
-  if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
-      VK_SUCCESS) {
-    throw std::runtime_error("failed to submit draw command buffer!");
+  std::lock_guard<std::mutex> queueLock{device.queueMutex()};
+  {
+    VKM_PROFILE_SCOPE("vkQueueSubmit");
+    if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit draw command buffer!");
+    }
   }
 
   VkPresentInfoKHR presentInfo = {};
@@ -122,9 +207,13 @@ VkResult VkmSwapChain::submitCommandBuffers(
 
   presentInfo.pImageIndices = imageIndex;
 
-  auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
+  VkResult result;
+  {
+    VKM_PROFILE_SCOPE("vkQueuePresentKHR");
+    result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
+  }
 
-  currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+  currentFrame = (currentFrame + 1) % framesInFlight;
 
   return result;
 }
@@ -133,10 +222,10 @@ void VkmSwapChain::createSwapChain() {
   SwapChainSupportDetails swapChainSupport = device.getSwapChainSupport();
 
   VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-  VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+  presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
   VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + policy.extraImages;
   if (swapChainSupport.capabilities.maxImageCount > 0 &&
       imageCount > swapChainSupport.capabilities.maxImageCount) {
     imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -152,6 +241,11 @@ void VkmSwapChain::createSwapChain() {
   createInfo.imageExtent = extent;
   createInfo.imageArrayLayers = 1;
   createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  // Frame capture copies out of the images
+  if (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+    createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    supportsCapture = true;
+  }
 
   QueueFamilyIndices indices = device.findPhysicalQueueFamilies();
   uint32_t queueFamilyIndices[] = {indices.graphicsFamily, indices.presentFamily};
@@ -274,61 +368,72 @@ void VkmSwapChain::createRenderPass() {
 }
 
 void VkmSwapChain::createFramebuffers() {
-  swapChainFramebuffers.resize(imageCount());
-  for (size_t i = 0; i < imageCount(); i++) {
-    std::array<VkImageView, 2> attachments = {swapChainImageViews[i], depthImageViews[i]};
-
-    VkExtent2D swapChainExtent = getSwapChainExtent();
-    VkFramebufferCreateInfo framebufferInfo = {};
-    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    framebufferInfo.renderPass = renderPass;
-    framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-    framebufferInfo.pAttachments = attachments.data();
-    framebufferInfo.width = swapChainExtent.width;
-    framebufferInfo.height = swapChainExtent.height;
-    framebufferInfo.layers = 1;
-
-    if (vkCreateFramebuffer(
-            device.device(),
-            &framebufferInfo,
-            nullptr,
-            &swapChainFramebuffers[i]) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create framebuffer!");
+  // Depth belongs to the frame slot and color to the image, so one framebuffer per combination
+  swapChainFramebuffers.resize(framesInFlight * imageCount());
+  for (size_t slot = 0; slot < framesInFlight; slot++) {
+    for (size_t i = 0; i < imageCount(); i++) {
+      std::array<VkImageView, 2> attachments = {swapChainImageViews[i], depthImageViews[slot]};
+
+      VkExtent2D swapChainExtent = getSwapChainExtent();
+      VkFramebufferCreateInfo framebufferInfo = {};
+      framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+      framebufferInfo.renderPass = renderPass;
+      framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+      framebufferInfo.pAttachments = attachments.data();
+      framebufferInfo.width = swapChainExtent.width;
+      framebufferInfo.height = swapChainExtent.height;
+      framebufferInfo.layers = 1;
+
+      if (vkCreateFramebuffer(
+              device.device(),
+              &framebufferInfo,
+              nullptr,
+              &swapChainFramebuffers[slot * imageCount() + i]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create framebuffer!");
+      }
     }
   }
 }
 
+VkImageCreateInfo VkmSwapChain::depthImageInfo(VkFormat format, VkExtent2D extent) {
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = extent.width;
+  imageInfo.extent.height = extent.height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = format;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  // Cleared at the start of the pass and never stored, so it can live in tile memory only
+  imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.flags = 0;
+  return imageInfo;
+}
+
 void VkmSwapChain::createDepthResources() {
   VkFormat depthFormat = findDepthFormat();
   swapChainDepthFormat = depthFormat;
   VkExtent2D swapChainExtent = getSwapChainExtent();
 
-  depthImages.resize(imageCount());
-  depthImageMemorys.resize(imageCount());
-  depthImageViews.resize(imageCount());
+  // Only the frames in flight can be rendering at once, images beyond that are just waiting to be presented
+  depthImages.resize(framesInFlight);
+  depthImageAllocations.resize(framesInFlight);
+  depthImageViews.resize(framesInFlight);
 
   for (int i = 0; i < depthImages.size(); i++) {
-    VkImageCreateInfo imageInfo{};
-    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageInfo.extent.width = swapChainExtent.width;
-    imageInfo.extent.height = swapChainExtent.height;
-    imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
-    imageInfo.format = depthFormat;
-    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    imageInfo.flags = 0;
+    VkImageCreateInfo imageInfo = depthImageInfo(depthFormat, swapChainExtent);
 
     device.createImageWithInfo(
         imageInfo,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
         depthImages[i],
-        depthImageMemorys[i]);
+        depthImageAllocations[i],
+        VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
 
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -347,30 +452,93 @@ void VkmSwapChain::createDepthResources() {
   }
 }
 
+VkmSwapChain::DepthMemoryReport VkmSwapChain::depthMemoryReport(VkExtent2D extent) {
+  // A throwaway image gives this driver's real size (alignment, compression metadata), no memory is bound to it
+  VkImageCreateInfo imageInfo = depthImageInfo(swapChainDepthFormat, extent);
+  VkImage image;
+  if (vkCreateImage(device.device(), &imageInfo, nullptr, &image) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create image!");
+  }
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(device.device(), image, &requirements);
+  vkDestroyImage(device.device(), image, nullptr);
+
+  DepthMemoryReport report{};
+  report.extent = extent;
+  report.bytesPerImage = requirements.size;
+  report.imageCount = static_cast<uint32_t>(imageCount());
+  report.framesInFlight = framesInFlight;
+  report.lazilyAllocated = !depthImageAllocations.empty() &&
+      (device.getMemoryPropertyFlags(depthImageAllocations[0].memoryType) &
+       VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+  return report;
+}
+
+std::ostream &operator<<(std::ostream &os, const VkmSwapChain::DepthMemoryReport &report) {
+  auto megabytes = [](VkDeviceSize bytes) { return bytes / (1024.0 * 1024.0); };
+  const VkDeviceSize perImage = report.bytesPerImage * report.imageCount;
+  const VkDeviceSize perFrame = report.bytesPerImage * report.framesInFlight;
+  os << "depth at " << report.extent.width << "x" << report.extent.height << ": " << megabytes(report.bytesPerImage)
+     << " MB each, one per swap chain image (" << report.imageCount << ") " << megabytes(perImage)
+     << " MB, one per frame in flight (" << report.framesInFlight << ") " << megabytes(perFrame) << " MB, saves "
+     << megabytes(perImage - std::min(perImage, perFrame)) << " MB";
+  if (report.lazilyAllocated) {
+    os << " (lazily allocated, close to nothing is actually backed on tiled GPUs)";
+  }
+  return os;
+}
+
 void VkmSwapChain::createSyncObjects() {
-  imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-  imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
+  const size_t existing = imageAvailableSemaphores.size();
+  imageAvailableSemaphores.resize(framesInFlight);
+  renderFinishedSemaphores.resize(framesInFlight);
+  imageFrames.resize(imageCount(), 0);
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (size_t i = existing; i < framesInFlight; i++) {
     if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) !=
             VK_SUCCESS ||
         vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) !=
-            VK_SUCCESS ||
-        vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+            VK_SUCCESS) {
       throw std::runtime_error("failed to create synchronization objects for a frame!");
     }
   }
 }
 
+void VkmSwapChain::adoptSyncObjects(VkmSwapChain &previous) {
+  imageAvailableSemaphores = std::move(previous.imageAvailableSemaphores);
+  renderFinishedSemaphores = std::move(previous.renderFinishedSemaphores);
+  previous.imageAvailableSemaphores.clear();
+  previous.renderFinishedSemaphores.clear();
+  imageFrames.resize(imageCount(), 0);
+  if (previous.framesInFlight == framesInFlight) {
+    currentFrame = previous.currentFrame;
+    return;
+  }
+
+  // Slots map to frames differently now, so everything already submitted has to be done first.
+  // Only happens when the latency mode changes, and it's a wait on the frame clock, not the whole device
+  {
+    VKM_PROFILE_SCOPE("wait for frames in flight");
+    device.waitForFrame(device.currentFrame() - 1);
+  }
+  currentFrame = 0;
+  // A present can still be waiting on a leftover semaphore
+  while (imageAvailableSemaphores.size() > framesInFlight) {
+    device.deferDestruction([vkDevice = device.device(),
+                             imageAvailable = imageAvailableSemaphores.back(),
+                             renderFinished = renderFinishedSemaphores.back()]() {
+      vkDestroySemaphore(vkDevice, imageAvailable, nullptr);
+      vkDestroySemaphore(vkDevice, renderFinished, nullptr);
+    });
+    imageAvailableSemaphores.pop_back();
+    renderFinishedSemaphores.pop_back();
+  }
+  createSyncObjects();
+}
+
 VkSurfaceFormatKHR VkmSwapChain::chooseSwapSurfaceFormat(
     const std::vector<VkSurfaceFormatKHR> &availableFormats) {
   for (const auto &availableFormat : availableFormats) {
@@ -385,22 +553,33 @@ VkSurfaceFormatKHR VkmSwapChain::chooseSwapSurfaceFormat(
 
 VkPresentModeKHR VkmSwapChain::chooseSwapPresentMode(
     const std::vector<VkPresentModeKHR> &availablePresentModes) {
-  for (const auto &availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      std::cout << "Present mode: Mailbox" << std::endl;
-      return availablePresentMode;
+  VkPresentModeKHR chosen = VK_PRESENT_MODE_FIFO_KHR;  // Always supported
+  for (VkPresentModeKHR preferred : policy.presentModes) {
+    if (std::find(availablePresentModes.begin(), availablePresentModes.end(), preferred) !=
+        availablePresentModes.end()) {
+      chosen = preferred;
+      break;
     }
   }
 
-  // for (const auto &availablePresentMode : availablePresentModes) {
-  //   if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-  //     std::cout << "Present mode: Immediate" << std::endl;
-  //     return availablePresentMode;
-  //   }
-  // }
+  std::cout << "Present mode: " << presentModeName(chosen) << ", " << framesInFlight
+            << " frame(s) in flight" << std::endl;
+  return chosen;
+}
 
-  std::cout << "Present mode: V-Sync" << std::endl;
-  return VK_PRESENT_MODE_FIFO_KHR;
+const char *VkmSwapChain::presentModeName(VkPresentModeKHR mode) {
+  switch (mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "Immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "Mailbox";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "V-Sync (relaxed)";
+    case VK_PRESENT_MODE_FIFO_KHR:
+      return "V-Sync";
+    default:
+      return "Other";
+  }
 }
 
 VkExtent2D VkmSwapChain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) {
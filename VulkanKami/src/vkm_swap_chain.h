@@ -7,36 +7,88 @@
 
 // std lib headers
 #include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 
 namespace vkm {
 
+enum class VkmLatencyMode { LowLatency, Throughput, PowerSave };
+
+// Frames in flight, present mode and image count picked together, they only make sense as a set
+// (mailbox with one frame in flight starves the queue, FIFO with four just stacks up latency)
+struct VkmPresentPolicy {
+  uint32_t framesInFlight;
+  std::vector<VkPresentModeKHR> presentModes;  // First one the surface supports wins, FIFO always works
+  uint32_t extraImages;                        // On top of the surface's minImageCount
+
+  static VkmPresentPolicy forMode(VkmLatencyMode mode);
+  static const char *modeName(VkmLatencyMode mode);
+};
+
 class VkmSwapChain {
  public:
-  static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-  VkmSwapChain(VkmDevice &deviceRef, VkExtent2D windowExtent);
-  VkmSwapChain(VkmDevice &deviceRef, VkExtent2D windowExtent, std::shared_ptr<VkmSwapChain> previous);
+  // Upper bound for frames in flight, per frame arrays elsewhere are sized for this many
+  static constexpr int MAX_FRAMES_IN_FLIGHT = 4;
+
+  // dynamicRendering: no render pass or framebuffers, the renderer begins rendering on the image views
+  // directly and handles the layout transitions itself
+  VkmSwapChain(
+      VkmDevice &deviceRef, VkExtent2D windowExtent, const VkmPresentPolicy &policy, bool dynamicRendering);
+  // Takes over previous' per frame semaphores and frame slot (frames submitted on the old chain are still waited
+  // on through the device's frame timeline), and its render pass when the formats didn't change. previous can be destroyed once this chain has presented and those frames retire (see VkmRenderer::endFrame).
+  // A different frames in flight count waits for every submitted frame first, so frame slots start over
+  VkmSwapChain(
+      VkmDevice &deviceRef,
+      VkExtent2D windowExtent,
+      const VkmPresentPolicy &policy,
+      bool dynamicRendering,
+      std::shared_ptr<VkmSwapChain> previous);
   ~VkmSwapChain();
 
   VkmSwapChain(const VkmSwapChain &) = delete;
   VkmSwapChain operator=(const VkmSwapChain &) = delete;
 
-  VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
+  // Render pass mode only
+  VkFramebuffer getFrameBuffer(int imageIndex, int frameSlot) {
+    return swapChainFramebuffers[frameSlot * imageCount() + imageIndex];
+  }
   VkRenderPass getRenderPass() { return renderPass; }
   VkImageView getImageView(int index) { return swapChainImageViews[index]; }
+  VkImage getImage(int index) { return swapChainImages[index]; }
+  // Depth is per frame slot (getCurrentFrame), not per image
+  VkImage getDepthImage(int frameSlot) { return depthImages[frameSlot]; }
+  VkImageView getDepthImageView(int frameSlot) { return depthImageViews[frameSlot]; }
+  VkFormat getSwapChainDepthFormat() { return swapChainDepthFormat; }
+  bool usesDynamicRendering() const { return dynamicRendering; }
+  // Images were created with TRANSFER_SRC usage (surfaces don't have to allow it)
+  bool canCapture() const { return supportsCapture; }
   size_t imageCount() { return swapChainImages.size(); }
   VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
   VkExtent2D getSwapChainExtent() { return swapChainExtent; }
   uint32_t width() { return swapChainExtent.width; }
   uint32_t height() { return swapChainExtent.height; }
+  uint32_t getFramesInFlight() const { return framesInFlight; }
+  // Frame slot the next acquire/submit uses, in [0, getFramesInFlight())
+  uint32_t getCurrentFrame() const { return static_cast<uint32_t>(currentFrame); }
+  VkPresentModeKHR getPresentMode() const { return presentMode; }
+  static const char *presentModeName(VkPresentModeKHR mode);
 
   float extentAspectRatio() {
     return static_cast<float>(swapChainExtent.width) / static_cast<float>(swapChainExtent.height);
   }
   VkFormat findDepthFormat();
 
+  // What depth costs at extent with one image per swap chain image vs one per frame in flight
+  struct DepthMemoryReport {
+    VkExtent2D extent;
+    VkDeviceSize bytesPerImage;
+    uint32_t imageCount;
+    uint32_t framesInFlight;
+    bool lazilyAllocated;  // This swap chain's depth got LAZILY_ALLOCATED memory
+  };
+  DepthMemoryReport depthMemoryReport(VkExtent2D extent);
+
   VkResult acquireNextImage(uint32_t *imageIndex);
   VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
 
@@ -50,9 +102,12 @@ class VkmSwapChain {
   void createSwapChain();
   void createImageViews();
   void createDepthResources();
+  VkImageCreateInfo depthImageInfo(VkFormat format, VkExtent2D extent);
   void createRenderPass();
   void createFramebuffers();
+  // Creates semaphores until there are framesInFlight of each
   void createSyncObjects();
+  void adoptSyncObjects(VkmSwapChain &previous);
 
   // Helper functions
   VkSurfaceFormatKHR chooseSwapSurfaceFormat(
@@ -65,26 +120,32 @@ class VkmSwapChain {
   VkFormat swapChainDepthFormat;
   VkExtent2D swapChainExtent;
 
-  std::vector<VkFramebuffer> swapChainFramebuffers;
-  VkRenderPass renderPass;
+  std::vector<VkFramebuffer> swapChainFramebuffers;  // [frame slot * imageCount + image]
+  VkRenderPass renderPass = VK_NULL_HANDLE;  // Handed on to the next swap chain when the formats match
 
-  std::vector<VkImage> depthImages;
-  std::vector<VkDeviceMemory> depthImageMemorys;
+  std::vector<VkImage> depthImages;  // One per frame in flight
+  std::vector<VkmAllocation> depthImageAllocations;
   std::vector<VkImageView> depthImageViews;
   std::vector<VkImage> swapChainImages;
   std::vector<VkImageView> swapChainImageViews;
 
   VkmDevice &device;
   VkExtent2D windowExtent;
+  VkmPresentPolicy policy;
+  uint32_t framesInFlight;
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+  bool dynamicRendering;
+  bool supportsCapture = false;
 
   VkSwapchainKHR swapChain;
   std::shared_ptr<VkmSwapChain> oldSwapChain;
 
   std::vector<VkSemaphore> imageAvailableSemaphores;
   std::vector<VkSemaphore> renderFinishedSemaphores;
-  std::vector<VkFence> inFlightFences;
-  std::vector<VkFence> imagesInFlight;
+  std::vector<uint64_t> imageFrames;  // Last frame (device frame timeline) that rendered into each image
   size_t currentFrame = 0;
 };
 
+std::ostream &operator<<(std::ostream &os, const VkmSwapChain::DepthMemoryReport &report);
+
 }  // namespace vkm
@@ -0,0 +1,133 @@
+#include "vkm_thread_pool.h"
+#include "vkm_cpu_profiler.h"
+
+// Standard Libraries
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+namespace vkm {
+
+	VkmThreadPool::VkmThreadPool(uint32_t threadCount) {
+		if (threadCount == 0) {
+			uint32_t hardwareThreads = std::thread::hardware_concurrency();
+			threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+		}
+
+		workers.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; i++) {
+			workers.emplace_back([this, i]() {
+				VkmCpuProfiler::get().setThreadName("worker " + std::to_string(i));
+				workerLoop();
+			});
+		}
+	}
+
+	VkmThreadPool::~VkmThreadPool() {
+		// Queued jobs still run, anything holding a future expects it to be fulfilled
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+		}
+		jobAvailable.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	void VkmThreadPool::enqueue(std::function<void()> job) {
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			jobs.push_back(std::move(job));
+		}
+		jobAvailable.notify_one();
+	}
+
+	void VkmThreadPool::workerLoop() {
+		while (true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock{ mutex };
+				jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+				if (jobs.empty()) {
+					return; // Stopping and nothing left to do
+				}
+				job = std::move(jobs.front());
+				jobs.pop_front();
+				activeJobs++;
+			}
+
+			job();
+
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				activeJobs--;
+				if (activeJobs == 0 && jobs.empty()) {
+					idle.notify_all();
+				}
+			}
+		}
+	}
+
+	void VkmThreadPool::waitIdle() {
+		std::unique_lock<std::mutex> lock{ mutex };
+		idle.wait(lock, [this]() { return activeJobs == 0 && jobs.empty(); });
+	}
+
+	void VkmThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& fn, uint32_t minRangeSize) {
+		if (count == 0) {
+			return;
+		}
+
+		// A few ranges per thread so one slow range doesn't leave everyone else waiting
+		const uint32_t participants = threadCount() + 1;
+		const uint32_t rangeSize = std::max(minRangeSize, (count + participants * 4 - 1) / (participants * 4));
+		const uint32_t rangeCount = (count + rangeSize - 1) / rangeSize;
+		if (rangeCount == 1) {
+			fn(0, count);
+			return;
+		}
+
+		// Workers and the caller grab ranges off a shared counter until they run out
+		auto nextRange = std::make_shared<std::atomic<uint32_t>>(0);
+		auto runRanges = [nextRange, rangeCount, rangeSize, count, &fn]() {
+			uint32_t range;
+			while ((range = nextRange->fetch_add(1)) < rangeCount) {
+				uint32_t begin = range * rangeSize;
+				fn(begin, std::min(begin + rangeSize, count));
+			}
+		};
+
+		const uint32_t helperCount = std::min(threadCount(), rangeCount - 1);
+		std::vector<std::future<void>> helpers;
+		helpers.reserve(helperCount);
+		// The helpers call fn by reference, so nothing may leave this function while one is still running
+		std::exception_ptr error;
+		try {
+			for (uint32_t i = 0; i < helperCount; i++) {
+				helpers.push_back(submit(runRanges));
+			}
+			runRanges();
+		}
+		catch (...) {
+			error = std::current_exception();
+			nextRange->store(rangeCount); // No new ranges for anyone
+		}
+
+		for (auto& helper : helpers) {
+			try {
+				helper.get(); // Rethrows anything a range threw
+			}
+			catch (...) {
+				if (!error) {
+					error = std::current_exception();
+					nextRange->store(rangeCount);
+				}
+			}
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+} // Namespace vkm
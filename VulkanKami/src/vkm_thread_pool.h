@@ -0,0 +1,62 @@
+#pragma once
+
+// Standard Library
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace vkm {
+
+	// Fixed set of worker threads pulling jobs off one shared queue.
+	// Used for anything that shouldn't run on the main thread (pipeline builds etc)
+	class VkmThreadPool {
+	public:
+		// 0 picks hardware_concurrency - 1 so the main thread keeps a core to itself
+		explicit VkmThreadPool(uint32_t threadCount = 0);
+		~VkmThreadPool();
+
+		VkmThreadPool(const VkmThreadPool &) = delete;
+		VkmThreadPool &operator=(const VkmThreadPool &) = delete;
+
+		// Queues job and returns a future for its result. Exceptions thrown by the job end up in the future
+		template<typename F>
+		auto submit(F&& job) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+			using Result = std::invoke_result_t<std::decay_t<F>>;
+			// packaged_task is move only and std::function needs something copyable, hence the shared_ptr
+			auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+			std::future<Result> future = task->get_future();
+			enqueue([task]() { (*task)(); });
+			return future;
+		}
+
+		// Splits [0, count) into ranges and runs fn(begin, end) on the workers and the calling thread.
+		// Returns once every range is done. Don't call it from inside a pool job, the caller has to be free to help out
+		void parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& fn, uint32_t minRangeSize = 1);
+
+		// Blocks until the queue is empty and no job is running
+		void waitIdle();
+
+		uint32_t threadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+	private:
+		void enqueue(std::function<void()> job);
+		void workerLoop();
+
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> jobs;
+
+		std::mutex mutex;
+		std::condition_variable jobAvailable;
+		std::condition_variable idle;
+		uint32_t activeJobs = 0;
+		bool stopping = false;
+	};
+
+} // Namespace vkm
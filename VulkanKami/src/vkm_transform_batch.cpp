@@ -0,0 +1,246 @@
+#include "vkm_transform_batch.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/gtc/constants.hpp>
+
+// Standard Libraries
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VKM_TRANSFORM_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC lets any function use any intrinsic, GCC/Clang need the instruction set enabled per function
+#if defined(VKM_TRANSFORM_X86) && (defined(__GNUC__) || defined(__clang__))
+#define VKM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define VKM_TARGET_AVX2
+#endif
+
+namespace vkm {
+
+	static constexpr uint32_t PADDING = 8; // Widest kernel's lane count
+
+	// Cephes style sincos constants (the same ones sse_mathfun uses). Range reduction to [-pi/4, pi/4]
+	// in three steps for extra precision, then a polynomial each for sin and cos
+	static constexpr float FOUR_OVER_PI = 1.27323954473516f;
+	static constexpr float DP1 = -0.78515625f;
+	static constexpr float DP2 = -2.4187564849853515625e-4f;
+	static constexpr float DP3 = -3.77489497744594108e-8f;
+	static constexpr float SIN_P0 = -1.9515295891e-4f;
+	static constexpr float SIN_P1 = 8.3321608736e-3f;
+	static constexpr float SIN_P2 = -1.6666654611e-1f;
+	static constexpr float COS_P0 = 2.443315711809948e-5f;
+	static constexpr float COS_P1 = -1.388731625493765e-3f;
+	static constexpr float COS_P2 = 4.166664568298827e-2f;
+
+	static void computeScalar(VkmTransformBatch& batch, uint32_t count) {
+		for (uint32_t i = 0; i < count; i++) {
+			const float s = std::sin(batch.rotation[i]);
+			const float c = std::cos(batch.rotation[i]);
+			batch.col0x[i] = c * batch.scaleX[i];
+			batch.col0y[i] = s * batch.scaleX[i];
+			batch.col1x[i] = -s * batch.scaleY[i];
+			batch.col1y[i] = c * batch.scaleY[i];
+		}
+	}
+
+#ifdef VKM_TRANSFORM_X86
+	static void sincosSse2(__m128 x, __m128& sinOut, __m128& cosOut) {
+		const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000u)));
+		__m128 sinSign = _mm_and_ps(x, signMask);
+		x = _mm_andnot_ps(signMask, x);
+
+		// Octant, rounded up to even
+		__m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(FOUR_OVER_PI)));
+		octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+		__m128 y = _mm_cvtepi32_ps(octant);
+
+		__m128 sinSwap = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29));
+		__m128 polyMask = _mm_castsi128_ps(
+			_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_setzero_si128()));
+		__m128 cosSign = _mm_castsi128_ps(
+			_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+		sinSign = _mm_xor_ps(sinSign, sinSwap);
+
+		x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(DP1)));
+		x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(DP2)));
+		x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(DP3)));
+		__m128 z = _mm_mul_ps(x, x);
+
+		__m128 cosPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_P0), z), _mm_set1_ps(COS_P1));
+		cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(COS_P2));
+		cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+		cosPoly = _mm_sub_ps(cosPoly, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+		cosPoly = _mm_add_ps(cosPoly, _mm_set1_ps(1.f));
+
+		__m128 sinPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P0), z), _mm_set1_ps(SIN_P1));
+		sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(SIN_P2));
+		sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+
+		// Octants 1, 2, 5 and 6 swap the polynomials
+		__m128 sinValue = _mm_or_ps(_mm_and_ps(polyMask, sinPoly), _mm_andnot_ps(polyMask, cosPoly));
+		__m128 cosValue = _mm_or_ps(_mm_and_ps(polyMask, cosPoly), _mm_andnot_ps(polyMask, sinPoly));
+		sinOut = _mm_xor_ps(sinValue, sinSign);
+		cosOut = _mm_xor_ps(cosValue, cosSign);
+	}
+
+	static void computeSse2(VkmTransformBatch& batch, uint32_t paddedCount) {
+		for (uint32_t i = 0; i < paddedCount; i += 4) {
+			__m128 s, c;
+			sincosSse2(_mm_loadu_ps(&batch.rotation[i]), s, c);
+			__m128 sx = _mm_loadu_ps(&batch.scaleX[i]);
+			__m128 sy = _mm_loadu_ps(&batch.scaleY[i]);
+			_mm_storeu_ps(&batch.col0x[i], _mm_mul_ps(c, sx));
+			_mm_storeu_ps(&batch.col0y[i], _mm_mul_ps(s, sx));
+			_mm_storeu_ps(&batch.col1x[i], _mm_xor_ps(_mm_mul_ps(s, sy), _mm_set1_ps(-0.f)));
+			_mm_storeu_ps(&batch.col1y[i], _mm_mul_ps(c, sy));
+		}
+	}
+
+	VKM_TARGET_AVX2 static void sincosAvx2(__m256 x, __m256& sinOut, __m256& cosOut) {
+		const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(0x80000000u)));
+		__m256 sinSign = _mm256_and_ps(x, signMask);
+		x = _mm256_andnot_ps(signMask, x);
+
+		__m256i octant = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(FOUR_OVER_PI)));
+		octant = _mm256_and_si256(_mm256_add_epi32(octant, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+		__m256 y = _mm256_cvtepi32_ps(octant);
+
+		__m256 sinSwap = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(4)), 29));
+		__m256 polyMask = _mm256_castsi256_ps(
+			_mm256_cmpeq_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+		__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(
+			_mm256_andnot_si256(_mm256_sub_epi32(octant, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+		sinSign = _mm256_xor_ps(sinSign, sinSwap);
+
+		x = _mm256_add_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(DP1)));
+		x = _mm256_add_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(DP2)));
+		x = _mm256_add_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(DP3)));
+		__m256 z = _mm256_mul_ps(x, x);
+
+		__m256 cosPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(COS_P0), z), _mm256_set1_ps(COS_P1));
+		cosPoly = _mm256_add_ps(_mm256_mul_ps(cosPoly, z), _mm256_set1_ps(COS_P2));
+		cosPoly = _mm256_mul_ps(_mm256_mul_ps(cosPoly, z), z);
+		cosPoly = _mm256_sub_ps(cosPoly, _mm256_mul_ps(z, _mm256_set1_ps(0.5f)));
+		cosPoly = _mm256_add_ps(cosPoly, _mm256_set1_ps(1.f));
+
+		__m256 sinPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_P0), z), _mm256_set1_ps(SIN_P1));
+		sinPoly = _mm256_add_ps(_mm256_mul_ps(sinPoly, z), _mm256_set1_ps(SIN_P2));
+		sinPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sinPoly, z), x), x);
+
+		sinOut = _mm256_xor_ps(_mm256_blendv_ps(cosPoly, sinPoly, polyMask), sinSign);
+		cosOut = _mm256_xor_ps(_mm256_blendv_ps(sinPoly, cosPoly, polyMask), cosSign);
+	}
+
+	VKM_TARGET_AVX2 static void computeAvx2(VkmTransformBatch& batch, uint32_t paddedCount) {
+		for (uint32_t i = 0; i < paddedCount; i += 8) {
+			__m256 s, c;
+			sincosAvx2(_mm256_loadu_ps(&batch.rotation[i]), s, c);
+			__m256 sx = _mm256_loadu_ps(&batch.scaleX[i]);
+			__m256 sy = _mm256_loadu_ps(&batch.scaleY[i]);
+			_mm256_storeu_ps(&batch.col0x[i], _mm256_mul_ps(c, sx));
+			_mm256_storeu_ps(&batch.col0y[i], _mm256_mul_ps(s, sx));
+			_mm256_storeu_ps(&batch.col1x[i], _mm256_xor_ps(_mm256_mul_ps(s, sy), _mm256_set1_ps(-0.f)));
+			_mm256_storeu_ps(&batch.col1y[i], _mm256_mul_ps(c, sy));
+		}
+	}
+#endif
+
+	VkmTransformBatch::Kernel VkmTransformBatch::bestKernel() {
+		static const Kernel best = []() {
+#ifdef VKM_TRANSFORM_X86
+			// SSE2 is part of x86-64. AVX2 needs the CPU bit and the OS saving the YMM registers (XCR0 bits 1 and 2)
+			unsigned int leaf1[4] = {};
+			unsigned int leaf7[4] = {};
+#if defined(_MSC_VER)
+			__cpuidex(reinterpret_cast<int*>(leaf1), 1, 0);
+			__cpuidex(reinterpret_cast<int*>(leaf7), 7, 0);
+#else
+			__cpuid_count(1, 0, leaf1[0], leaf1[1], leaf1[2], leaf1[3]);
+			__cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+#endif
+			const bool osxsave = (leaf1[2] & (1u << 27)) != 0;
+			const bool avx = (leaf1[2] & (1u << 28)) != 0;
+			const bool avx2 = (leaf7[1] & (1u << 5)) != 0;
+			if (osxsave && avx && avx2) {
+#if defined(_MSC_VER)
+				unsigned long long xcr0 = _xgetbv(0);
+#else
+				unsigned int xcr0Low, xcr0High;
+				__asm__ volatile("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+				unsigned long long xcr0 = xcr0Low;
+#endif
+				if ((xcr0 & 0x6) == 0x6) {
+					return Kernel::Avx2;
+				}
+			}
+			return Kernel::Sse2;
+#else
+			return Kernel::Scalar;
+#endif
+		}();
+		return best;
+	}
+
+	const char* VkmTransformBatch::kernelName(Kernel kernel) {
+		switch (kernel) {
+		case Kernel::Avx2: return "AVX2";
+		case Kernel::Sse2: return "SSE2";
+		default: return "scalar";
+		}
+	}
+
+	void VkmTransformBatch::setKernel(Kernel newKernel) {
+		kernel = static_cast<int>(newKernel) <= static_cast<int>(bestKernel()) ? newKernel : bestKernel();
+	}
+
+	void VkmTransformBatch::resize(uint32_t newCount) {
+		count = newCount;
+		const size_t padded = (static_cast<size_t>(newCount) + PADDING - 1) / PADDING * PADDING;
+		// Padding lanes hold harmless values (rotation 0, scale 1) so the kernels can run over them
+		translationX.resize(padded, 0.f);
+		translationY.resize(padded, 0.f);
+		scaleX.resize(padded, 1.f);
+		scaleY.resize(padded, 1.f);
+		rotation.resize(padded, 0.f);
+		col0x.resize(padded);
+		col0y.resize(padded);
+		col1x.resize(padded);
+		col1y.resize(padded);
+	}
+
+	void VkmTransformBatch::advanceRotations(float step) {
+		// Simple enough for the compiler to vectorize on its own
+		const float twoPi = 2.f * glm::pi<float>();
+		for (uint32_t i = 0; i < count; i++) {
+			float value = rotation[i] + step * static_cast<float>(i + 1);
+			rotation[i] = value - twoPi * std::floor(value / twoPi);
+		}
+	}
+
+	void VkmTransformBatch::computeMatrices() {
+		const uint32_t paddedCount = static_cast<uint32_t>(rotation.size());
+		switch (kernel) {
+#ifdef VKM_TRANSFORM_X86
+		case Kernel::Avx2:
+			computeAvx2(*this, paddedCount);
+			break;
+		case Kernel::Sse2:
+			computeSse2(*this, paddedCount);
+			break;
+#endif
+		default:
+			computeScalar(*this, count);
+			break;
+		}
+	}
+
+} // Namespace vkm
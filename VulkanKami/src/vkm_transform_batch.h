@@ -0,0 +1,58 @@
+#pragma once
+
+#include "vkm_components.h"
+
+// Standard Library
+#include <cstdint>
+#include <vector>
+
+namespace vkm {
+
+	// Structure of arrays copy of every object's Transform2dComponent. computeMatrices does the sin/cos and
+	// the rotation * scale product for all objects in one pass, 4 (SSE2) or 8 (AVX2) at a time.
+	// The kernel is picked from CPUID once, arrays are padded to a multiple of 8 so there is no scalar tail
+	class VkmTransformBatch {
+	public:
+		enum class Kernel { Scalar, Sse2, Avx2 };
+
+		// Widest kernel this CPU (and OS) supports
+		static Kernel bestKernel();
+		static const char* kernelName(Kernel kernel);
+
+		VkmTransformBatch() : kernel{ bestKernel() } {}
+
+		void resize(uint32_t count);
+		uint32_t size() const { return count; }
+
+		void set(uint32_t i, const Transform2dComponent& transform) {
+			translationX[i] = transform.translation.x;
+			translationY[i] = transform.translation.y;
+			scaleX[i] = transform.scale.x;
+			scaleY[i] = transform.scale.y;
+			rotation[i] = transform.rotation;
+		}
+
+		// rotation[i] = mod(rotation[i] + step * (i + 1), 2pi), the per index spin the transform benchmark times
+		void advanceRotations(float step);
+		void computeMatrices();
+
+		// Same matrix Transform2dComponent::mat2 returns
+		glm::mat2 matrix(uint32_t i) const { return { { col0x[i], col0y[i] }, { col1x[i], col1y[i] } }; }
+
+		// Only for benchmarks/tests, unsupported kernels fall back to the best supported one
+		void setKernel(Kernel newKernel);
+		Kernel getKernel() const { return kernel; }
+
+		// Inputs
+		std::vector<float> translationX, translationY;
+		std::vector<float> scaleX, scaleY;
+		std::vector<float> rotation;
+		// Outputs, the mat2 columns
+		std::vector<float> col0x, col0y, col1x, col1y;
+
+	private:
+		Kernel kernel;
+		uint32_t count = 0;
+	};
+
+} // Namespace vkm
@@ -18,10 +18,13 @@ namespace vkm {
 
 		bool shouldClose() { return glfwWindowShouldClose(window); } // Wrapper function
 		VkExtent2D getExtent() { return { static_cast<uint32_t>(width), static_cast<uint32_t>(height) }; }
+		// Zero sized framebuffer, there is no swap chain to render into until it's restored
+		bool isMinimized() const { return width == 0 || height == 0; }
 		bool wasWindowResized() { return frameBufferResized; }
 		void resetWindowResizedFlag() { frameBufferResized = false; }
 
 		void createWindowSurface(VkInstance instance, VkSurfaceKHR *surface);
+		GLFWwindow *getGLFWwindow() const { return window; }
 	private:
 		static void framebufferResizeCallback(GLFWwindow *window, int width, int height);
 		void initWindow();